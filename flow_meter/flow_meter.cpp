@@ -48,6 +48,7 @@
 #include <getopt.h>
 #include <string>
 #include <iostream>
+#include <sstream>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -62,7 +63,9 @@
 #include "flowifc.h"
 #include "pcapreader.h"
 #include "nhtflowcache.h"
+#include "packetring.h"
 #include "unirecexporter.h"
+#include "ipfixexporter.h"
 #include "stats.h"
 #include "fields.h"
 
@@ -71,11 +74,15 @@
 #include "sipplugin.h"
 #include "ntpplugin.h"
 #include "arpplugin.h"
+#include "pstatsplugin.h"
+#include "tlsplugin.h"
+#include "pluginmodule.h"
 
 using namespace std;
 
 trap_module_info_t *module_info = NULL;
 static int stop = 0;
+static int checkpoint = 0;
 
 #define MODULE_BASIC_INFO(BASIC) \
   BASIC("Flow meter module", "Convert packets from PCAP file or network interface into flow records.", 0, -1)
@@ -83,26 +90,32 @@ static int stop = 0;
 #define MODULE_PARAMS(PARAM) \
   PARAM('p', "plugins", "Activate specified parsing plugins. Output interface for each plugin correspond the order which you specify items in -i and -p param. "\
   "For example: \'-i u:a,u:b,u:c -p http,basic,dns\' http traffic will be send to interface u:a, basic flow to u:b etc. If you don't specify -p parameter, flow meter"\
-  " will require one output interface for basic flow by default. Format: plugin_name[,...] Supported plugins: http,dns,sip,ntp,basic,arp", required_argument, "string")\
+  " will require one output interface for basic flow by default. Format: plugin_name[,...] Supported plugins: http,dns,sip,ntp,basic,arp,pstats,tls or path to plugin module (*.so)", required_argument, "string")\
   PARAM('c', "count", "Quit after number of packets are captured.", required_argument, "uint32")\
   PARAM('I', "interface", "Capture from given network interface. Parameter require interface name (eth0 for example).", required_argument, "string")\
   PARAM('r', "file", "Pcap file to read. - to read from stdin.", required_argument, "string") \
   PARAM('t', "timeout", "Active and inactive timeout in seconds. Format: DOUBLE:DOUBLE. Value default means use default value 300.0:30.0.", required_argument, "string") \
   PARAM('s', "cache_size", "Size of flow cache in number of flow records. Each flow record has 176 bytes. default means use value 65536.", required_argument, "string") \
+  PARAM('g', "cache-max-size", "Allow flow cache to grow online up to given number of flow records when flows are exported prematurely because of full cache lines. Disabled by default.", required_argument, "uint32") \
   PARAM('S', "cache-statistics", "Print flow cache statistics. NUMBER specifies interval between prints.", required_argument, "float") \
   PARAM('P', "pcap-statistics", "Print pcap statistics every 5 seconds. The statistics do not behave the same way on all platforms.", no_argument, "none") \
   PARAM('m', "sample", "Sampling probability. NUMBER in 100 (DEFAULT: 100).", required_argument, "uint32") \
-  PARAM('V', "vector", "Replacement vector. 1+32 NUMBERS.", required_argument, "string")
+  PARAM('V', "vector", "Replacement vector. 1+32 NUMBERS.", required_argument, "string") \
+  PARAM('x', "ipfix", "Export flows in IPFIX messages instead of TRAP interfaces. Format: udp:HOST:PORT, tcp:HOST:PORT or file:PATH.", required_argument, "string") \
+  PARAM('C', "checkpoint", "Save active flows into given file on exit (or on SIGUSR1) and load them on start instead of exporting them.", required_argument, "string") \
+  PARAM('b', "biflow", "Aggregate both directions of a connection into one flow record with separate counters of each direction (PACKETS_REV, BYTES_REV, TCP_FLAGS_REV).", no_argument, "none") \
+  PARAM('R', "ring", "Keep recent packets in memory ring of SIZE MB and dump packets of selected flows to pcap file in directory DIR on command received on UNIX socket PATH. Format: SIZE:PATH:DIR.", required_argument, "string")
 
 /**
  * \brief Parse input plugin settings.
  * \param [in] settings String containing input plugin settings.
- * \param [out] plugins Array for storing active plugins.
+ * \param [out] plugin_wrapper Storage for active plugins and loaded plugin modules.
  * \param [in] module_options Options for plugin initialization.
  * \return Number of items specified in input string.
  */
-int parse_plugin_settings(const string &settings, vector<FlowCachePlugin *> &plugins, options_t &module_options)
+int parse_plugin_settings(const string &settings, plugins_t &plugin_wrapper, options_t &module_options)
 {
+   vector<FlowCachePlugin *> &plugins = plugin_wrapper.plugins;
    string proto;
    size_t begin = 0, end = 0;
 
@@ -143,6 +156,25 @@ int parse_plugin_settings(const string &settings, vector<FlowCachePlugin *> &plu
          tmp.push_back(plugin_opt("arp", arp, ifc_num++));
 
          plugins.push_back(new ARPPlugin(module_options, tmp));
+      } else if (proto == "pstats"){
+         vector<plugin_opt> tmp;
+         tmp.push_back(plugin_opt("pstats", pstats, ifc_num++));
+
+         plugins.push_back(new PSTATSPlugin(module_options, tmp));
+      } else if (proto == "tls"){
+         vector<plugin_opt> tmp;
+         tmp.push_back(plugin_opt("tls", tls, ifc_num++));
+
+         plugins.push_back(new TLSPlugin(module_options, tmp));
+      } else if (proto.length() > 3 && proto.compare(proto.length() - 3, 3, ".so") == 0) {
+         void *handle;
+         FlowCachePlugin *plugin = load_plugin_module(proto, module_options, ifc_num++, handle);
+         if (plugin == NULL) {
+            return -1;
+         }
+
+         plugin_wrapper.modules.push_back(handle);
+         plugins.push_back(plugin);
       } else {
          fprintf(stderr, "Unsupported plugin: \"%s\"\n", proto.c_str());
          return -1;
@@ -222,14 +254,13 @@ bool str_to_double(const char *str, double &dst)
 }
 
 /**
- * \brief Convert double to struct timeval.
+ * \brief Convert double in seconds to time in nanoseconds.
  * \param [in] value Value to convert.
- * \param [out] time Struct for storing converted time.
+ * \param [out] time Variable for storing converted time.
  */
-static inline void double_to_timeval(double value, struct timeval &time)
+static inline void double_to_timestamp(double value, timestamp_t &time)
 {
-   time.tv_sec = (long) value;
-   time.tv_usec = (value - (long) value) * 1000000;
+   time = (timestamp_t) (value * NSEC_PER_SEC);
 }
 
 /**
@@ -243,13 +274,75 @@ inline bool error(const string &e)
    return EXIT_FAILURE;
 }
 
+/**
+ * \brief Free array of packets used for bursts.
+ * \param [in] packets Array of PACKET_BURST_SIZE packets.
+ */
+void free_packets(Packet *packets)
+{
+   for (unsigned int i = 0; i < PACKET_BURST_SIZE; i++) {
+      delete [] packets[i].packet;
+   }
+   delete [] packets;
+}
+
+/**
+ * \brief Process pending command on control socket of packet ring.
+ * \param [in] ring Packet ring.
+ * \param [in] flowcache Flow cache used to compute flow ids of selected flow.
+ */
+void process_ring_command(PacketRing &ring, NHTFlowCache &flowcache)
+{
+   string command, file;
+   ring_filter_t filter;
+   int client = ring.get_command(command);
+
+   if (client == -1) {
+      return;
+   }
+   if (!parse_ring_command(command, filter, file)) {
+      ring.reply(client, "ERROR invalid command");
+      return;
+   }
+
+   if (filter.flow) {
+      Packet pkt;
+      pkt.field_indicator = (filter.ip_version == 4 ? PCKT_IPV4_MASK : PCKT_IPV6_MASK);
+      pkt.ip_proto = filter.ip_proto;
+      pkt.src_ip = filter.ip1;
+      pkt.dst_ip = filter.ip2;
+      pkt.src_port = filter.port1;
+      pkt.dst_port = filter.port2;
+      flowcache.flow_hash(pkt, filter.hash[0]);
+
+      pkt.src_ip = filter.ip2;
+      pkt.dst_ip = filter.ip1;
+      pkt.src_port = filter.port2;
+      pkt.dst_port = filter.port1;
+      flowcache.flow_hash(pkt, filter.hash[1]);
+   }
+
+   int cnt = ring.dump(filter, file);
+   if (cnt < 0) {
+      ring.reply(client, "ERROR " + ring.error_msg);
+   } else {
+      ostringstream msg;
+      msg << "OK " << cnt;
+      ring.reply(client, msg.str());
+   }
+}
+
 /**
  * \brief Signal handler function.
  * \param [in] sig Signal number.
  */
 void signal_handler(int sig)
 {
-   stop = 1;
+   if (sig == SIGUSR1) {
+      checkpoint = 1;
+   } else {
+      stop = 1;
+   }
 }
 
 int main(int argc, char *argv[])
@@ -257,14 +350,20 @@ int main(int argc, char *argv[])
    plugins_t plugin_wrapper;
    options_t options;
    options.flow_cache_size = DEFAULT_FLOW_CACHE_SIZE;
+   options.flow_cache_max_size = 0;
    options.flow_line_size = DEFAULT_FLOW_LINE_SIZE;
-   double_to_timeval(DEFAULT_INACTIVE_TIMEOUT, options.inactive_timeout);
-   double_to_timeval(DEFAULT_ACTIVE_TIMEOUT, options.active_timeout);
+   double_to_timestamp(DEFAULT_INACTIVE_TIMEOUT, options.inactive_timeout);
+   double_to_timestamp(DEFAULT_ACTIVE_TIMEOUT, options.active_timeout);
    options.replacement_string = DEFAULT_REPLACEMENT_STRING;
    options.print_stats = true; /* Plugins, FlowCache stats ON. */
    options.print_pcap_stats = false;
    options.interface = "";
    options.basic_ifc_num = 0;
+   options.checkpoint_file = "";
+   options.biflow = false;
+   options.ring_size = 0;
+   options.ring_socket = "";
+   options.ring_dir = "";
 
    uint32_t pkt_limit = 0; // Limit of packets for packet parser. 0 = no limit
    int sampling = 100;
@@ -277,6 +376,7 @@ int main(int argc, char *argv[])
 
    signal(SIGTERM, signal_handler);
    signal(SIGINT, signal_handler);
+   signal(SIGUSR1, signal_handler);
 
    for (int i = 0; i < module_info->num_ifc_out; i++) {
       trap_ifcctl(TRAPIFC_OUTPUT, i, TRAPCTL_SETTIMEOUT, TRAP_WAIT);
@@ -288,7 +388,7 @@ int main(int argc, char *argv[])
       case 'p':
          {
             options.basic_ifc_num = -1;
-            int ret = parse_plugin_settings(string(optarg), plugin_wrapper.plugins, options);
+            int ret = parse_plugin_settings(string(optarg), plugin_wrapper, options);
             if (ret < 0) {
                FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
                TRAP_DEFAULT_FINALIZATION();
@@ -337,8 +437,8 @@ int main(int argc, char *argv[])
                return error("Invalid argument for option -t");
             }
 
-            double_to_timeval(tmp1, options.active_timeout);
-            double_to_timeval(tmp2, options.inactive_timeout);
+            double_to_timestamp(tmp1, options.active_timeout);
+            double_to_timestamp(tmp2, options.inactive_timeout);
          }
          break;
       case 'r':
@@ -357,6 +457,17 @@ int main(int argc, char *argv[])
             options.flow_cache_size = DEFAULT_FLOW_CACHE_SIZE;
          }
          break;
+      case 'g':
+         {
+            uint32_t tmp;
+            if (!str_to_uint32(optarg, tmp) || tmp == 0) {
+               FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+               TRAP_DEFAULT_FINALIZATION();
+               return error("Invalid argument for option -g");
+            }
+            options.flow_cache_max_size = tmp;
+         }
+         break;
       case 'S':
          {
             double tmp;
@@ -365,7 +476,7 @@ int main(int argc, char *argv[])
                TRAP_DEFAULT_FINALIZATION();
                return error("Invalid argument for option -s");
             }
-            double_to_timeval(tmp, options.cache_stats_interval);
+            double_to_timestamp(tmp, options.cache_stats_interval);
             options.print_stats = false; /* Plugins, FlowCache stats OFF.*/
          }
          break;
@@ -392,6 +503,32 @@ int main(int argc, char *argv[])
       case 'V':
          options.replacement_string = optarg;
          break;
+      case 'x':
+         options.ipfix_target = string(optarg);
+         break;
+      case 'C':
+         options.checkpoint_file = string(optarg);
+         break;
+      case 'b':
+         options.biflow = true;
+         break;
+      case 'R':
+         {
+            string arg(optarg);
+            size_t pos = arg.find(':');
+            size_t dir_pos = (pos == string::npos ? string::npos : arg.find(':', pos + 1));
+            uint32_t tmp;
+            if (dir_pos == string::npos || !str_to_uint32(arg.substr(0, pos).c_str(), tmp) || tmp == 0 ||
+                dir_pos == pos + 1 || dir_pos + 1 == arg.length()) {
+               FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+               TRAP_DEFAULT_FINALIZATION();
+               return error("Invalid argument for option -R");
+            }
+            options.ring_size = (uint64_t) tmp << 20;
+            options.ring_socket = arg.substr(pos + 1, dir_pos - pos - 1);
+            options.ring_dir = arg.substr(dir_pos + 1);
+         }
+         break;
       default:
          FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
          TRAP_DEFAULT_FINALIZATION();
@@ -414,6 +551,12 @@ int main(int argc, char *argv[])
       TRAP_DEFAULT_FINALIZATION();
       return error("Size of flow line (32 by default) must divide size of flow cache.");
    }
+   if (options.flow_cache_max_size != 0 && (options.flow_cache_max_size < options.flow_cache_size ||
+      options.flow_cache_max_size % options.flow_line_size != 0)) {
+      FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+      TRAP_DEFAULT_FINALIZATION();
+      return error("Maximal size of flow cache must be at least size of flow cache and divisible by size of flow line.");
+   }
 
    PcapReader packetloader(options);
    if (options.interface == "") {
@@ -431,14 +574,23 @@ int main(int argc, char *argv[])
    }
 
    NHTFlowCache flowcache(options);
-   UnirecExporter flowwriter;
+   UnirecExporter unirec_exporter;
+   IpfixExporter ipfix_exporter;
+   FlowExporter *flowwriter = &unirec_exporter;
 
-   if (flowwriter.init(plugin_wrapper.plugins, module_info->num_ifc_out, options.basic_ifc_num) != 0) {
+   if (options.ipfix_target != "") {
+      if (ipfix_exporter.init(plugin_wrapper.plugins, options.ipfix_target, options.biflow) != 0) {
+         FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+         TRAP_DEFAULT_FINALIZATION();
+         return error("Unable to initialize IpfixExporter: " + ipfix_exporter.error_msg);
+      }
+      flowwriter = &ipfix_exporter;
+   } else if (unirec_exporter.init(plugin_wrapper.plugins, module_info->num_ifc_out, options.basic_ifc_num, options.biflow) != 0) {
       FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
       TRAP_DEFAULT_FINALIZATION();
       return error("Unable to initialize UnirecExporter.");
    }
-   flowcache.set_exporter(&flowwriter);
+   flowcache.set_exporter(flowwriter);
 
    if (!options.print_stats) {
       plugin_wrapper.plugins.push_back(new StatsPlugin(options.cache_stats_interval, cout));
@@ -448,36 +600,76 @@ int main(int argc, char *argv[])
       flowcache.add_plugin(plugin_wrapper.plugins[i]);
    }
 
+   PacketRing ring;
+   if (options.ring_socket != "") {
+      if (ring.init(options.ring_size, options.ring_socket, options.ring_dir) != 0) {
+         FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
+         TRAP_DEFAULT_FINALIZATION();
+         return error("Unable to initialize packet ring: " + ring.error_msg);
+      }
+      flowcache.set_packet_ring(&ring);
+   }
+
    flowcache.init();
+   if (options.checkpoint_file != "" && flowcache.load(options.checkpoint_file) < 0) {
+      cerr << "Warning: checkpoint " << options.checkpoint_file << " was not loaded" << endl;
+   }
 
-   Packet packet;
+   Packet *packets = new Packet[PACKET_BURST_SIZE];
    int ret = 0;
    uint32_t pkt_total = 0, pkt_parsed = 0;
-   packet.packet = new char[MAXPCKTSIZE + 1];
-
-   /* Main packet capture loop. */
-   while (!stop && (ret = packetloader.get_pkt(packet)) > 0) {
-      if (ret == 3) { /* Process timeout. */
-         flowcache.export_expired(false);
-         continue;
-      }
+   bool limit_reached = false;
+   unsigned int bursts = 0;
+   for (unsigned int i = 0; i < PACKET_BURST_SIZE; i++) {
+      packets[i].packet = new char[MAXPCKTSIZE + 1];
+   }
 
-      pkt_total++;
-      if (ret == 2 && (sampling == 100 || ((rand() % 100) + 1) <= sampling)) {
-         flowcache.put_pkt(packet);
-         pkt_parsed++;
+   /* Main packet capture loop. Packets are passed to flow cache in bursts. */
+   while (!stop && !limit_reached) {
+      int burst_cnt = 0;
 
-         /* Check if packet limit is reached. */
-         if (pkt_limit != 0 && pkt_parsed >= pkt_limit) {
+      while (burst_cnt < (int) PACKET_BURST_SIZE && (ret = packetloader.get_pkt(packets[burst_cnt])) > 0) {
+         if (ret == 3) { /* Process timeout. */
             break;
          }
+
+         pkt_total++;
+         if (ret == 2 && (sampling == 100 || ((rand() % 100) + 1) <= sampling)) {
+            burst_cnt++;
+            pkt_parsed++;
+
+            /* Check if packet limit is reached. */
+            if (pkt_limit != 0 && pkt_parsed >= pkt_limit) {
+               limit_reached = true;
+               break;
+            }
+         }
+      }
+
+      if (burst_cnt > 0) {
+         flowcache.put_pkts(packets, burst_cnt);
+      }
+      if (checkpoint) {
+         checkpoint = 0;
+         if (options.checkpoint_file != "") {
+            flowcache.save(options.checkpoint_file, false);
+         }
+      }
+      if (options.ring_socket != "" && (ret == 3 || ++bursts % RING_POLL_BURSTS == 0)) {
+         process_ring_command(ring, flowcache);
+      }
+      if (ret == 3) {
+         flowcache.export_expired(false);
+         flowwriter->flush();
+      } else if (ret <= 0) {
+         break;
       }
    }
 
    if (ret < 0) {
       packetloader.close();
-      flowwriter.close();
-      delete [] packet.packet;
+      flowwriter->close();
+      free_packets(packets);
       FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
       TRAP_DEFAULT_FINALIZATION();
       return error("Error during reading: " + packetloader.error_msg);
@@ -490,10 +682,10 @@ int main(int argc, char *argv[])
 
    /* Cleanup. */
    flowcache.finish();
-   flowwriter.close();
+   flowwriter->close();
    packetloader.close();
 
-   delete [] packet.packet;
+   free_packets(packets);
    FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS);
    TRAP_DEFAULT_FINALIZATION();
 
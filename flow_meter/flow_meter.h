@@ -47,6 +47,7 @@
 #define MAIN_H
 
 #include <stdint.h>
+#include <dlfcn.h>
 #include <string>
 #include <vector>
 
@@ -60,6 +61,8 @@ const unsigned int DEFAULT_FLOW_CACHE_SIZE = 65536;
 const unsigned int DEFAULT_FLOW_CACHE_SIZE = FLOW_CACHE_SIZE;
 #endif
 const unsigned int DEFAULT_FLOW_LINE_SIZE = 32;
+const unsigned int PACKET_BURST_SIZE = 32;
+const unsigned int RING_POLL_BURSTS = 16; /**< Number of packet bursts between checks of packet ring control socket. */
 const double DEFAULT_INACTIVE_TIMEOUT = 30.0;
 const double DEFAULT_ACTIVE_TIMEOUT = 300.0;
 const string DEFAULT_REPLACEMENT_STRING = \
@@ -73,13 +76,20 @@ struct options_t {
    bool print_stats;
    bool print_pcap_stats;
    uint32_t flow_cache_size;
+   uint32_t flow_cache_max_size;
    uint32_t flow_line_size;
-   struct timeval inactive_timeout;
-   struct timeval active_timeout;
-   struct timeval cache_stats_interval;
+   timestamp_t inactive_timeout;
+   timestamp_t active_timeout;
+   timestamp_t cache_stats_interval;
    string interface;
    string pcap_file;
    string replacement_string;
+   string ipfix_target;
+   string checkpoint_file;
+   bool biflow;
+   uint64_t ring_size;
+   string ring_socket;
+   string ring_dir;
 };
 
 /**
@@ -87,6 +97,7 @@ struct options_t {
  */
 struct plugins_t {
    vector<FlowCachePlugin *> plugins;
+   vector<void *> modules; /**< Handles of shared objects of plugins loaded at runtime. */
 
    /**
     * \brief Destructor.
@@ -95,6 +106,9 @@ struct plugins_t {
       for (unsigned int i = 0; i < plugins.size(); i++) {
          delete plugins[i];
       }
+      for (unsigned int i = 0; i < modules.size(); i++) {
+         dlclose(modules[i]);
+      }
    }
 };
 
@@ -75,6 +75,21 @@ public:
     */
    virtual int put_pkt(Packet &pkt) = 0;
 
+   /**
+    * \brief Put burst of packets into the cache.
+    * Implementations may process the burst in stages to overlap memory accesses of individual packets.
+    * \param [in] pkts Array of input parsed packets.
+    * \param [in] count Number of packets in array.
+    * \return 0 on success.
+    */
+   virtual int put_pkts(Packet *pkts, int count)
+   {
+      for (int i = 0; i < count; i++) {
+         put_pkt(pkts[i]);
+      }
+      return 0;
+   }
+
    /**
     * \brief Initialize flow cache.
     * Should be called before first call of recv_pkt, after all plugins are added.
@@ -113,6 +128,15 @@ public:
 protected:
    //Every FlowCache implementation should call these functions at appropriate places
 
+   /**
+    * \brief Get number of added plugins.
+    * Allows an implementation to select code path without plugin calls.
+    */
+   unsigned int plugins_count() const
+   {
+      return plugins.size();
+   }
+
    /**
     * \brief Initialize added plugins.
     */
@@ -192,6 +216,24 @@ protected:
       }
    }
 
+   /**
+    * \brief Create extension from checkpoint data using plugin which owns its type.
+    * \param [in] ext_type Extension type.
+    * \param [in] buffer Serialized extension data.
+    * \param [in] size Size of data.
+    * \return New extension or NULL if no plugin recognized the type.
+    */
+   RecordExt *plugins_deserialize_ext(uint16_t ext_type, const uint8_t *buffer, int size)
+   {
+      for (unsigned int i = 0; i < plugins.size(); i++) {
+         RecordExt *ext = plugins[i]->deserialize_ext(ext_type, buffer, size);
+         if (ext != NULL) {
+            return ext;
+         }
+      }
+      return NULL;
+   }
+
    /**
     * \brief Call finish function for each added plugin.
     */
@@ -180,6 +180,28 @@ public:
       return "";
    }
 
+   /**
+    * \brief Get IPFIX information elements of given extension.
+    * \param [in] ext_type Extension type registered by plugin.
+    * \return Elements in order they are written by RecordExt::fillIPFIX, empty if extension is not exported over IPFIX.
+    */
+   virtual vector<ipfix_field_t> get_ipfix_fields(uint16_t ext_type)
+   {
+      return vector<ipfix_field_t>();
+   }
+
+   /**
+    * \brief Create extension from data stored in flow cache checkpoint.
+    * \param [in] ext_type Extension type registered by plugin.
+    * \param [in] buffer Data written by RecordExt::serialize.
+    * \param [in] size Size of data.
+    * \return New extension or NULL if extension type does not belong to plugin.
+    */
+   virtual RecordExt *deserialize_ext(uint16_t ext_type, const uint8_t *buffer, int size)
+   {
+      return NULL;
+   }
+
    /**
     * \brief Check if plugin require basic flow fields in unirec template.
     * \return True if basic flow is need to be included, false otherwise.
@@ -69,6 +69,28 @@ public:
     * \return 0 on success
     */
    virtual int export_packet(Packet &pkt) = 0;
+
+   /**
+    * \brief Send buffered records.
+    * Called by flow cache after periodic export of expired flows.
+    */
+   virtual void flush()
+   {
+   }
+
+   /**
+    * \brief Close connection and free resources.
+    */
+   virtual void close()
+   {
+   }
+
+   /**
+    * \brief Virtual destructor.
+    */
+   virtual ~FlowExporter()
+   {
+   }
 };
 
 #endif
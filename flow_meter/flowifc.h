@@ -51,11 +51,32 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
 #include <unirec/unirec.h>
 
 #include "ipaddr.h"
 #include "fields.h"
 
+#define NSEC_PER_SEC 1000000000ULL
+
+/**
+ * \brief Timestamp or time interval in nanoseconds, timestamps are counted from the Epoch.
+ */
+typedef uint64_t timestamp_t;
+
+/**
+ * \brief Convert timestamp to UniRec time without floating point arithmetic.
+ * Fraction of second is rounded up, so that ur_time_get_msec/usec/nsec return the original value.
+ * \param [in] ts Timestamp.
+ * \return UniRec time.
+ */
+inline ur_time_t timestamp_to_ur_time(timestamp_t ts)
+{
+   uint64_t nsec = ts % NSEC_PER_SEC;
+   return ((ts / NSEC_PER_SEC) << 32) | (((nsec << 32) + NSEC_PER_SEC - 1) / NSEC_PER_SEC);
+}
+
 // Values of field presence indicator flags (field_indicator)
 // (Names of the fields are inspired by IPFIX specification)
 #define FLW_FLOWFIELDINDICATOR       (0x1 << 0)
@@ -129,10 +150,70 @@ enum extTypeEnum {
    dns,
    sip,
    ntp,
-   arp
+   arp,
+   pstats,
+   tls,
    /* Add extension header identifiers for your plugins here */
+
+   dynamic_ext_first = 32, /**< Types from here are assigned to plugins loaded at runtime. */
+   dynamic_ext_last = 63
 };
 
+/**
+ * \brief IPFIX information element used in templates.
+ */
+struct ipfix_field_t {
+   uint32_t enterprise; /**< Private enterprise number, 0 for IANA elements. */
+   uint16_t id;         /**< Information element identifier. */
+   uint16_t length;     /**< Length of the element or IPFIX_VAR_LENGTH. */
+
+   ipfix_field_t(uint32_t enterprise, uint16_t id, uint16_t length) : enterprise(enterprise), id(id), length(length)
+   {
+   }
+};
+
+#define IPFIX_VAR_LENGTH 65535 /**< Length of variable-length information element. */
+#define IPFIX_CESNET_PEN 8057  /**< Private enterprise number used for plugin elements. */
+
+/**
+ * \brief Write variable-length IPFIX octet array.
+ * \param [out] buffer Output buffer.
+ * \param [in] size Size of output buffer.
+ * \param [in] data Data to write.
+ * \param [in] len Length of data.
+ * \return Number of bytes written or -1 if buffer is too small.
+ */
+inline int ipfix_fill_bytes(uint8_t *buffer, int size, const void *data, int len)
+{
+   int hdr_len = (len < 255 ? 1 : 3);
+
+   if (len + hdr_len > size) {
+      return -1;
+   }
+
+   if (hdr_len == 1) {
+      buffer[0] = len;
+   } else {
+      buffer[0] = 255;
+      *(uint16_t *) (buffer + 1) = htons(len);
+   }
+   memcpy(buffer + hdr_len, data, len);
+
+   return len + hdr_len;
+}
+
+/**
+ * \brief Write variable-length IPFIX string.
+ * \param [out] buffer Output buffer.
+ * \param [in] size Size of output buffer.
+ * \param [in] str String to write.
+ * \return Number of bytes written or -1 if buffer is too small.
+ */
+inline int ipfix_fill_string(uint8_t *buffer, int size, const char *str)
+{
+   return ipfix_fill_bytes(buffer, size, str, strlen(str));
+}
+
 /**
  * \brief Flow record extension base struct.
  */
@@ -157,6 +238,30 @@ struct RecordExt {
    {
    }
 
+   /**
+    * \brief Fill IPFIX data record with stored extension data.
+    * Elements must be written in order given by FlowCachePlugin::get_ipfix_fields.
+    * \param [out] buffer Output buffer.
+    * \param [in] size Size of output buffer.
+    * \return Number of bytes written or -1 if buffer is too small.
+    */
+   virtual int fillIPFIX(uint8_t *buffer, int size)
+   {
+      return 0;
+   }
+
+   /**
+    * \brief Serialize extension data into flow cache checkpoint.
+    * Data are passed back to FlowCachePlugin::deserialize_ext when checkpoint is loaded.
+    * \param [out] buffer Output buffer.
+    * \param [in] size Size of output buffer.
+    * \return Number of bytes written or -1 if extension cannot be serialized.
+    */
+   virtual int serialize(uint8_t *buffer, int size) const
+   {
+      return -1;
+   }
+
    /**
     * \brief Virtual destructor.
     */
@@ -248,8 +353,8 @@ struct Record {
  */
 struct FlowRecord : public Record {
    uint64_t field_indicator;
-   struct timeval start_timestamp;
-   struct timeval end_timestamp;
+   timestamp_t start_timestamp;
+   timestamp_t end_timestamp;
    uint8_t  ip_version;
    uint8_t  ip_proto;
    uint8_t  ip_tos;
@@ -261,6 +366,11 @@ struct FlowRecord : public Record {
    uint32_t pkt_total_cnt;
    uint64_t octet_total_length;
    uint8_t  tcp_control_bits;
+
+   /* Counters of packets sent from destination to source, used only in biflow mode. */
+   uint32_t dst_pkt_total_cnt;
+   uint64_t dst_octet_total_length;
+   uint8_t  dst_tcp_control_bits;
 };
 
 #endif
@@ -162,6 +162,43 @@ string HTTPPlugin::get_unirec_field_string()
    return HTTP_UNIREC_TEMPLATE;
 }
 
+vector<ipfix_field_t> HTTPPlugin::get_ipfix_fields(uint16_t ext_type)
+{
+   vector<ipfix_field_t> fields;
+
+   if (ext_type == http_request) {
+      fields.push_back(ipfix_field_t(IPFIX_CESNET_PEN, HTTP_IPFIX_METHOD, IPFIX_VAR_LENGTH));
+      fields.push_back(ipfix_field_t(IPFIX_CESNET_PEN, HTTP_IPFIX_HOST, IPFIX_VAR_LENGTH));
+      fields.push_back(ipfix_field_t(IPFIX_CESNET_PEN, HTTP_IPFIX_URL, IPFIX_VAR_LENGTH));
+      fields.push_back(ipfix_field_t(IPFIX_CESNET_PEN, HTTP_IPFIX_USER_AGENT, IPFIX_VAR_LENGTH));
+      fields.push_back(ipfix_field_t(IPFIX_CESNET_PEN, HTTP_IPFIX_REFERER, IPFIX_VAR_LENGTH));
+   } else if (ext_type == http_response) {
+      fields.push_back(ipfix_field_t(IPFIX_CESNET_PEN, HTTP_IPFIX_RESPONSE_CODE, 2));
+      fields.push_back(ipfix_field_t(IPFIX_CESNET_PEN, HTTP_IPFIX_CONTENT_TYPE, IPFIX_VAR_LENGTH));
+   }
+
+   return fields;
+}
+
+RecordExt *HTTPPlugin::deserialize_ext(uint16_t ext_type, const uint8_t *buffer, int size)
+{
+   if (ext_type == http_request) {
+      RecordExtHTTPReq *ext = new RecordExtHTTPReq();
+      if (ext->deserialize(buffer, size)) {
+         return ext;
+      }
+      delete ext;
+   } else if (ext_type == http_response) {
+      RecordExtHTTPResp *ext = new RecordExtHTTPResp();
+      if (ext->deserialize(buffer, size)) {
+         return ext;
+      }
+      delete ext;
+   }
+
+   return NULL;
+}
+
 /**
  * \brief Copy string and append \0 character.
  * NOTE: function removes any CR chars at the end of string.
@@ -57,6 +57,15 @@
 
 using namespace std;
 
+/* IPFIX element ids of HTTP fields (enterprise IPFIX_CESNET_PEN). */
+#define HTTP_IPFIX_METHOD        800
+#define HTTP_IPFIX_HOST          801
+#define HTTP_IPFIX_URL           802
+#define HTTP_IPFIX_USER_AGENT    803
+#define HTTP_IPFIX_REFERER       804
+#define HTTP_IPFIX_RESPONSE_CODE 805
+#define HTTP_IPFIX_CONTENT_TYPE  806
+
 /**
  * \brief Flow record extension header for storing HTTP requests.
  */
@@ -87,6 +96,60 @@ struct RecordExtHTTPReq : RecordExt {
       ur_set_string(tmplt, record, F_HTTP_USER_AGENT, httpReqUserAgent);
       ur_set_string(tmplt, record, F_HTTP_REFERER, httpReqReferer);
    }
+
+   virtual int fillIPFIX(uint8_t *buffer, int size)
+   {
+      const char *fields[] = {httpReqMethod, httpReqHost, httpReqUrl, httpReqUserAgent, httpReqReferer};
+      int len, total = 0;
+
+      for (unsigned int i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+         len = ipfix_fill_string(buffer + total, size - total, fields[i]);
+         if (len < 0) {
+            return -1;
+         }
+         total += len;
+      }
+      return total;
+   }
+
+   virtual int serialize(uint8_t *buffer, int size) const
+   {
+      const char *fields[] = {httpReqMethod, httpReqHost, httpReqUrl, httpReqUserAgent, httpReqReferer};
+      int sizes[] = {sizeof(httpReqMethod), sizeof(httpReqHost), sizeof(httpReqUrl), sizeof(httpReqUserAgent), sizeof(httpReqReferer)};
+      int total = 0;
+
+      for (unsigned int i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+         if (total + sizes[i] > size) {
+            return -1;
+         }
+         memcpy(buffer + total, fields[i], sizes[i]);
+         total += sizes[i];
+      }
+      return total;
+   }
+
+   /**
+    * \brief Restore extension from data written by serialize.
+    * \param [in] buffer Serialized data.
+    * \param [in] size Size of data.
+    * \return True on success, false if size does not match.
+    */
+   bool deserialize(const uint8_t *buffer, int size)
+   {
+      char *fields[] = {httpReqMethod, httpReqHost, httpReqUrl, httpReqUserAgent, httpReqReferer};
+      int sizes[] = {sizeof(httpReqMethod), sizeof(httpReqHost), sizeof(httpReqUrl), sizeof(httpReqUserAgent), sizeof(httpReqReferer)};
+      int total = 0;
+
+      for (unsigned int i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+         if (total + sizes[i] > size) {
+            return false;
+         }
+         memcpy(fields[i], buffer + total, sizes[i]);
+         fields[i][sizes[i] - 1] = 0;
+         total += sizes[i];
+      }
+      return total == size;
+   }
 };
 
 /**
@@ -110,6 +173,47 @@ struct RecordExtHTTPResp : RecordExt {
       ur_set(tmplt, record, F_HTTP_RESPONSE_CODE, httpRespCode);
       ur_set_string(tmplt, record, F_HTTP_CONTENT_TYPE, httpRespContentType);
    }
+
+   virtual int fillIPFIX(uint8_t *buffer, int size)
+   {
+      if (size < 2) {
+         return -1;
+      }
+      *(uint16_t *) buffer = htons(httpRespCode);
+
+      int len = ipfix_fill_string(buffer + 2, size - 2, httpRespContentType);
+      if (len < 0) {
+         return -1;
+      }
+      return len + 2;
+   }
+
+   virtual int serialize(uint8_t *buffer, int size) const
+   {
+      if (size < (int) (sizeof(httpRespCode) + sizeof(httpRespContentType))) {
+         return -1;
+      }
+      memcpy(buffer, &httpRespCode, sizeof(httpRespCode));
+      memcpy(buffer + sizeof(httpRespCode), httpRespContentType, sizeof(httpRespContentType));
+      return sizeof(httpRespCode) + sizeof(httpRespContentType);
+   }
+
+   /**
+    * \brief Restore extension from data written by serialize.
+    * \param [in] buffer Serialized data.
+    * \param [in] size Size of data.
+    * \return True on success, false if size does not match.
+    */
+   bool deserialize(const uint8_t *buffer, int size)
+   {
+      if (size != (int) (sizeof(httpRespCode) + sizeof(httpRespContentType))) {
+         return false;
+      }
+      memcpy(&httpRespCode, buffer, sizeof(httpRespCode));
+      memcpy(httpRespContentType, buffer + sizeof(httpRespCode), sizeof(httpRespContentType));
+      httpRespContentType[sizeof(httpRespContentType) - 1] = 0;
+      return true;
+   }
 };
 
 /**
@@ -124,6 +228,8 @@ public:
    int pre_update(FlowRecord &rec, Packet &pkt);
    void finish();
    string get_unirec_field_string();
+   vector<ipfix_field_t> get_ipfix_fields(uint16_t ext_type);
+   RecordExt *deserialize_ext(uint16_t ext_type, const uint8_t *buffer, int size);
 
 private:
    bool parse_http_request(const char *data, int payload_len, RecordExtHTTPReq *rec, bool create);
@@ -0,0 +1,606 @@
+/**
+ * \file ipfixexporter.cpp
+ * \brief Flow exporter sending flows in IPFIX messages
+ * \date 2016
+ */
+/*
+ * Copyright (C) 2016 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <endian.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "ipfixexporter.h"
+#include "flowifc.h"
+
+using namespace std;
+
+/* IANA information elements used for basic flow fields. */
+#define IPFIX_IE_OCTET_DELTA_COUNT        1
+#define IPFIX_IE_PACKET_DELTA_COUNT       2
+#define IPFIX_IE_PROTOCOL_IDENTIFIER      4
+#define IPFIX_IE_IP_CLASS_OF_SERVICE      5
+#define IPFIX_IE_TCP_CONTROL_BITS         6
+#define IPFIX_IE_SOURCE_TRANSPORT_PORT    7
+#define IPFIX_IE_SOURCE_IPV4_ADDRESS      8
+#define IPFIX_IE_DESTINATION_TRANSPORT_PORT 11
+#define IPFIX_IE_DESTINATION_IPV4_ADDRESS 12
+#define IPFIX_IE_SOURCE_IPV6_ADDRESS      27
+#define IPFIX_IE_DESTINATION_IPV6_ADDRESS 28
+#define IPFIX_IE_FLOW_START_NANOSECONDS   156
+#define IPFIX_IE_FLOW_END_NANOSECONDS     157
+#define IPFIX_IE_IP_TTL                   192
+
+#define IPFIX_REVERSE_PEN 29305 /**< Enterprise number of reverse information elements (RFC 5103). */
+#define NTP_EPOCH_OFFSET 2208988800ULL /**< Seconds between NTP (1900) and Unix epoch. */
+
+/**
+ * \brief Convert timestamp to dateTimeNanoseconds, i.e. NTP timestamp format (RFC 7011).
+ * \param [in] ts Timestamp.
+ * \return Seconds since 1900 in upper 32 bits, fraction of second in lower 32 bits.
+ */
+static inline uint64_t timestamp_to_ntp(timestamp_t ts)
+{
+   return ((ts / NSEC_PER_SEC + NTP_EPOCH_OFFSET) << 32) | (((ts % NSEC_PER_SEC) << 32) / NSEC_PER_SEC);
+}
+
+/**
+ * \brief Get information elements of basic flow fields.
+ * \param [in] ipv6 Create fields for IPv6 flow.
+ * \param [in] biflow Append reverse direction counters.
+ * \return Basic flow fields in order they are written by fill_basic_flow.
+ */
+static vector<ipfix_field_t> basic_flow_fields(bool ipv6, bool biflow)
+{
+   vector<ipfix_field_t> fields;
+
+   if (ipv6) {
+      fields.push_back(ipfix_field_t(0, IPFIX_IE_SOURCE_IPV6_ADDRESS, 16));
+      fields.push_back(ipfix_field_t(0, IPFIX_IE_DESTINATION_IPV6_ADDRESS, 16));
+   } else {
+      fields.push_back(ipfix_field_t(0, IPFIX_IE_SOURCE_IPV4_ADDRESS, 4));
+      fields.push_back(ipfix_field_t(0, IPFIX_IE_DESTINATION_IPV4_ADDRESS, 4));
+   }
+   fields.push_back(ipfix_field_t(0, IPFIX_IE_SOURCE_TRANSPORT_PORT, 2));
+   fields.push_back(ipfix_field_t(0, IPFIX_IE_DESTINATION_TRANSPORT_PORT, 2));
+   fields.push_back(ipfix_field_t(0, IPFIX_IE_PROTOCOL_IDENTIFIER, 1));
+   fields.push_back(ipfix_field_t(0, IPFIX_IE_PACKET_DELTA_COUNT, 8));
+   fields.push_back(ipfix_field_t(0, IPFIX_IE_OCTET_DELTA_COUNT, 8));
+   fields.push_back(ipfix_field_t(0, IPFIX_IE_FLOW_START_NANOSECONDS, 8));
+   fields.push_back(ipfix_field_t(0, IPFIX_IE_FLOW_END_NANOSECONDS, 8));
+   fields.push_back(ipfix_field_t(0, IPFIX_IE_TCP_CONTROL_BITS, 1));
+   fields.push_back(ipfix_field_t(0, IPFIX_IE_IP_CLASS_OF_SERVICE, 1));
+   fields.push_back(ipfix_field_t(0, IPFIX_IE_IP_TTL, 1));
+   if (biflow) {
+      fields.push_back(ipfix_field_t(IPFIX_REVERSE_PEN, IPFIX_IE_PACKET_DELTA_COUNT, 8));
+      fields.push_back(ipfix_field_t(IPFIX_REVERSE_PEN, IPFIX_IE_OCTET_DELTA_COUNT, 8));
+      fields.push_back(ipfix_field_t(IPFIX_REVERSE_PEN, IPFIX_IE_TCP_CONTROL_BITS, 1));
+   }
+
+   return fields;
+}
+
+/**
+ * \brief Append information elements to template record.
+ * \param [in,out] rec Template record.
+ * \param [in] fields Elements to append.
+ * \return Number of appended elements.
+ */
+static int append_template_fields(vector<uint8_t> &rec, const vector<ipfix_field_t> &fields)
+{
+   for (unsigned int i = 0; i < fields.size(); i++) {
+      uint16_t id = fields[i].id | (fields[i].enterprise != 0 ? 0x8000 : 0);
+      rec.push_back(id >> 8);
+      rec.push_back(id & 0xFF);
+      rec.push_back(fields[i].length >> 8);
+      rec.push_back(fields[i].length & 0xFF);
+      if (fields[i].enterprise != 0) {
+         rec.push_back(fields[i].enterprise >> 24);
+         rec.push_back((fields[i].enterprise >> 16) & 0xFF);
+         rec.push_back((fields[i].enterprise >> 8) & 0xFF);
+         rec.push_back(fields[i].enterprise & 0xFF);
+      }
+   }
+   return fields.size();
+}
+
+/**
+ * \brief Constructor.
+ */
+IpfixExporter::IpfixExporter() : transport(TRANSPORT_UDP), fd(-1), file(NULL), biflow(false), max_msg_size(0), msg(NULL), rec(NULL),
+   sequence(0), next_template_id(IPFIX_FIRST_TEMPLATE_ID), last_refresh(0), dropped(0)
+{
+}
+
+/**
+ * \brief Destructor.
+ */
+IpfixExporter::~IpfixExporter()
+{
+   close_target();
+   free_templates();
+   delete [] msg;
+   delete [] rec;
+}
+
+/**
+ * \brief Initialize exporter.
+ * \param [in] plugins Active plugins.
+ * \param [in] target Output specification: udp:HOST:PORT, tcp:HOST:PORT or file:PATH.
+ * \param [in] biflow_mode Export reverse direction counters of biflows.
+ * \return 0 on success or negative value when error occur, error_msg is filled with error message.
+ */
+int IpfixExporter::init(const vector<FlowCachePlugin *> &plugins, const string &target, bool biflow_mode)
+{
+   biflow = biflow_mode;
+
+   size_t delim = target.find(':');
+   if (delim == string::npos) {
+      error_msg = "invalid IPFIX target " + target;
+      return -1;
+   }
+
+   string type = target.substr(0, delim);
+   if (type == "file") {
+      transport = TRANSPORT_FILE;
+      file_name = target.substr(delim + 1);
+   } else if (type == "udp" || type == "tcp") {
+      transport = (type == "udp" ? TRANSPORT_UDP : TRANSPORT_TCP);
+      size_t port_delim = target.rfind(':');
+      if (port_delim == delim) {
+         error_msg = "missing collector port in IPFIX target " + target;
+         return -1;
+      }
+      host = target.substr(delim + 1, port_delim - delim - 1);
+      port = target.substr(port_delim + 1);
+   } else {
+      error_msg = "unsupported IPFIX transport " + type;
+      return -1;
+   }
+   max_msg_size = (transport == TRANSPORT_UDP ? IPFIX_UDP_MESSAGE_SIZE : IPFIX_MESSAGE_SIZE);
+
+   for (unsigned int i = 0; i < plugins.size(); i++) {
+      vector<plugin_opt> &opts = plugins[i]->get_options();
+      for (unsigned int j = 0; j < opts.size(); j++) {
+         vector<ipfix_field_t> fields = plugins[i]->get_ipfix_fields(opts[j].ext_type);
+         if (!fields.empty() && opts[j].ext_type < 64) {
+            ext_fields[opts[j].ext_type] = fields;
+         }
+      }
+   }
+
+   msg = new uint8_t[max_msg_size];
+   rec = new uint8_t[max_msg_size];
+
+   return open_target();
+}
+
+/**
+ * \brief Send buffered records and close output.
+ */
+void IpfixExporter::close()
+{
+   flush();
+   close_target();
+   free_templates();
+
+   if (dropped != 0) {
+      fprintf(stderr, "IpfixExporter: %lu records were dropped\n", (unsigned long) dropped);
+   }
+}
+
+/**
+ * \brief Open output file or connect to collector.
+ * \return 0 on success, -1 on error and error_msg is filled.
+ */
+int IpfixExporter::open_target()
+{
+   if (transport == TRANSPORT_FILE) {
+      file = fopen(file_name.c_str(), "wb");
+      if (file == NULL) {
+         error_msg = "unable to open " + file_name + ": " + strerror(errno);
+         return -1;
+      }
+   } else {
+      struct addrinfo hints, *res, *ai;
+      memset(&hints, 0, sizeof(hints));
+      hints.ai_family = AF_UNSPEC;
+      hints.ai_socktype = (transport == TRANSPORT_UDP ? SOCK_DGRAM : SOCK_STREAM);
+
+      int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+      if (err != 0) {
+         error_msg = "unable to resolve " + host + ": " + gai_strerror(err);
+         return -1;
+      }
+
+      for (ai = res; ai != NULL; ai = ai->ai_next) {
+         fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+         if (fd < 0) {
+            continue;
+         }
+         if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+         }
+         ::close(fd);
+         fd = -1;
+      }
+      freeaddrinfo(res);
+
+      if (fd < 0) {
+         error_msg = "unable to connect to collector " + host + ":" + port;
+         return -1;
+      }
+   }
+
+   /* New connection or file has to start with templates. */
+   for (map<uint64_t, ipfix_template_t *>::iterator it = templates.begin(); it != templates.end(); ++it) {
+      it->second->exported = false;
+   }
+   last_refresh = time(NULL);
+
+   return 0;
+}
+
+/**
+ * \brief Close output file or connection.
+ */
+void IpfixExporter::close_target()
+{
+   if (file != NULL) {
+      fclose(file);
+      file = NULL;
+   }
+   if (fd >= 0) {
+      ::close(fd);
+      fd = -1;
+   }
+}
+
+/**
+ * \brief Free templates and their buffers.
+ */
+void IpfixExporter::free_templates()
+{
+   for (map<uint64_t, ipfix_template_t *>::iterator it = templates.begin(); it != templates.end(); ++it) {
+      delete [] it->second->data;
+      delete it->second;
+   }
+   templates.clear();
+}
+
+/**
+ * \brief Write message to output.
+ * \param [in] msg Message to send.
+ * \param [in] len Length of message.
+ * \return 0 on success, -1 on error.
+ */
+int IpfixExporter::send_message(const uint8_t *msg, uint16_t len)
+{
+   if (transport == TRANSPORT_FILE) {
+      return (fwrite(msg, len, 1, file) == 1 ? 0 : -1);
+   }
+
+   if (transport == TRANSPORT_UDP) {
+      return (send(fd, msg, len, 0) == len ? 0 : -1);
+   }
+
+   while (len > 0) {
+      ssize_t sent = send(fd, msg, len, MSG_NOSIGNAL);
+      if (sent < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         return -1;
+      }
+      msg += sent;
+      len -= sent;
+   }
+   return 0;
+}
+
+/**
+ * \brief Find template for flow or create a new one.
+ * \param [in] ipv6 Flow is IPv6 flow.
+ * \param [in] ext_mask Bit mask of exported extension types.
+ * \return Pointer to template.
+ */
+ipfix_template_t *IpfixExporter::get_template(bool ipv6, uint64_t ext_mask)
+{
+   uint64_t key = (ext_mask << 1) | ipv6;
+   map<uint64_t, ipfix_template_t *>::iterator it = templates.find(key);
+   if (it != templates.end()) {
+      return it->second;
+   }
+
+   ipfix_template_t *tmplt = new ipfix_template_t;
+   tmplt->id = next_template_id++;
+   tmplt->data = new uint8_t[max_msg_size];
+   tmplt->data_len = 0;
+   tmplt->records = 0;
+   tmplt->exported = false;
+
+   /* Template record header, field count is filled below. */
+   tmplt->tmplt_rec.push_back(tmplt->id >> 8);
+   tmplt->tmplt_rec.push_back(tmplt->id & 0xFF);
+   tmplt->tmplt_rec.push_back(0);
+   tmplt->tmplt_rec.push_back(0);
+
+   int field_cnt = append_template_fields(tmplt->tmplt_rec, basic_flow_fields(ipv6, biflow));
+   for (map<uint16_t, vector<ipfix_field_t> >::iterator ext = ext_fields.begin(); ext != ext_fields.end(); ++ext) {
+      if (ext_mask & ((uint64_t) 1 << ext->first)) {
+         tmplt->ext_types.push_back(ext->first);
+         field_cnt += append_template_fields(tmplt->tmplt_rec, ext->second);
+      }
+   }
+   tmplt->tmplt_rec[2] = field_cnt >> 8;
+   tmplt->tmplt_rec[3] = field_cnt & 0xFF;
+
+   templates[key] = tmplt;
+   return tmplt;
+}
+
+/**
+ * \brief Write basic flow fields.
+ * \param [in] flow Flow record.
+ * \param [in] ipv6 Flow is IPv6 flow.
+ * \param [out] buffer Output buffer.
+ * \param [in] size Size of output buffer.
+ * \return Number of bytes written or -1 if buffer is too small.
+ */
+int IpfixExporter::fill_basic_flow(const FlowRecord &flow, bool ipv6, uint8_t *buffer, int size)
+{
+   uint8_t *p = buffer;
+
+   if (size < (ipv6 ? 72 : 48) + (biflow ? 17 : 0)) {
+      return -1;
+   }
+
+   if (ipv6) {
+      memcpy(p, flow.src_ip.v6, 16);
+      memcpy(p + 16, flow.dst_ip.v6, 16);
+      p += 32;
+   } else {
+      *(uint32_t *) p = flow.src_ip.v4;
+      *(uint32_t *) (p + 4) = flow.dst_ip.v4;
+      p += 8;
+   }
+   *(uint16_t *) p = htons(flow.src_port);
+   *(uint16_t *) (p + 2) = htons(flow.dst_port);
+   p[4] = flow.ip_proto;
+   p += 5;
+   *(uint64_t *) p = htobe64(flow.pkt_total_cnt);
+   *(uint64_t *) (p + 8) = htobe64(flow.octet_total_length);
+   *(uint64_t *) (p + 16) = htobe64(timestamp_to_ntp(flow.start_timestamp));
+   *(uint64_t *) (p + 24) = htobe64(timestamp_to_ntp(flow.end_timestamp));
+   p += 32;
+   p[0] = flow.tcp_control_bits;
+   p[1] = flow.ip_tos;
+   p[2] = flow.ip_ttl;
+   p += 3;
+   if (biflow) {
+      *(uint64_t *) p = htobe64(flow.dst_pkt_total_cnt);
+      *(uint64_t *) (p + 8) = htobe64(flow.dst_octet_total_length);
+      p[16] = flow.dst_tcp_control_bits;
+      p += 17;
+   }
+
+   return p - buffer;
+}
+
+/**
+ * \brief Write data record of given template.
+ * \param [in] flow Flow record.
+ * \param [in] tmplt Template of the record.
+ * \param [out] buffer Output buffer.
+ * \param [in] size Size of output buffer.
+ * \return Number of bytes written or -1 if buffer is too small.
+ */
+int IpfixExporter::fill_record(FlowRecord &flow, const ipfix_template_t *tmplt, uint8_t *buffer, int size)
+{
+   int len = fill_basic_flow(flow, flow.ip_version == 6, buffer, size);
+   if (len < 0) {
+      return -1;
+   }
+
+   for (unsigned int i = 0; i < tmplt->ext_types.size(); i++) {
+      RecordExt *ext = flow.getExtension((extTypeEnum) tmplt->ext_types[i]);
+      int ext_len = ext->fillIPFIX(buffer + len, size - len);
+      if (ext_len < 0) {
+         return -1;
+      }
+      len += ext_len;
+   }
+
+   return len;
+}
+
+int IpfixExporter::export_flow(FlowRecord &flow)
+{
+   uint64_t ext_mask = 0;
+   for (RecordExt *ext = flow.exts; ext != NULL; ext = ext->next) {
+      if (ext_fields.find(ext->extType) != ext_fields.end()) {
+         ext_mask |= (uint64_t) 1 << ext->extType;
+      }
+   }
+
+   ipfix_template_t *tmplt = get_template(flow.ip_version == 6, ext_mask);
+   int len = fill_record(flow, tmplt, rec, max_msg_size - IPFIX_HEADER_SIZE - 2 * IPFIX_SET_HEADER_SIZE - tmplt->tmplt_rec.size());
+   if (len < 0) {
+      dropped++;
+      return -1;
+   }
+
+   if (message_size(tmplt, len) > max_msg_size) {
+      flush();
+      if (message_size(tmplt, len) > max_msg_size) {
+         dropped++;
+         return -1;
+      }
+   }
+
+   memcpy(tmplt->data + tmplt->data_len, rec, len);
+   tmplt->data_len += len;
+   tmplt->records++;
+
+   return 0;
+}
+
+/**
+ * \brief Compute size of message containing buffered records, unexported templates and a new record.
+ * \param [in] tmplt Template of the new record.
+ * \param [in] len Length of the new record.
+ * \return Size of the message.
+ */
+uint32_t IpfixExporter::message_size(const ipfix_template_t *tmplt, int len) const
+{
+   uint32_t size = IPFIX_HEADER_SIZE + len + (tmplt->records == 0 ? IPFIX_SET_HEADER_SIZE : 0);
+   bool template_set = false;
+
+   for (map<uint64_t, ipfix_template_t *>::const_iterator it = templates.begin(); it != templates.end(); ++it) {
+      const ipfix_template_t *t = it->second;
+      if (!t->exported) {
+         size += t->tmplt_rec.size();
+         template_set = true;
+      }
+      if (t->records != 0) {
+         size += IPFIX_SET_HEADER_SIZE + t->data_len;
+      }
+   }
+   if (template_set) {
+      size += IPFIX_SET_HEADER_SIZE;
+   }
+
+   return size;
+}
+
+int IpfixExporter::export_packet(Packet &pkt)
+{
+   /* Packets are not exported over IPFIX. */
+   return 0;
+}
+
+/**
+ * \brief Build IPFIX message from buffered templates and records and send it.
+ */
+void IpfixExporter::flush()
+{
+   uint32_t records = 0;
+   bool template_set = false;
+   map<uint64_t, ipfix_template_t *>::iterator it;
+
+   for (it = templates.begin(); it != templates.end(); ++it) {
+      records += it->second->records;
+      template_set |= !it->second->exported;
+   }
+   if (records == 0 && !template_set) {
+      return;
+   }
+
+   if (fd < 0 && file == NULL && open_target() != 0) {
+      dropped += records;
+      for (it = templates.begin(); it != templates.end(); ++it) {
+         it->second->data_len = 0;
+         it->second->records = 0;
+      }
+      return;
+   }
+
+   uint8_t *p = msg + IPFIX_HEADER_SIZE;
+   if (template_set) {
+      uint8_t *set = p;
+      p += IPFIX_SET_HEADER_SIZE;
+      for (it = templates.begin(); it != templates.end(); ++it) {
+         if (!it->second->exported) {
+            memcpy(p, &it->second->tmplt_rec[0], it->second->tmplt_rec.size());
+            p += it->second->tmplt_rec.size();
+         }
+      }
+      *(uint16_t *) set = htons(IPFIX_TEMPLATE_SET_ID);
+      *(uint16_t *) (set + 2) = htons(p - set);
+   }
+
+   for (it = templates.begin(); it != templates.end(); ++it) {
+      ipfix_template_t *t = it->second;
+      if (t->records == 0) {
+         continue;
+      }
+      *(uint16_t *) p = htons(t->id);
+      *(uint16_t *) (p + 2) = htons(IPFIX_SET_HEADER_SIZE + t->data_len);
+      memcpy(p + IPFIX_SET_HEADER_SIZE, t->data, t->data_len);
+      p += IPFIX_SET_HEADER_SIZE + t->data_len;
+   }
+
+   time_t now = time(NULL);
+   *(uint16_t *) msg = htons(IPFIX_VERSION);
+   *(uint16_t *) (msg + 2) = htons(p - msg);
+   *(uint32_t *) (msg + 4) = htonl(now);
+   *(uint32_t *) (msg + 8) = htonl(sequence);
+   *(uint32_t *) (msg + 12) = htonl(0); /* Observation domain id. */
+
+   if (send_message(msg, p - msg) == 0) {
+      sequence += records;
+      for (it = templates.begin(); it != templates.end(); ++it) {
+         it->second->exported = true;
+      }
+   } else {
+      dropped += records;
+      if (transport == TRANSPORT_TCP) {
+         close_target(); /* Reconnect during next flush. */
+      }
+   }
+
+   for (it = templates.begin(); it != templates.end(); ++it) {
+      it->second->data_len = 0;
+      it->second->records = 0;
+   }
+
+   if (transport == TRANSPORT_UDP && now - last_refresh >= IPFIX_TEMPLATE_REFRESH) {
+      for (it = templates.begin(); it != templates.end(); ++it) {
+         it->second->exported = false;
+      }
+      last_refresh = now;
+   }
+}
@@ -0,0 +1,126 @@
+/**
+ * \file ipfixexporter.h
+ * \brief Flow exporter sending flows in IPFIX messages
+ * \date 2016
+ */
+/*
+ * Copyright (C) 2016 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef IPFIX_EXPORTER_H
+#define IPFIX_EXPORTER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdio>
+
+#include "flowcacheplugin.h"
+#include "flowexporter.h"
+#include "packet.h"
+
+using namespace std;
+
+#define IPFIX_VERSION 10
+#define IPFIX_HEADER_SIZE 16
+#define IPFIX_SET_HEADER_SIZE 4
+#define IPFIX_TEMPLATE_SET_ID 2
+#define IPFIX_FIRST_TEMPLATE_ID 256
+
+#define IPFIX_UDP_MESSAGE_SIZE 1400   /**< Maximal size of message sent over UDP (fits into ethernet MTU). */
+#define IPFIX_MESSAGE_SIZE 65535      /**< Maximal size of message sent over TCP or written to file. */
+#define IPFIX_TEMPLATE_REFRESH 600    /**< Interval in seconds between template retransmissions over UDP. */
+
+/**
+ * \brief IPFIX template with buffered data records.
+ */
+struct ipfix_template_t {
+   uint16_t id;                  /**< Template id. */
+   vector<uint16_t> ext_types;   /**< Extensions which follow basic fields, in order. */
+   vector<uint8_t> tmplt_rec;    /**< Template record. */
+   uint8_t *data;                /**< Buffered data records of this template. */
+   uint16_t data_len;            /**< Length of buffered data records. */
+   uint32_t records;             /**< Number of buffered data records. */
+   bool exported;                /**< Template record was sent to collector. */
+};
+
+/**
+ * \brief Class for exporting flow records in IPFIX messages over UDP, TCP or into file.
+ */
+class IpfixExporter : public FlowExporter
+{
+public:
+   IpfixExporter();
+   ~IpfixExporter();
+   int init(const vector<FlowCachePlugin *> &plugins, const string &target, bool biflow_mode);
+   void close();
+   void flush();
+   int export_flow(FlowRecord &flow);
+   int export_packet(Packet &pkt);
+
+   string error_msg; /**< String to store an error messages. */
+
+private:
+   enum transport_t { TRANSPORT_UDP, TRANSPORT_TCP, TRANSPORT_FILE };
+
+   int open_target();
+   void close_target();
+   int send_message(const uint8_t *msg, uint16_t len);
+   ipfix_template_t *get_template(bool ipv6, uint64_t ext_mask);
+   int fill_basic_flow(const FlowRecord &flow, bool ipv6, uint8_t *buffer, int size);
+   int fill_record(FlowRecord &flow, const ipfix_template_t *tmplt, uint8_t *buffer, int size);
+   uint32_t message_size(const ipfix_template_t *tmplt, int len) const;
+   void free_templates();
+
+   transport_t transport;     /**< Type of output. */
+   string host;               /**< Collector address. */
+   string port;               /**< Collector port. */
+   string file_name;          /**< Output file name. */
+   int fd;                    /**< Socket descriptor. */
+   FILE *file;                /**< Output file. */
+   bool biflow;               /**< Export reverse direction counters. */
+   uint16_t max_msg_size;     /**< Maximal size of IPFIX message. */
+   uint8_t *msg;              /**< Buffer for message being sent. */
+   uint8_t *rec;              /**< Buffer for record being created. */
+   uint32_t sequence;         /**< Number of data records sent so far. */
+   uint16_t next_template_id; /**< Id assigned to next created template. */
+   time_t last_refresh;       /**< Time of the last template transmission. */
+   uint64_t dropped;          /**< Number of records which could not be exported. */
+   map<uint16_t, vector<ipfix_field_t> > ext_fields; /**< Extension type -> IPFIX elements. */
+   map<uint64_t, ipfix_template_t *> templates;     /**< Template key -> template. */
+};
+
+#endif
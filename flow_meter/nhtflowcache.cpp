@@ -46,6 +46,7 @@
  */
 
 #include <cstdlib>
+#include <cstdio>
 #include <iostream>
 #include <sys/time.h>
 #include <nemea-common/super_fast_hash.h>
@@ -63,11 +64,19 @@ using namespace std;
  * \param [in] inactive Inactive timeout.
  * \return True if flow is expired, false otherwise.
  */
-inline bool is_expired(const Flow *flow, const struct timeval &current_ts,
-                       const struct timeval &active, const struct timeval &inactive)
+inline bool is_expired(const Flow *flow, timestamp_t current_ts, timestamp_t active, timestamp_t inactive)
 {
-   if (!flow->is_empty() && ( current_ts.tv_sec - flow->flow_record.start_timestamp.tv_sec >= active.tv_sec ||
-      current_ts.tv_sec - flow->flow_record.end_timestamp.tv_sec >= inactive.tv_sec)) {
+   if (flow->is_empty()) {
+      return false;
+   }
+
+   if (flow->is_tcp_closed() && inactive > TCP_CLOSED_TIMEOUT * NSEC_PER_SEC) {
+      inactive = TCP_CLOSED_TIMEOUT * NSEC_PER_SEC;
+   }
+
+   /* Packets may come slightly out of order, timestamps of the flow can be newer than current_ts. */
+   if ((int64_t) (current_ts - flow->flow_record.start_timestamp) >= (int64_t) active ||
+      (int64_t) (current_ts - flow->flow_record.end_timestamp) >= (int64_t) inactive) {
       return true;
    } else {
       return false;
@@ -79,7 +88,48 @@ inline bool Flow::is_empty() const
    return empty_flow;
 }
 
-bool Flow::belongs(uint64_t pkt_hash, char *pkt_key, uint8_t key_len) const
+inline uint64_t Flow::get_hash() const
+{
+   return hash;
+}
+
+/**
+ * \brief Check if TCP connection of the flow was terminated by FIN or RST in any direction.
+ */
+inline bool Flow::is_tcp_closed() const
+{
+   return ((flow_record.tcp_control_bits | flow_record.dst_tcp_control_bits) & (TCP_FIN | TCP_RST)) != 0;
+}
+
+/**
+ * \brief Check if packet opens a new TCP connection on 5-tuple of a terminated flow.
+ * \param [in] pkt Packet belonging to the flow.
+ * \return True if packet is SYN without ACK and the flow has seen FIN or RST.
+ */
+bool Flow::is_tcp_restart(const Packet &pkt) const
+{
+   return (pkt.field_indicator & PCKT_TCP_MASK) == PCKT_TCP_MASK &&
+      (pkt.tcp_control_bits & (TCP_SYN | TCP_ACK)) == TCP_SYN && is_tcp_closed();
+}
+
+const char *Flow::get_key() const
+{
+   return key;
+}
+
+/**
+ * \brief Mark flow as used with given hash and key, flow record is filled by caller.
+ * \param [in] flow_hash Hash of the flow key.
+ * \param [in] flow_key Flow key (MAX_KEY_LENGTH bytes).
+ */
+void Flow::restore(uint64_t flow_hash, const char *flow_key)
+{
+   hash = flow_hash;
+   memcpy(key, flow_key, MAX_KEY_LENGTH);
+   empty_flow = false;
+}
+
+bool Flow::belongs(uint64_t pkt_hash, const char *pkt_key, uint8_t key_len) const
 {
    if (is_empty() || (pkt_hash != hash)) {
       return false;
@@ -88,7 +138,7 @@ bool Flow::belongs(uint64_t pkt_hash, char *pkt_key, uint8_t key_len) const
    }
 }
 
-void Flow::create(const Packet &pkt, uint64_t pkt_hash, char *pkt_key, uint8_t key_len)
+void Flow::create(const Packet &pkt, uint64_t pkt_hash, const char *pkt_key, uint8_t key_len)
 {
    flow_record.field_indicator    = FLW_FLOWFIELDINDICATOR;
    flow_record.pkt_total_cnt      = 1;
@@ -140,20 +190,45 @@ void Flow::create(const Packet &pkt, uint64_t pkt_hash, char *pkt_key, uint8_t k
    empty_flow = false;
 }
 
-void Flow::update(const Packet &pkt)
+/**
+ * \brief Check if packet was sent from destination of the flow to its source.
+ * \param [in] pkt Packet belonging to the flow.
+ * \return True if packet goes in reverse direction.
+ */
+bool Flow::is_reverse(const Packet &pkt) const
 {
-   flow_record.pkt_total_cnt += 1;
+   if (pkt.src_port != flow_record.src_port) {
+      return true;
+   }
+   if (flow_record.ip_version == 4) {
+      return pkt.src_ip.v4 != flow_record.src_ip.v4;
+   }
+   return memcmp(pkt.src_ip.v6, flow_record.src_ip.v6, sizeof(pkt.src_ip.v6)) != 0;
+}
+
+/**
+ * \brief Update flow counters with packet.
+ * \param [in] pkt Packet belonging to the flow.
+ * \param [in] reverse Packet goes from destination to source (biflow mode only).
+ */
+void Flow::update(const Packet &pkt, bool reverse)
+{
+   uint32_t &pkt_cnt = (reverse ? flow_record.dst_pkt_total_cnt : flow_record.pkt_total_cnt);
+   uint64_t &octets = (reverse ? flow_record.dst_octet_total_length : flow_record.octet_total_length);
+   uint8_t &tcp_flags = (reverse ? flow_record.dst_tcp_control_bits : flow_record.tcp_control_bits);
+
+   pkt_cnt += 1;
    if ((pkt.field_indicator & PCKT_PCAP_MASK) == PCKT_PCAP_MASK) {
       flow_record.end_timestamp = pkt.timestamp;
    }
    if ((pkt.field_indicator & PCKT_IPV4_MASK) == PCKT_IPV4_MASK) {
-      flow_record.octet_total_length += pkt.ip_length;
+      octets += pkt.ip_length;
    }
    if ((pkt.field_indicator & PCKT_IPV6_MASK) == PCKT_IPV6_MASK) {
-      flow_record.octet_total_length += pkt.ip_length;
+      octets += pkt.ip_length;
    }
    if ((pkt.field_indicator & PCKT_TCP_MASK) == PCKT_TCP_MASK) {
-      flow_record.tcp_control_bits |= pkt.tcp_control_bits;
+      tcp_flags |= pkt.tcp_control_bits;
    }
 }
 
@@ -165,11 +240,27 @@ void NHTFlowCache::init()
    parse_replacement_string();
    insertpos = rpl[0];
    rpl.assign(rpl.begin() + 1, rpl.end());
+
+   /* Select implementation specialized for current configuration. Default line size is specialized
+    * together with default replacement policy, other configurations use line_size and rpl. */
+   bool plugins = plugins_count() > 0;
+   if (line_size == (int) DEFAULT_FLOW_LINE_SIZE && policy == DEFAULT_REPLACEMENT_STRING) {
+      put_pkt_func = (plugins ? &NHTFlowCache::put_pkt_tmpl<DEFAULT_FLOW_LINE_SIZE, true> :
+         &NHTFlowCache::put_pkt_tmpl<DEFAULT_FLOW_LINE_SIZE, false>);
+      put_pkts_func = (plugins ? &NHTFlowCache::put_pkts_tmpl<DEFAULT_FLOW_LINE_SIZE, true> :
+         &NHTFlowCache::put_pkts_tmpl<DEFAULT_FLOW_LINE_SIZE, false>);
+   } else {
+      put_pkt_func = (plugins ? &NHTFlowCache::put_pkt_tmpl<0, true> : &NHTFlowCache::put_pkt_tmpl<0, false>);
+      put_pkts_func = (plugins ? &NHTFlowCache::put_pkts_tmpl<0, true> : &NHTFlowCache::put_pkts_tmpl<0, false>);
+   }
 }
 
 void NHTFlowCache::finish()
 {
    plugins_finish();
+   if (checkpoint_file != "") {
+      save(checkpoint_file, true); // keep active flows for the next run
+   }
    export_expired(true); // export whole cache
 
    if (print_stats) {
@@ -179,126 +270,238 @@ void NHTFlowCache::finish()
 
 int NHTFlowCache::put_pkt(Packet &pkt)
 {
-   int ret = plugins_pre_create(pkt);
+   uint32_t hashval = 0;
 
-   if (ret == EXPORT_PACKET) {
-      exporter->export_packet(pkt);
-      pkt.removeExtensions();
+   if (create_hash_key(pkt, key, key_len)) {
+      hashval = SuperFastHash(key, key_len); /* Calculates hash value from key created before. */
+   } else {
+      key_len = 0;
+   }
+   if (ring != NULL) {
+      ring->add(pkt, hashval);
+   }
 
-      return 0;
+   return (this->*put_pkt_func)(pkt, key, key_len, hashval);
+}
+
+int NHTFlowCache::put_pkts(Packet *pkts, int count)
+{
+   return (this->*put_pkts_func)(pkts, count);
+}
+
+/**
+ * \brief Put burst of packets into the cache, specialized for given configuration.
+ * Implementation is selected once in init(), so put_pkt_tmpl is called directly and can be inlined.
+ * \tparam LINE_SIZE Number of flows in a line known at compile time or 0 to use line_size attribute.
+ * \tparam PLUGINS Call plugin hooks.
+ * \param [in] pkts Array of parsed packets.
+ * \param [in] count Number of packets.
+ * \return 0 on success.
+ */
+template <int LINE_SIZE, bool PLUGINS>
+int NHTFlowCache::put_pkts_tmpl(Packet *pkts, int count)
+{
+   const int lsize = (LINE_SIZE != 0 ? LINE_SIZE : line_size);
+
+   for (int start = 0; start < count; start += PACKET_BURST_SIZE) {
+      int end = (count - start > (int) PACKET_BURST_SIZE ? start + PACKET_BURST_SIZE : count);
+
+      /* Compute keys and hashes of the whole burst first and prefetch lines they fall into,
+       * so that the lookups below do not stall on memory one after another. */
+      for (int i = start; i < end; i++) {
+         burst_t &b = burst[i - start];
+
+         if (create_hash_key(pkts[i], b.key, b.key_len)) {
+            b.hash = SuperFastHash(b.key, b.key_len);
+
+            int line_index = ((b.hash % size) / lsize) * lsize;
+            char *tags = (char *) &tag_array[line_index];
+            char *line = (char *) &flow_array[line_index];
+            for (unsigned int j = 0; j < lsize * sizeof(uint32_t); j += 64) {
+               __builtin_prefetch(tags + j);
+            }
+            for (unsigned int j = 0; j < lsize * sizeof(Flow *); j += 64) {
+               __builtin_prefetch(line + j);
+            }
+         } else {
+            b.key_len = 0;
+            b.hash = 0;
+         }
+         if (ring != NULL) {
+            ring->add(pkts[i], b.hash);
+         }
+      }
+
+      /* Tags of the lines should be loaded by now, prefetch flows which the packets probably belong to. */
+      for (int i = start; i < end; i++) {
+         burst_t &b = burst[i - start];
+
+         if (b.key_len != 0) {
+            int line_index = ((b.hash % size) / lsize) * lsize;
+            for (int j = line_index; j < line_index + lsize; j++) {
+               if (tag_array[j] == b.hash) {
+                  __builtin_prefetch(flow_array[j]);
+                  break;
+               }
+            }
+         }
+      }
+
+      for (int i = start; i < end; i++) {
+         burst_t &b = burst[i - start];
+         put_pkt_tmpl<LINE_SIZE, PLUGINS>(pkts[i], b.key, b.key_len, b.hash);
+      }
+   }
+
+   return 0;
+}
+
+/**
+ * \brief Put packet into the cache, specialized for given configuration.
+ * \tparam LINE_SIZE Default line size with default replacement policy or 0 to use line_size and rpl attributes.
+ * \tparam PLUGINS Call plugin hooks.
+ * \param [in] pkt Input parsed packet.
+ * \param [in] key Flow key of the packet.
+ * \param [in] key_len Length of the key, 0 when packet has no key.
+ * \param [in] hashval Hash of the key.
+ * \return 0 on success.
+ */
+template <int LINE_SIZE, bool PLUGINS>
+inline int NHTFlowCache::put_pkt_tmpl(Packet &pkt, const char *key, uint8_t key_len, uint32_t hashval)
+{
+   const int lsize = (LINE_SIZE != 0 ? LINE_SIZE : line_size);
+   int ret = 0;
+
+   if (PLUGINS) {
+      ret = plugins_pre_create(pkt);
+
+      if (ret == EXPORT_PACKET) {
+         exporter->export_packet(pkt);
+         pkt.removeExtensions();
+
+         return 0;
+      }
    }
 
-   if (!create_hash_key(pkt)) { // saves key value and key length into attributes NHTFlowCache::key and NHTFlowCache::key_len
+   if (key_len == 0) {
       return 0;
    }
 
-   uint32_t hashval = SuperFastHash(key, key_len); /* Calculates hash value from key created before. */
+   if (old_flow_array != NULL) {
+      rehash_lines(REHASH_LINES_PER_PKT);
+   }
 
-   int line_index = ((hashval % size) / line_size) * line_size; /* Find place for packet. */
-   int flow_index = 0, next_line = line_index + line_size;
+   int line_index = ((hashval % size) / lsize) * lsize; /* Find place for packet. */
+   int flow_index = 0, next_line = line_index + lsize;
 
    bool found = false;
 
    for (flow_index = line_index; flow_index < next_line; flow_index++) {
-      if (flow_array[flow_index]->belongs(hashval, key, key_len)) {
+      if (tag_array[flow_index] == hashval && flow_array[flow_index]->belongs(hashval, key, key_len)) {
          found = true;
          break;
       }
    }
 
+   if (!found && old_flow_array != NULL) {
+      /* Flow may still be stored in the table which is being drained, move it into the new one. */
+      int old_line_index = ((hashval % old_size) / lsize) * lsize;
+      int old_next_line = old_line_index + lsize;
+
+      for (int i = old_line_index; i < old_next_line; i++) {
+         if (old_flow_array[i]->belongs(hashval, key, key_len)) {
+            flow_index = make_room(line_index);
+
+            Flow *ptr_flow = flow_array[flow_index];
+            flow_array[flow_index] = old_flow_array[i];
+            tag_array[flow_index] = hashval;
+            old_flow_array[i] = ptr_flow;
+
+            found = true;
+            break;
+         }
+      }
+   }
+
    if (found) {
 #ifdef FLOW_CACHE_STATS
       lookups += (flow_index - line_index + 1);
       lookups2 += (flow_index - line_index + 1) * (flow_index - line_index + 1);
 #endif /* FLOW_CACHE_STATS */
       int relpos = flow_index - line_index;
-      int newrel = rpl[relpos];
+      int newrel = (LINE_SIZE != 0 ? 0 : rpl[relpos]); /* Default policy moves flow to the front of line. */
       int flow_index_start = line_index + newrel;
 
-      Flow *ptr_flow = flow_array[flow_index];
-      for (int j = flow_index; j > flow_index_start; j--) {
-         flow_array[j] = flow_array[j - 1];
-      }
-
-      flow_array[flow_index_start] = ptr_flow;
+      move_flow(flow_index, flow_index_start);
       flow_index = flow_index_start;
 #ifdef FLOW_CACHE_STATS
       hits++;
 #endif /* FLOW_CACHE_STATS */
    } else {
-      for (flow_index = line_index; flow_index < next_line; flow_index++) {
-         if (flow_array[flow_index]->is_empty()) {
-            found = true;
-            break;
-         }
-      }
-      if (!found) {
-         flow_index = next_line - 1;
-
-         // Export flow
-         plugins_pre_export(flow_array[flow_index]->flow_record);
-         exporter->export_flow(flow_array[flow_index]->flow_record);
+      flow_index = make_room(line_index);
+      inserts++;
+   }
 
+   current_ts = pkt.timestamp;
+   Flow *flow = flow_array[flow_index];
+   if (!flow->is_empty() && flow->is_tcp_restart(pkt)) {
+      /* New connection reuses 5-tuple of a terminated one, export the old flow. */
+      if (PLUGINS) {
+         plugins_pre_export(flow->flow_record);
+      }
+      exporter->export_flow(flow->flow_record);
 #ifdef FLOW_CACHE_STATS
-         expired++;
+      expired++;
 #endif /* FLOW_CACHE_STATS */
-         int flow_index_start = line_index + insertpos;
-         Flow *ptr_flow = flow_array[flow_index];
-         ptr_flow->erase();
-         for (int j = flow_index; j > flow_index_start; j--) {
-            flow_array[j] = flow_array[j - 1];
-         }
-         flow_index = flow_index_start;
-         flow_array[flow_index] = ptr_flow;
-#ifdef FLOW_CACHE_STATS
-         not_empty++;
-      } else {
-         empty++;
-#endif /* FLOW_CACHE_STATS */
-      }
+      flow->erase();
    }
 
-   current_ts = pkt.timestamp;
-   if (flow_array[flow_index]->is_empty()) {
-      flow_array[flow_index]->create(pkt, hashval, key, key_len);
-      ret = plugins_post_create(flow_array[flow_index]->flow_record, pkt);
+   if (flow->is_empty()) {
+      flow->create(pkt, hashval, key, key_len);
+      tag_array[flow_index] = hashval;
+      if (PLUGINS) {
+         ret = plugins_post_create(flow->flow_record, pkt);
 
-      if (ret & FLOW_FLUSH) {
-         exporter->export_flow(flow_array[flow_index]->flow_record);
+         if (ret & FLOW_FLUSH) {
+            exporter->export_flow(flow->flow_record);
 #ifdef FLOW_CACHE_STATS
-         flushed++;
+            flushed++;
 #endif /* FLOW_CACHE_STATS */
-         flow_array[flow_index]->erase();
+            flow->erase();
+         }
       }
+   } else if (!PLUGINS) {
+      flow->update(pkt, biflow && flow->is_reverse(pkt));
    } else {
-      ret = plugins_pre_update(flow_array[flow_index]->flow_record, pkt);
+      ret = plugins_pre_update(flow->flow_record, pkt);
 
       if (ret & FLOW_FLUSH) {
-         exporter->export_flow(flow_array[flow_index]->flow_record);
+         exporter->export_flow(flow->flow_record);
 #ifdef FLOW_CACHE_STATS
          flushed++;
 #endif /* FLOW_CACHE_STATS */
-         flow_array[flow_index]->erase();
+         flow->erase();
 
-         return put_pkt(pkt);
+         return put_pkt_tmpl<LINE_SIZE, PLUGINS>(pkt, key, key_len, hashval);
       } else {
-         flow_array[flow_index]->update(pkt);
-         ret = plugins_post_update(flow_array[flow_index]->flow_record, pkt);
+         flow->update(pkt, biflow && flow->is_reverse(pkt));
+         ret = plugins_post_update(flow->flow_record, pkt);
 
          if (ret & FLOW_FLUSH) {
-            exporter->export_flow(flow_array[flow_index]->flow_record);
+            exporter->export_flow(flow->flow_record);
 #ifdef FLOW_CACHE_STATS
             flushed++;
 #endif /* FLOW_CACHE_STATS */
-            flow_array[flow_index]->erase();
+            flow->erase();
 
-            return put_pkt(pkt);
+            return put_pkt_tmpl<LINE_SIZE, PLUGINS>(pkt, key, key_len, hashval);
          }
       }
    }
 
-   if (current_ts.tv_sec - last_ts.tv_sec > 5) {
+   if ((int64_t) (current_ts - last_ts) > (int64_t) (5 * NSEC_PER_SEC)) {
       export_expired(false); // false -- export only expired flows
+      exporter->flush();
       last_ts = current_ts;
    }
 
@@ -321,9 +524,291 @@ int NHTFlowCache::export_expired(bool export_all)
          exported++;
       }
    }
+
+   for (int i = 0; i < old_size; i++) {
+      if (is_expired(old_flow_array[i], current_ts, active, inactive) ||
+         (export_all && !old_flow_array[i]->is_empty())) {
+         plugins_pre_export(old_flow_array[i]->flow_record);
+         exporter->export_flow(old_flow_array[i]->flow_record);
+
+         old_flow_array[i]->erase();
+#ifdef FLOW_CACHE_STATS
+         expired++;
+#endif /* FLOW_CACHE_STATS */
+         exported++;
+      }
+   }
+
+   if (export_all || old_flow_array != NULL) {
+      return exported;
+   }
+
+   /* Sample occupancy of lines which survived the expiration. */
+   for (int line_index = 0; line_index < size; line_index += line_size) {
+      int cnt = 0;
+      for (int i = line_index; i < line_index + line_size; i++) {
+         cnt += !flow_array[i]->is_empty();
+      }
+      occupancy[cnt]++;
+   }
+
+   if (size < max_size && evictions > inserts * GROW_EVICTION_RATIO) {
+      grow();
+   }
+   evictions = 0;
+   inserts = 0;
+
    return exported;
 }
 
+/**
+ * \brief Fixed part of a flow stored in checkpoint file.
+ */
+struct flow_checkpoint_t {
+   uint64_t hash;
+   uint64_t field_indicator;
+   uint64_t start_timestamp;
+   uint64_t end_timestamp;
+   uint64_t octet_total_length;
+   uint32_t pkt_total_cnt;
+   uint16_t src_port;
+   uint16_t dst_port;
+   uint8_t src_ip[16];
+   uint8_t dst_ip[16];
+   uint8_t ip_version;
+   uint8_t ip_proto;
+   uint8_t ip_tos;
+   uint8_t ip_ttl;
+   uint8_t tcp_control_bits;
+   uint8_t ext_cnt;
+   uint64_t dst_octet_total_length;
+   uint32_t dst_pkt_total_cnt;
+   uint8_t dst_tcp_control_bits;
+   char key[MAX_KEY_LENGTH];
+};
+
+/**
+ * \brief Header of checkpoint file.
+ */
+struct checkpoint_hdr_t {
+   char magic[4];
+   uint32_t version;
+   uint32_t record_size; /**< sizeof(flow_checkpoint_t), guards against layout changes. */
+   uint32_t flows;
+   uint32_t flags;       /**< CHECKPOINT_BIFLOW if keys were created in biflow mode. */
+};
+
+/**
+ * \brief Save active flows into checkpoint file.
+ * Flows with an extension which cannot be serialized are not saved.
+ * File is written under temporary name and renamed when complete.
+ * \param [in] file Checkpoint file name.
+ * \param [in] remove_saved Remove saved flows from the cache without export, only when the file is
+ * written successfully, otherwise they stay in the cache and are exported as usual.
+ * \return Number of saved flows or -1 on error.
+ */
+int NHTFlowCache::save(const string &file, bool remove_saved)
+{
+   string tmp_file = file + ".tmp";
+   FILE *f = fopen(tmp_file.c_str(), "wb");
+   if (f == NULL) {
+      cerr << "NHTFlowCache: unable to create checkpoint " << tmp_file << endl;
+      return -1;
+   }
+   setvbuf(f, NULL, _IOFBF, 1 << 20);
+
+   checkpoint_hdr_t hdr;
+   memset(&hdr, 0, sizeof(hdr));
+   memcpy(hdr.magic, CHECKPOINT_MAGIC, sizeof(hdr.magic));
+   hdr.version = CHECKPOINT_VERSION;
+   hdr.record_size = sizeof(flow_checkpoint_t);
+   hdr.flags = (biflow ? CHECKPOINT_BIFLOW : 0);
+   fwrite(&hdr, sizeof(hdr), 1, f);
+
+   vector<Flow *> saved;
+   Flow **tables[] = {flow_array, old_flow_array};
+   int sizes[] = {size, old_size};
+   for (int t = 0; t < 2; t++) {
+      for (int i = 0; i < sizes[t]; i++) {
+         Flow *flow = tables[t][i];
+         if (flow->is_empty() || !save_flow(f, flow)) {
+            continue;
+         }
+
+         hdr.flows++;
+         if (remove_saved) {
+            saved.push_back(flow);
+         }
+      }
+   }
+
+   /* Write number of flows into header. */
+   fseek(f, 0, SEEK_SET);
+   fwrite(&hdr, sizeof(hdr), 1, f);
+
+   if (ferror(f) || fclose(f) != 0 || rename(tmp_file.c_str(), file.c_str()) != 0) {
+      cerr << "NHTFlowCache: unable to write checkpoint " << file << endl;
+      remove(tmp_file.c_str());
+      return -1;
+   }
+
+   for (size_t i = 0; i < saved.size(); i++) {
+      saved[i]->erase();
+   }
+   return hdr.flows;
+}
+
+/**
+ * \brief Write one flow into checkpoint file.
+ * \param [in] f Opened checkpoint file.
+ * \param [in] flow Flow to save.
+ * \return False if flow has an extension which cannot be serialized, nothing is written in that case.
+ */
+bool NHTFlowCache::save_flow(FILE *f, Flow *flow)
+{
+   static uint8_t ext_buffer[CHECKPOINT_FLOW_EXT_BUFFER];
+   const FlowRecord &rec = flow->flow_record;
+   flow_checkpoint_t cp;
+   size_t ext_len = 0;
+
+   /* Serialize extensions first, each one is preceded by its type and length. */
+   memset(&cp, 0, sizeof(cp));
+   for (RecordExt *ext = rec.exts; ext != NULL; ext = ext->next) {
+      uint16_t ext_hdr[2];
+      int space = sizeof(ext_buffer) - ext_len - sizeof(ext_hdr);
+      if (space > CHECKPOINT_EXT_BUFFER) {
+         space = CHECKPOINT_EXT_BUFFER;
+      }
+
+      int len = (space > 0 ? ext->serialize(ext_buffer + ext_len + sizeof(ext_hdr), space) : -1);
+      if (len < 0 || cp.ext_cnt == 0xff) {
+         return false;
+      }
+      ext_hdr[0] = ext->extType;
+      ext_hdr[1] = len;
+      memcpy(ext_buffer + ext_len, ext_hdr, sizeof(ext_hdr));
+      ext_len += sizeof(ext_hdr) + len;
+      cp.ext_cnt++;
+   }
+
+   cp.hash = flow->get_hash();
+   memcpy(cp.key, flow->get_key(), MAX_KEY_LENGTH);
+   cp.field_indicator = rec.field_indicator;
+   cp.start_timestamp = rec.start_timestamp;
+   cp.end_timestamp = rec.end_timestamp;
+   cp.octet_total_length = rec.octet_total_length;
+   cp.pkt_total_cnt = rec.pkt_total_cnt;
+   cp.src_port = rec.src_port;
+   cp.dst_port = rec.dst_port;
+   memcpy(cp.src_ip, &rec.src_ip, sizeof(rec.src_ip));
+   memcpy(cp.dst_ip, &rec.dst_ip, sizeof(rec.dst_ip));
+   cp.ip_version = rec.ip_version;
+   cp.ip_proto = rec.ip_proto;
+   cp.ip_tos = rec.ip_tos;
+   cp.ip_ttl = rec.ip_ttl;
+   cp.tcp_control_bits = rec.tcp_control_bits;
+   cp.dst_octet_total_length = rec.dst_octet_total_length;
+   cp.dst_pkt_total_cnt = rec.dst_pkt_total_cnt;
+   cp.dst_tcp_control_bits = rec.dst_tcp_control_bits;
+   fwrite(&cp, sizeof(cp), 1, f);
+   fwrite(ext_buffer, ext_len, 1, f);
+
+   return true;
+}
+
+/**
+ * \brief Load flows from checkpoint file into the cache.
+ * File is removed after it is loaded, so the same flows cannot be loaded (and exported) twice.
+ * Loading stops at the first damaged flow, flows read before it are kept.
+ * \param [in] file Checkpoint file name.
+ * \return Number of loaded flows or -1 on error.
+ */
+int NHTFlowCache::load(const string &file)
+{
+   static uint8_t ext_buffer[CHECKPOINT_EXT_BUFFER];
+   FILE *f = fopen(file.c_str(), "rb");
+   if (f == NULL) {
+      return 0;
+   }
+   setvbuf(f, NULL, _IOFBF, 1 << 20);
+
+   checkpoint_hdr_t hdr;
+   if (fread(&hdr, sizeof(hdr), 1, f) != 1 || memcmp(hdr.magic, CHECKPOINT_MAGIC, sizeof(hdr.magic)) ||
+      hdr.version != CHECKPOINT_VERSION || hdr.record_size != sizeof(flow_checkpoint_t)) {
+      cerr << "NHTFlowCache: incompatible checkpoint " << file << endl;
+      fclose(f);
+      return -1;
+   }
+   if (((hdr.flags & CHECKPOINT_BIFLOW) != 0) != biflow) {
+      /* Keys of flows would never match keys of packets. */
+      cerr << "NHTFlowCache: checkpoint " << file << " was saved in " << (biflow ? "uniflow" : "biflow") <<
+         " mode, it is not loaded" << endl;
+      fclose(f);
+      return -1;
+   }
+
+   uint32_t loaded;
+   bool damaged = false;
+   for (loaded = 0; loaded < hdr.flows; loaded++) {
+      flow_checkpoint_t cp;
+      if (fread(&cp, sizeof(cp), 1, f) != 1) {
+         break;
+      }
+
+      int flow_index = make_room(((cp.hash % size) / line_size) * line_size);
+      Flow *flow = flow_array[flow_index];
+      FlowRecord &rec = flow->flow_record;
+
+      flow->restore(cp.hash, cp.key);
+      tag_array[flow_index] = cp.hash;
+      rec.field_indicator = cp.field_indicator;
+      rec.start_timestamp = cp.start_timestamp;
+      rec.end_timestamp = cp.end_timestamp;
+      rec.octet_total_length = cp.octet_total_length;
+      rec.pkt_total_cnt = cp.pkt_total_cnt;
+      rec.src_port = cp.src_port;
+      rec.dst_port = cp.dst_port;
+      memcpy(&rec.src_ip, cp.src_ip, sizeof(rec.src_ip));
+      memcpy(&rec.dst_ip, cp.dst_ip, sizeof(rec.dst_ip));
+      rec.ip_version = cp.ip_version;
+      rec.ip_proto = cp.ip_proto;
+      rec.ip_tos = cp.ip_tos;
+      rec.ip_ttl = cp.ip_ttl;
+      rec.tcp_control_bits = cp.tcp_control_bits;
+      rec.dst_octet_total_length = cp.dst_octet_total_length;
+      rec.dst_pkt_total_cnt = cp.dst_pkt_total_cnt;
+      rec.dst_tcp_control_bits = cp.dst_tcp_control_bits;
+
+      for (int i = 0; i < cp.ext_cnt; i++) {
+         uint16_t ext_hdr[2];
+         if (fread(ext_hdr, sizeof(ext_hdr), 1, f) != 1 || ext_hdr[1] > sizeof(ext_buffer) ||
+            (ext_hdr[1] > 0 && fread(ext_buffer, ext_hdr[1], 1, f) != 1)) {
+            /* Position in file is lost, drop partially restored flow and the rest of the file. */
+            flow->erase();
+            damaged = true;
+            break;
+         }
+
+         RecordExt *ext = plugins_deserialize_ext(ext_hdr[0], ext_buffer, ext_hdr[1]);
+         if (ext != NULL) {
+            rec.addExtension(ext);
+         }
+      }
+      if (damaged) {
+         break;
+      }
+   }
+
+   if (loaded != hdr.flows) {
+      cerr << "NHTFlowCache: checkpoint " << file << " is truncated or damaged, " << loaded << " of " <<
+         hdr.flows << " flows loaded" << endl;
+   }
+   fclose(f);
+   remove(file.c_str());
+
+   return loaded;
+}
+
 // NHTFlowCache -- PROTECTED **************************************************
 
 void NHTFlowCache::parse_replacement_string()
@@ -339,33 +824,49 @@ void NHTFlowCache::parse_replacement_string()
    rpl.push_back(atoi((char *) policy.substr(search_pos_old).c_str()));
 }
 
-bool NHTFlowCache::create_hash_key(Packet &pkt)
+/**
+ * \brief Create flow key of the packet.
+ * In biflow mode endpoints are ordered so both directions of a connection have the same key.
+ * \param [in] pkt Input parsed packet.
+ * \param [out] key Buffer for the key (MAX_KEY_LENGTH bytes).
+ * \param [out] key_len Length of the key.
+ * \return False if packet is not IPv4 or IPv6 packet.
+ */
+bool NHTFlowCache::create_hash_key(const Packet &pkt, char *key, uint8_t &key_len)
 {
    char *k = key;
+   bool swap = false;
 
    if ((pkt.field_indicator & PCKT_IPV4_MASK) == PCKT_IPV4_MASK) {
+      if (biflow) {
+         swap = pkt.src_ip.v4 > pkt.dst_ip.v4 || (pkt.src_ip.v4 == pkt.dst_ip.v4 && pkt.src_port > pkt.dst_port);
+      }
       *(uint8_t *) k = pkt.ip_proto;
       k += sizeof(pkt.ip_proto);
-      *(uint32_t *) k = pkt.src_ip.v4;
+      *(uint32_t *) k = (swap ? pkt.dst_ip.v4 : pkt.src_ip.v4);
       k += sizeof(pkt.src_ip.v4);
-      *(uint32_t *) k = pkt.dst_ip.v4;
+      *(uint32_t *) k = (swap ? pkt.src_ip.v4 : pkt.dst_ip.v4);
       k += sizeof(pkt.dst_ip.v4);
-      *(uint16_t *) k = pkt.src_port;
+      *(uint16_t *) k = (swap ? pkt.dst_port : pkt.src_port);
       k += sizeof(pkt.src_port);
-      *(uint16_t *) k = pkt.dst_port;
+      *(uint16_t *) k = (swap ? pkt.src_port : pkt.dst_port);
       k += sizeof(pkt.dst_port);
       *k = '\0';
       key_len = 13;
    } else if ((pkt.field_indicator & PCKT_IPV6_MASK) == PCKT_IPV6_MASK) {
+      if (biflow) {
+         int cmp = memcmp(pkt.src_ip.v6, pkt.dst_ip.v6, sizeof(pkt.src_ip.v6));
+         swap = cmp > 0 || (cmp == 0 && pkt.src_port > pkt.dst_port);
+      }
       *(uint8_t *) k = pkt.ip_proto;
       k += sizeof(pkt.ip_proto);
-      memcpy(k, pkt.src_ip.v6, sizeof(pkt.src_ip.v6));
+      memcpy(k, (swap ? pkt.dst_ip.v6 : pkt.src_ip.v6), sizeof(pkt.src_ip.v6));
       k += sizeof(pkt.src_ip.v6);
-      memcpy(k, pkt.dst_ip.v6, sizeof(pkt.src_ip.v6));
+      memcpy(k, (swap ? pkt.src_ip.v6 : pkt.dst_ip.v6), sizeof(pkt.src_ip.v6));
       k += sizeof(pkt.dst_ip.v6);
-      *(uint16_t *) k = pkt.src_port;
+      *(uint16_t *) k = (swap ? pkt.dst_port : pkt.src_port);
       k += sizeof(pkt.src_port);
-      *(uint16_t *) k = pkt.dst_port;
+      *(uint16_t *) k = (swap ? pkt.src_port : pkt.dst_port);
       k += sizeof(pkt.dst_port);
       *k = '\0';
       key_len = 37;
@@ -376,6 +877,163 @@ bool NHTFlowCache::create_hash_key(Packet &pkt)
    return true;
 }
 
+/**
+ * \brief Compute hash of flow key of the packet, i.e. the id under which its flow is stored in the cache.
+ * \param [in] pkt Packet with filled header fields.
+ * \param [out] hash Hash of the flow key.
+ * \return False if no key can be created for the packet.
+ */
+bool NHTFlowCache::flow_hash(const Packet &pkt, uint32_t &hash)
+{
+   char k[MAX_KEY_LENGTH];
+   uint8_t k_len;
+
+   if (!create_hash_key(pkt, k, k_len)) {
+      return false;
+   }
+   hash = SuperFastHash(k, k_len);
+   return true;
+}
+
+/**
+ * \brief Find empty place for a new flow in given line.
+ * Last flow of the line is exported and its place is reused when the line is full.
+ * \param [in] line_index Index of the first flow in the line.
+ * \return Index of an empty flow.
+ */
+int NHTFlowCache::make_room(int line_index)
+{
+   int flow_index, next_line = line_index + line_size;
+
+   for (flow_index = line_index; flow_index < next_line; flow_index++) {
+      if (flow_array[flow_index]->is_empty()) {
+#ifdef FLOW_CACHE_STATS
+         empty++;
+#endif /* FLOW_CACHE_STATS */
+         return flow_index;
+      }
+   }
+
+   /* Prefer terminated TCP connection over the least recently used flow. */
+   for (flow_index = next_line - 1; flow_index >= line_index; flow_index--) {
+      if (flow_array[flow_index]->is_tcp_closed()) {
+         break;
+      }
+   }
+   if (flow_index < line_index) {
+      flow_index = next_line - 1;
+      evictions++;
+   }
+
+   // Export flow
+   plugins_pre_export(flow_array[flow_index]->flow_record);
+   exporter->export_flow(flow_array[flow_index]->flow_record);
+
+#ifdef FLOW_CACHE_STATS
+   expired++;
+   not_empty++;
+#endif /* FLOW_CACHE_STATS */
+
+   int flow_index_start = line_index + insertpos;
+   flow_array[flow_index]->erase();
+   move_flow(flow_index, flow_index_start);
+
+   return flow_index_start;
+}
+
+/**
+ * \brief Move flow to another position in its line, flows in between are shifted by one.
+ * \param [in] from Current index of the flow.
+ * \param [in] to New index of the flow.
+ */
+void NHTFlowCache::move_flow(int from, int to)
+{
+   Flow *ptr_flow = flow_array[from];
+   uint32_t tag = tag_array[from];
+
+   for (int j = from; j > to; j--) {
+      flow_array[j] = flow_array[j - 1];
+      tag_array[j] = tag_array[j - 1];
+   }
+   for (int j = from; j < to; j++) {
+      flow_array[j] = flow_array[j + 1];
+      tag_array[j] = tag_array[j + 1];
+   }
+   flow_array[to] = ptr_flow;
+   tag_array[to] = tag;
+}
+
+/**
+ * \brief Allocate larger table, flows from the current one are moved incrementally by rehash_lines.
+ */
+void NHTFlowCache::grow()
+{
+   int new_size = size * 2;
+   if (new_size > max_size) {
+      new_size = max_size;
+   }
+
+   old_flow_array = flow_array;
+   old_size = size;
+   rehash_line = 0;
+
+   flow_array = new Flow*[new_size];
+   for (int i = 0; i < new_size; i++) {
+      flow_array[i] = new Flow();
+   }
+   delete [] tag_array;
+   tag_array = new uint32_t[new_size]();
+   size = new_size;
+   resizes++;
+}
+
+/**
+ * \brief Move flows from given number of lines of the old table into the new one.
+ * Old table is freed when it is fully drained.
+ * \param [in] count Number of lines to move.
+ */
+void NHTFlowCache::rehash_lines(int count)
+{
+   for (; count > 0 && rehash_line < old_size; count--, rehash_line += line_size) {
+      for (int i = rehash_line; i < rehash_line + line_size; i++) {
+         if (old_flow_array[i]->is_empty()) {
+            continue;
+         }
+
+         uint64_t hashval = old_flow_array[i]->get_hash();
+         int flow_index = make_room(((hashval % size) / line_size) * line_size);
+
+         Flow *ptr_flow = flow_array[flow_index];
+         flow_array[flow_index] = old_flow_array[i];
+         tag_array[flow_index] = hashval;
+         old_flow_array[i] = ptr_flow;
+      }
+   }
+
+   if (rehash_line >= old_size) {
+      free_old_table();
+   }
+}
+
+/**
+ * \brief Free drained table.
+ */
+void NHTFlowCache::free_old_table()
+{
+   if (old_flow_array == NULL) {
+      return;
+   }
+
+   for (int i = 0; i < old_size; i++) {
+      delete old_flow_array[i];
+   }
+   delete [] old_flow_array;
+
+   old_flow_array = NULL;
+   old_size = 0;
+   rehash_line = 0;
+}
+
 void NHTFlowCache::print_report()
 {
 #ifdef FLOW_CACHE_STATS
@@ -389,4 +1047,23 @@ void NHTFlowCache::print_report()
    cout << "Average Lookup:  " << tmp << endl;
    cout << "Variance Lookup: " << float(lookups2) / hits - tmp * tmp << endl;
 #endif /* FLOW_CACHE_STATS */
+
+   if (resizes > 0) {
+      cout << "Cache size: " << size << " (grown " << resizes << " times)" << endl;
+   }
+
+   unsigned long samples = 0;
+   for (int i = 0; i <= line_size; i++) {
+      samples += occupancy[i];
+   }
+   if (samples == 0) {
+      return;
+   }
+
+   cout << "Line occupancy (flows in line: share of samples):" << endl;
+   for (int i = 0; i <= line_size; i++) {
+      if (occupancy[i] != 0) {
+         cout << "   " << i << ": " << float(occupancy[i]) / samples << endl;
+      }
+   }
 }
@@ -48,16 +48,33 @@
 #define NHTFLOWCACHE_H
 
 #include <string>
+#include <cstdio>
 
 #include "flow_meter.h"
 #include "flowcache.h"
 #include "flowifc.h"
 #include "flowexporter.h"
+#include "packetring.h"
 
 using namespace std;
 
 #define MAX_KEY_LENGTH 40
 
+/* Number of lines of the old table moved into the new one per processed packet while the cache grows. */
+#define REHASH_LINES_PER_PKT 2
+
+/* Cache grows when premature exports (full line) exceed this fraction of newly created flows between two checks. */
+#define GROW_EVICTION_RATIO 0.01
+
+/* Inactive timeout in seconds of TCP flows which have seen FIN or RST. */
+#define TCP_CLOSED_TIMEOUT 2
+
+#define CHECKPOINT_MAGIC "FMCP"
+#define CHECKPOINT_VERSION 4
+#define CHECKPOINT_EXT_BUFFER 4096 /* Maximal size of serialized extension. */
+#define CHECKPOINT_FLOW_EXT_BUFFER (4 * CHECKPOINT_EXT_BUFFER) /* Maximal size of all serialized extensions of a flow. */
+#define CHECKPOINT_BIFLOW 0x1 /* Flag of checkpoint header, flow keys were created in biflow mode. */
+
 class Flow
 {
    uint64_t hash;
@@ -83,21 +100,53 @@ public:
    };
 
    inline bool is_empty() const;
-   bool belongs(uint64_t pkt_hash, char *pkt_key, uint8_t key_len) const;
-   void create(const Packet &pkt, uint64_t pkt_hash, char *pkt_key, uint8_t key_len);
-   void update(const Packet &pkt);
+   inline uint64_t get_hash() const;
+   inline bool is_tcp_closed() const;
+   bool is_tcp_restart(const Packet &pkt) const;
+   const char *get_key() const;
+   void restore(uint64_t flow_hash, const char *flow_key);
+   bool belongs(uint64_t pkt_hash, const char *pkt_key, uint8_t key_len) const;
+   bool is_reverse(const Packet &pkt) const;
+   void create(const Packet &pkt, uint64_t pkt_hash, const char *pkt_key, uint8_t key_len);
+   void update(const Packet &pkt, bool reverse);
 };
 
 typedef vector<int> replacementvector_t;
 typedef replacementvector_t::iterator replacementvectoriter_t;
 
+class NHTFlowCache;
+
+/**
+ * \brief Key and hash of a packet from currently processed burst.
+ */
+struct burst_t {
+   uint32_t hash;
+   uint8_t key_len;
+   char key[MAX_KEY_LENGTH];
+};
+
+/**
+ * \brief Pointer to put_pkt implementation specialized for cache configuration.
+ */
+typedef int (NHTFlowCache::*put_pkt_func_t)(Packet &pkt, const char *key, uint8_t key_len, uint32_t hashval);
+
+/**
+ * \brief Pointer to put_pkts implementation specialized for cache configuration.
+ */
+typedef int (NHTFlowCache::*put_pkts_func_t)(Packet *pkts, int count);
+
 class NHTFlowCache : public FlowCache
 {
    bool print_stats;
    uint8_t key_len;
    int line_size;
    int size;
+   int max_size;
    int insertpos;
+   long evictions;      /**< Flows exported prematurely because their line was full (since last check). */
+   long inserts;        /**< Newly created flows (since last check). */
+   long resizes;        /**< Number of times the cache has grown. */
+   unsigned long *occupancy; /**< Histogram of line occupancy (index = number of flows in line). */
 #ifdef FLOW_CACHE_STATS
    long empty;
    long not_empty;
@@ -107,20 +156,38 @@ class NHTFlowCache : public FlowCache
    long lookups;
    long lookups2;
 #endif /* FLOW_CACHE_STATS */
-   struct timeval current_ts;
-   struct timeval last_ts;
-   struct timeval active;
-   struct timeval inactive;
+   timestamp_t current_ts;
+   timestamp_t last_ts;
+   timestamp_t active;
+   timestamp_t inactive;
    char key[MAX_KEY_LENGTH];
+   burst_t burst[PACKET_BURST_SIZE];
    string policy;
+   string checkpoint_file;
+   bool biflow;
    replacementvector_t rpl;
    Flow **flow_array;
+   uint32_t *tag_array;    /**< Hashes of flows in flow_array (valid for non-empty flows), compared before flows are accessed. */
+   put_pkt_func_t put_pkt_func;
+   put_pkts_func_t put_pkts_func;
+   Flow **old_flow_array;  /**< Table being drained into flow_array while the cache grows. */
+   int old_size;
+   int rehash_line;        /**< Index of next line of old_flow_array to move. */
+   PacketRing *ring;       /**< Ring storing every packet put into the cache, or NULL. */
 
 public:
    NHTFlowCache(const options_t &options)
    {
       line_size = options.flow_line_size;
       size = options.flow_cache_size;
+      max_size = options.flow_cache_max_size;
+      evictions = 0;
+      inserts = 0;
+      resizes = 0;
+      old_flow_array = NULL;
+      old_size = 0;
+      rehash_line = 0;
+      ring = NULL;
 #ifdef FLOW_CACHE_STATS
       empty = 0;
       not_empty = 0;
@@ -131,14 +198,26 @@ public:
       lookups2 = 0;
 #endif /* FLOW_CACHE_STATS */
       policy = options.replacement_string;
+      checkpoint_file = options.checkpoint_file;
+      biflow = options.biflow;
       print_stats = options.print_stats;
+      put_pkt_func = NULL; /* Selected in init(). */
+      put_pkts_func = NULL;
       active = options.active_timeout;
       inactive = options.inactive_timeout;
+      current_ts = 0;
+      last_ts = 0;
 
       flow_array = new Flow*[size];
       for (int i = 0; i < size; i++) {
          flow_array[i] = new Flow();
       }
+      tag_array = new uint32_t[size]();
+
+      occupancy = new unsigned long[line_size + 1];
+      for (int i = 0; i <= line_size; i++) {
+         occupancy[i] = 0;
+      }
    };
    ~NHTFlowCache()
    {
@@ -146,18 +225,43 @@ public:
          delete flow_array[i];
       }
       delete [] flow_array;
+      delete [] tag_array;
+      free_old_table();
+      delete [] occupancy;
    };
 
 // Put packet into the cache (i.e. update corresponding flow record or create a new one)
    virtual int put_pkt(Packet &pkt);
+   virtual int put_pkts(Packet *pkts, int count);
    virtual void init();
    virtual void finish();
 
    int export_expired(bool export_all);
+   int save(const string &file, bool remove_saved);
+   int load(const string &file);
+   bool flow_hash(const Packet &pkt, uint32_t &hash);
+
+   /**
+    * \brief Store every packet put into the cache into given ring, tagged by hash of its flow key.
+    */
+   void set_packet_ring(PacketRing *packet_ring)
+   {
+      ring = packet_ring;
+   }
 
 protected:
+   template <int LINE_SIZE, bool PLUGINS>
+   int put_pkt_tmpl(Packet &pkt, const char *key, uint8_t key_len, uint32_t hashval);
+   template <int LINE_SIZE, bool PLUGINS>
+   int put_pkts_tmpl(Packet *pkts, int count);
    void parse_replacement_string();
-   bool create_hash_key(Packet &pkt);
+   bool create_hash_key(const Packet &pkt, char *key, uint8_t &key_len);
+   int make_room(int line_index);
+   void move_flow(int from, int to);
+   void grow();
+   void rehash_lines(int count);
+   void free_old_table();
+   bool save_flow(FILE *f, Flow *flow);
    void print_report();
 };
 
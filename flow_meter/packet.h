@@ -131,7 +131,7 @@
  */
 struct Packet : public Record {
    uint64_t    field_indicator;
-   struct timeval timestamp;
+   timestamp_t timestamp;
 
    uint16_t    ethertype;
 
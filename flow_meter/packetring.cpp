@@ -0,0 +1,423 @@
+/**
+ * \file packetring.cpp
+ * \brief Ring of recently captured packets which can be dumped to pcap file on request.
+ * \date 2016
+ */
+/*
+ * Copyright (C) 2016 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <string>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pcap/pcap.h>
+
+#include "packetring.h"
+
+using namespace std;
+
+PacketRing::PacketRing() : buffer(NULL), capacity(0), head(0), tail(0), sock(-1), client(-1), client_since(0)
+{
+}
+
+PacketRing::~PacketRing()
+{
+   if (client != -1) {
+      close(client);
+   }
+   if (sock != -1) {
+      close(sock);
+      unlink(sock_path.c_str());
+   }
+   delete [] buffer;
+}
+
+/**
+ * \brief Allocate the ring and open control socket.
+ * \param [in] size Size of the ring in bytes.
+ * \param [in] socket_path Path of UNIX socket accepting dump commands.
+ * \param [in] dump_dir Directory where dumped files are created.
+ * \return 0 on success, -1 on error.
+ */
+int PacketRing::init(uint64_t size, const string &socket_path, const string &dump_dir)
+{
+   struct sockaddr_un addr;
+
+   capacity = size & ~7ULL;
+   if (capacity < RING_ALIGN(sizeof(ring_record_t) + MAXPCKTSIZE)) {
+      error_msg = "packet ring is too small";
+      return -1;
+   }
+   if (socket_path.length() >= sizeof(addr.sun_path)) {
+      error_msg = "socket path is too long";
+      return -1;
+   }
+   struct stat st;
+   if (stat(dump_dir.c_str(), &st) == -1 || !S_ISDIR(st.st_mode)) {
+      error_msg = dump_dir + ": not a directory";
+      return -1;
+   }
+
+   buffer = new uint8_t[capacity];
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, socket_path.c_str());
+   unlink(socket_path.c_str());
+
+   sock = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (sock == -1) {
+      error_msg = string("socket: ") + strerror(errno);
+      return -1;
+   }
+   /* Anybody able to connect can write files, so the socket is created with mode 0600. */
+   mode_t old_mask = umask(0177);
+   int ret = bind(sock, (struct sockaddr *) &addr, sizeof(addr));
+   umask(old_mask);
+   if (ret == -1 || listen(sock, 4) == -1 || fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK) == -1) {
+      error_msg = socket_path + ": " + strerror(errno);
+      close(sock);
+      sock = -1;
+      return -1;
+   }
+   sock_path = socket_path;
+   dir = dump_dir;
+
+   return 0;
+}
+
+/**
+ * \brief Get offset of record following the one at given offset.
+ * \param [in] offset Logical offset of a record.
+ * \return Logical offset of the next record.
+ */
+uint64_t PacketRing::next_record(uint64_t offset) const
+{
+   uint64_t pos = offset % capacity;
+
+   if (capacity - pos < sizeof(ring_record_t)) {
+      return offset + (capacity - pos); // Too small space at the end of buffer is skipped without padding record.
+   }
+   return offset + ((const ring_record_t *) (buffer + pos))->size;
+}
+
+/**
+ * \brief Store packet into the ring, the oldest packets are dropped to make space for it.
+ * \param [in] pkt Parsed packet.
+ * \param [in] hash Hash of flow key of the packet, 0 if packet has no key.
+ */
+void PacketRing::add(const Packet &pkt, uint32_t hash)
+{
+   uint32_t size = RING_ALIGN(sizeof(ring_record_t) + pkt.total_length);
+   uint64_t pos = head % capacity;
+   uint64_t skip = (capacity - pos < size ? capacity - pos : 0);
+
+   while (head + skip + size - tail > capacity) {
+      tail = next_record(tail);
+   }
+
+   if (skip != 0) {
+      if (skip >= sizeof(ring_record_t)) {
+         ring_record_t *pad = (ring_record_t *) (buffer + pos);
+         memset(pad, 0, sizeof(ring_record_t));
+         pad->size = skip;
+      }
+      head += skip;
+      pos = 0;
+   }
+
+   ring_record_t *rec = (ring_record_t *) (buffer + pos);
+   rec->size = size;
+   rec->hash = hash;
+   rec->timestamp = pkt.timestamp;
+   rec->caplen = pkt.total_length;
+   rec->ip_version = 0;
+   rec->ip_proto = pkt.ip_proto;
+   rec->src_port = pkt.src_port;
+   rec->dst_port = pkt.dst_port;
+   memset(&rec->src_ip, 0, sizeof(rec->src_ip));
+   memset(&rec->dst_ip, 0, sizeof(rec->dst_ip));
+   if ((pkt.field_indicator & PCKT_IPV4_MASK) == PCKT_IPV4_MASK) {
+      rec->ip_version = 4;
+      rec->src_ip.v4 = pkt.src_ip.v4;
+      rec->dst_ip.v4 = pkt.dst_ip.v4;
+   } else if ((pkt.field_indicator & PCKT_IPV6_MASK) == PCKT_IPV6_MASK) {
+      rec->ip_version = 6;
+      rec->src_ip = pkt.src_ip;
+      rec->dst_ip = pkt.dst_ip;
+   }
+   memcpy(rec + 1, pkt.packet, pkt.total_length);
+
+   head += size;
+}
+
+/**
+ * \brief Check whether stored packet is selected by filter.
+ * \param [in] rec Stored packet.
+ * \param [in] filter Packet selection.
+ * \return True if packet matches.
+ */
+bool PacketRing::match(const ring_record_t *rec, const ring_filter_t &filter) const
+{
+   if (rec->ip_version != filter.ip_version) {
+      return false;
+   }
+   if (filter.flow && rec->hash != filter.hash[0] && rec->hash != filter.hash[1]) {
+      return false; // Flow id differs, no need to compare the key.
+   }
+
+   bool fwd = !memcmp(&rec->src_ip, &filter.ip1, sizeof(ipaddr_t)) && !memcmp(&rec->dst_ip, &filter.ip2, sizeof(ipaddr_t));
+   bool rev = !memcmp(&rec->src_ip, &filter.ip2, sizeof(ipaddr_t)) && !memcmp(&rec->dst_ip, &filter.ip1, sizeof(ipaddr_t));
+   if (!filter.flow) {
+      return fwd || rev;
+   }
+   if (rec->ip_proto != filter.ip_proto) {
+      return false;
+   }
+
+   return (fwd && rec->src_port == filter.port1 && rec->dst_port == filter.port2) ||
+          (rev && rec->src_port == filter.port2 && rec->dst_port == filter.port1);
+}
+
+/**
+ * \brief Write stored packets selected by filter into pcap file.
+ * The whole ring is scanned, records are matched by flow id first.
+ * \param [in] filter Packet selection.
+ * \param [in] file Name of output pcap file in dump directory, it must not contain path.
+ * \return Number of written packets or -1 on error.
+ */
+int PacketRing::dump(const ring_filter_t &filter, const string &file)
+{
+   if (file.empty() || file == "." || file == ".." || file.find('/') != string::npos) {
+      error_msg = "file name must not contain path";
+      return -1;
+   }
+
+   string path = dir + "/" + file;
+   int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, 0600);
+   if (fd == -1) {
+      error_msg = path + ": " + strerror(errno);
+      return -1;
+   }
+   FILE *fp = fdopen(fd, "wb");
+   if (fp == NULL) {
+      error_msg = path + ": " + strerror(errno);
+      close(fd);
+      return -1;
+   }
+
+   /* Packets are always parsed as Ethernet frames. */
+#ifdef PCAP_TSTAMP_PRECISION_NANO
+   pcap_t *pcap = pcap_open_dead_with_tstamp_precision(DLT_EN10MB, MAXPCKTSIZE, PCAP_TSTAMP_PRECISION_NANO);
+   const timestamp_t frac_unit = 1;
+#else
+   pcap_t *pcap = pcap_open_dead(DLT_EN10MB, MAXPCKTSIZE);
+   const timestamp_t frac_unit = 1000;
+#endif
+   if (pcap == NULL) {
+      error_msg = "unable to create pcap handle";
+      fclose(fp);
+      return -1;
+   }
+   pcap_dumper_t *dumper = pcap_dump_fopen(pcap, fp);
+   if (dumper == NULL) {
+      error_msg = pcap_geterr(pcap);
+      pcap_close(pcap);
+      fclose(fp);
+      return -1;
+   }
+
+   int cnt = 0;
+   for (uint64_t offset = tail; offset != head; offset = next_record(offset)) {
+      uint64_t pos = offset % capacity;
+      if (capacity - pos < sizeof(ring_record_t)) {
+         continue;
+      }
+
+      const ring_record_t *rec = (const ring_record_t *) (buffer + pos);
+      if (rec->caplen == 0 || !match(rec, filter)) {
+         continue;
+      }
+
+      struct pcap_pkthdr hdr;
+      hdr.ts.tv_sec = rec->timestamp / NSEC_PER_SEC;
+      hdr.ts.tv_usec = (rec->timestamp % NSEC_PER_SEC) / frac_unit;
+      hdr.caplen = rec->caplen;
+      hdr.len = rec->caplen;
+      pcap_dump((u_char *) dumper, &hdr, (const u_char *) (rec + 1));
+      cnt++;
+   }
+
+   pcap_dump_close(dumper);
+   pcap_close(pcap);
+   return cnt;
+}
+
+/**
+ * \brief Accept pending connection on control socket and read one command line.
+ * Never blocks, only data already received are read. Client whose command is not complete is kept
+ * and read again on the next call, it is dropped when the command is too long or does not arrive in time.
+ * \param [out] command Received command without line terminator.
+ * \return Descriptor of client connection which has to be passed to reply(), -1 if there is no complete command.
+ */
+int PacketRing::get_command(string &command)
+{
+   if (client == -1) {
+      client = accept(sock, NULL, NULL);
+      if (client == -1) {
+         return -1;
+      }
+      fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK); // Not inherited from listening socket on Linux.
+      client_buf.clear();
+      client_since = time(NULL);
+   }
+
+   char buf[RING_COMMAND_MAX_LEN];
+   ssize_t ret = 1;
+   while (client_buf.length() < RING_COMMAND_MAX_LEN && client_buf.find('\n') == string::npos &&
+          (ret = recv(client, buf, RING_COMMAND_MAX_LEN - client_buf.length(), 0)) > 0) {
+      client_buf.append(buf, ret);
+   }
+
+   size_t end = client_buf.find_first_of("\r\n");
+   if (end == string::npos) {
+      bool closed = (ret == 0 || (ret == -1 && errno != EAGAIN && errno != EWOULDBLOCK));
+      if (closed && !client_buf.empty()) {
+         end = client_buf.length(); // Command without line terminator followed by end of connection.
+      } else if (closed || client_buf.length() >= RING_COMMAND_MAX_LEN || time(NULL) - client_since > RING_COMMAND_TIMEOUT) {
+         close(client);
+         client = -1;
+         return -1;
+      } else {
+         return -1; // Wait for the rest of command.
+      }
+   }
+
+   int ready = client;
+   command = client_buf.substr(0, end);
+   client = -1;
+   return ready;
+}
+
+/**
+ * \brief Send reply to client and close the connection.
+ * \param [in] client Descriptor returned by get_command().
+ * \param [in] msg Reply message.
+ */
+void PacketRing::reply(int client, const string &msg)
+{
+   string line = msg + "\n";
+   send(client, line.c_str(), line.length(), MSG_NOSIGNAL);
+   close(client);
+}
+
+/**
+ * \brief Parse IP address of filter.
+ * \param [in] str String representation of address.
+ * \param [out] addr Parsed address, unused bytes are zeroed.
+ * \return IP version or 0 on error.
+ */
+static uint8_t parse_ring_ip(const string &str, ipaddr_t &addr)
+{
+   memset(&addr, 0, sizeof(addr));
+   if (inet_pton(AF_INET, str.c_str(), &addr.v4) == 1) {
+      return 4;
+   }
+   if (inet_pton(AF_INET6, str.c_str(), addr.v6) == 1) {
+      return 6;
+   }
+   return 0;
+}
+
+/**
+ * \brief Parse control command.
+ * Supported commands are "flow PROTO SRC_IP SRC_PORT DST_IP DST_PORT FILE" and "pair IP1 IP2 FILE".
+ * PROTO is tcp, udp or protocol number.
+ * \param [in] command Command line.
+ * \param [out] filter Packet selection, hash member is not filled.
+ * \param [out] file Name of output file.
+ * \return True on success.
+ */
+bool parse_ring_command(const string &command, ring_filter_t &filter, string &file)
+{
+   istringstream in(command);
+   string cmd, proto, ip1, ip2, extra;
+   unsigned int port1 = 0, port2 = 0;
+
+   memset(&filter, 0, sizeof(filter));
+   in >> cmd;
+   if (cmd == "flow") {
+      if (!(in >> proto >> ip1 >> port1 >> ip2 >> port2 >> file) || port1 > 65535 || port2 > 65535) {
+         return false;
+      }
+      if (proto == "tcp") {
+         filter.ip_proto = IPPROTO_TCP;
+      } else if (proto == "udp") {
+         filter.ip_proto = IPPROTO_UDP;
+      } else {
+         char *end;
+         unsigned long num = strtoul(proto.c_str(), &end, 10);
+         if (*end != 0 || proto.empty() || num > 255) {
+            return false;
+         }
+         filter.ip_proto = num;
+      }
+      filter.flow = true;
+      filter.port1 = port1;
+      filter.port2 = port2;
+   } else if (cmd == "pair") {
+      if (!(in >> ip1 >> ip2 >> file)) {
+         return false;
+      }
+   } else {
+      return false;
+   }
+   if (in >> extra) {
+      return false;
+   }
+
+   filter.ip_version = parse_ring_ip(ip1, filter.ip1);
+   return filter.ip_version != 0 && parse_ring_ip(ip2, filter.ip2) == filter.ip_version;
+}
@@ -0,0 +1,129 @@
+/**
+ * \file packetring.h
+ * \brief Ring of recently captured packets which can be dumped to pcap file on request.
+ * \date 2016
+ */
+/*
+ * Copyright (C) 2016 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef PACKETRING_H
+#define PACKETRING_H
+
+#include <string>
+#include <stdint.h>
+#include <time.h>
+
+#include "packet.h"
+#include "ipaddr.h"
+
+using namespace std;
+
+#define RING_ALIGN(x) (((x) + 7) & ~7U) /**< Records are aligned to 8 bytes. */
+#define RING_COMMAND_MAX_LEN 512        /**< Maximal length of control command. */
+#define RING_COMMAND_TIMEOUT 5          /**< Seconds to wait for complete command of connected client. */
+
+/**
+ * \brief Header of packet stored in the ring, packet data follows.
+ */
+struct ring_record_t {
+   uint32_t size;       /**< Size of the whole record including alignment. */
+   uint32_t hash;       /**< Hash of flow key of the packet (flow id), 0 if packet has no key. */
+   timestamp_t timestamp; /**< Packet timestamp. */
+   uint16_t caplen;     /**< Length of stored packet data, 0 for padding records. */
+   uint8_t ip_version;  /**< IP version, 0 if packet is not IP. */
+   uint8_t ip_proto;
+   uint16_t src_port;
+   uint16_t dst_port;
+   ipaddr_t src_ip;
+   ipaddr_t dst_ip;
+};
+
+/**
+ * \brief Selection of packets to dump.
+ */
+struct ring_filter_t {
+   bool flow;           /**< Match whole 5-tuple, otherwise match IP pair only. */
+   uint8_t ip_version;
+   uint8_t ip_proto;
+   ipaddr_t ip1;
+   ipaddr_t ip2;
+   uint16_t port1;
+   uint16_t port2;
+   uint32_t hash[2];    /**< Flow ids of both directions (ip1 -> ip2 and ip2 -> ip1), used when flow is set. */
+};
+
+/**
+ * \brief Bounded ring of recent packets with a UNIX socket accepting dump commands.
+ *
+ * Packets are stored one after another into a byte buffer, the oldest ones are overwritten
+ * when the buffer is full. A record which does not fit before the end of the buffer starts
+ * at the beginning and the rest of the buffer is skipped.
+ * The socket is accessible only by the owner and files are written only into the dump directory.
+ */
+class PacketRing
+{
+public:
+   string error_msg; /**< String to store an error messages. */
+
+   PacketRing();
+   ~PacketRing();
+
+   int init(uint64_t size, const string &socket_path, const string &dump_dir);
+   void add(const Packet &pkt, uint32_t hash);
+   int dump(const ring_filter_t &filter, const string &file);
+   int get_command(string &command);
+   void reply(int client, const string &msg);
+
+private:
+   uint8_t *buffer;     /**< Ring buffer. */
+   uint64_t capacity;   /**< Size of the buffer. */
+   uint64_t head;       /**< Logical offset where next record is written. */
+   uint64_t tail;       /**< Logical offset of the oldest record. */
+   int sock;            /**< Listening control socket. */
+   string sock_path;
+   string dir;          /**< Directory of dumped files. */
+   int client;          /**< Connected client whose command is not complete yet, -1 if none. */
+   string client_buf;   /**< Part of command received from client. */
+   time_t client_since; /**< Time when client was accepted. */
+
+   uint64_t next_record(uint64_t offset) const;
+   bool match(const ring_record_t *rec, const ring_filter_t &filter) const;
+};
+
+bool parse_ring_command(const string &command, ring_filter_t &filter, string &file);
+
+#endif
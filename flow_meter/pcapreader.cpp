@@ -88,6 +88,11 @@ static uint32_t s_total_pkts = 0;
  */
 bool packet_valid = false;
 
+/**
+ * \brief Timestamps of captured packets have nanosecond resolution (tv_usec member contains nanoseconds).
+ */
+bool tstamp_nano = false;
+
 /**
  * \brief Parse specific fields from ETHERNET frame header.
  * \param [in] data_ptr Pointer to begin of header.
@@ -273,7 +278,7 @@ void packet_handler(u_char *arg, const struct pcap_pkthdr *h, const u_char *data
    DEBUG_MSG("Packet length:\t\tcaplen=%uB len=%uB\n\n", h->caplen, h->len);
 
    pkt->field_indicator = PCKT_PCAP_MASK;
-   pkt->timestamp = h->ts;
+   pkt->timestamp = (timestamp_t) h->ts.tv_sec * NSEC_PER_SEC + (tstamp_nano ? h->ts.tv_usec : h->ts.tv_usec * 1000);
    pkt->src_port = 0;
    pkt->dst_port = 0;
    pkt->ip_proto = 0;
@@ -347,11 +352,16 @@ int PcapReader::open_file(const string &file)
    }
 
    char error_buffer[PCAP_ERRBUF_SIZE];
+#ifdef PCAP_TSTAMP_PRECISION_NANO
+   handle = pcap_open_offline_with_tstamp_precision(file.c_str(), PCAP_TSTAMP_PRECISION_NANO, error_buffer);
+#else
    handle = pcap_open_offline(file.c_str(), error_buffer);
+#endif
    if (handle == NULL) {
       error_msg = error_buffer;
       return 2;
    }
+   set_tstamp_precision();
 
    if (print_pcap_stats) {
       printf("PcapReader: warning: printing pcap stats is only supported in live capture\n");
@@ -377,14 +387,40 @@ int PcapReader::init_interface(const string &interface)
    char errbuf[PCAP_ERRBUF_SIZE];
    errbuf[0] = 0;
 
-   handle = pcap_open_live(interface.c_str(), MAXPCKTSIZE, 1, READ_TIMEOUT, errbuf);
-   if (handle == NULL) {
-      error_msg = errbuf;
-      return 2;
-   }
-   if (errbuf[0] != 0) {
-      fprintf(stderr, "%s\n", errbuf); // Print warning.
+   /* Try hardware timestamps first, capture without them when the adapter refuses. */
+   for (int hw_tstamp = 1; hw_tstamp >= 0; hw_tstamp--) {
+      handle = pcap_create(interface.c_str(), errbuf);
+      if (handle == NULL) {
+         error_msg = errbuf;
+         return 2;
+      }
+      pcap_set_snaplen(handle, MAXPCKTSIZE);
+      pcap_set_promisc(handle, 1);
+      pcap_set_timeout(handle, READ_TIMEOUT);
+#ifdef PCAP_TSTAMP_ADAPTER
+      if (hw_tstamp) {
+         pcap_set_tstamp_type(handle, PCAP_TSTAMP_ADAPTER); // Ignored with a warning when not supported.
+      }
+#endif
+#ifdef PCAP_TSTAMP_PRECISION_NANO
+      pcap_set_tstamp_precision(handle, PCAP_TSTAMP_PRECISION_NANO);
+#endif
+
+      int ret = pcap_activate(handle);
+      if (ret > 0 && ret != PCAP_WARNING_TSTAMP_TYPE_NOTSUP) {
+         fprintf(stderr, "%s\n", pcap_statustostr(ret)); // Print warning.
+      } else if (ret < 0) {
+         error_msg = (ret == PCAP_ERROR ? pcap_geterr(handle) : pcap_statustostr(ret));
+         pcap_close(handle);
+         handle = NULL;
+         if (hw_tstamp) {
+            continue;
+         }
+         return 2;
+      }
+      break;
    }
+   set_tstamp_precision();
 
    if (print_pcap_stats) {
       /* Print stats header. */
@@ -399,6 +435,18 @@ int PcapReader::init_interface(const string &interface)
    return 0;
 }
 
+/**
+ * \brief Set resolution of timestamps according to opened handle.
+ */
+void PcapReader::set_tstamp_precision()
+{
+#ifdef PCAP_TSTAMP_PRECISION_NANO
+   tstamp_nano = (pcap_get_tstamp_precision(handle) == PCAP_TSTAMP_PRECISION_NANO);
+#else
+   tstamp_nano = false;
+#endif
+}
+
 /**
  * \brief Close opened file or interface.
  */
@@ -74,6 +74,8 @@ private:
    bool live_capture;               /**< PcapReader is capturing from network interface. */
    bool print_pcap_stats;           /**< Print pcap handle stats. */
    struct timeval last_ts;          /**< Last timestamp. */
+
+   void set_tstamp_precision();
 };
 
 void packet_handler(u_char *arg, const struct pcap_pkthdr *h, const u_char *data);
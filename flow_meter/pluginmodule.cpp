@@ -0,0 +1,116 @@
+/**
+ * \file pluginmodule.cpp
+ * \brief Loading of flow cache plugins from shared objects.
+ * \date 2016
+ */
+/*
+ * Copyright (C) 2016 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <dlfcn.h>
+
+#include <unirec/unirec.h>
+
+#include "pluginmodule.h"
+#include "flowifc.h"
+
+using namespace std;
+
+static uint16_t next_dynamic_ext = dynamic_ext_first; /**< Extension type assigned to the next registered extension. */
+
+/**
+ * \brief Load plugin from shared object and register its extension headers and UniRec fields.
+ * \param [in] path Path to shared object.
+ * \param [in] module_options Options for plugin initialization.
+ * \param [in] ifc_num Output interface of the plugin.
+ * \param [out] handle Handle of loaded shared object, it must be closed after the plugin is deleted.
+ * \return New plugin instance or NULL when error occur.
+ */
+FlowCachePlugin *load_plugin_module(const string &path, const options_t &module_options, int ifc_num, void *&handle)
+{
+   handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+   if (handle == NULL) {
+      fprintf(stderr, "Unable to load plugin %s: %s\n", path.c_str(), dlerror());
+      return NULL;
+   }
+
+   plugin_info_func_t info_func;
+   *(void **) &info_func = dlsym(handle, FLOW_METER_PLUGIN_SYMBOL);
+   const plugin_module_info_t *info = (info_func != NULL ? info_func() : NULL);
+   if (info == NULL) {
+      fprintf(stderr, "Plugin %s does not provide %s entry point\n", path.c_str(), FLOW_METER_PLUGIN_SYMBOL);
+      dlclose(handle);
+      handle = NULL;
+      return NULL;
+   }
+
+   const plugin_abi_t abi = FLOW_METER_PLUGIN_ABI;
+   if (memcmp(&info->abi, &abi, sizeof(abi)) != 0 || info->create == NULL) {
+      fprintf(stderr, "Plugin %s was built against different flow_meter headers or C++ ABI\n", path.c_str());
+      dlclose(handle);
+      handle = NULL;
+      return NULL;
+   }
+
+   if (info->unirec_fields != NULL && ur_define_set_of_fields(info->unirec_fields) != UR_OK) {
+      fprintf(stderr, "Plugin %s: unable to define UniRec fields \"%s\"\n", info->name, info->unirec_fields);
+      dlclose(handle);
+      handle = NULL;
+      return NULL;
+   }
+
+   vector<plugin_opt> opts;
+   for (int i = 0; info->ext_names != NULL && info->ext_names[i] != NULL; i++) {
+      if (next_dynamic_ext > dynamic_ext_last) {
+         fprintf(stderr, "Plugin %s: too many extension headers\n", info->name);
+         dlclose(handle);
+         handle = NULL;
+         return NULL;
+      }
+      opts.push_back(plugin_opt(info->ext_names[i], next_dynamic_ext++, ifc_num));
+   }
+
+   FlowCachePlugin *plugin = info->create(module_options, opts);
+   if (plugin == NULL) {
+      fprintf(stderr, "Plugin %s: initialization failed\n", info->name);
+      dlclose(handle);
+      handle = NULL;
+   }
+
+   return plugin;
+}
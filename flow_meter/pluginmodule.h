@@ -0,0 +1,114 @@
+/**
+ * \file pluginmodule.h
+ * \brief Interface of flow cache plugins loaded at runtime from shared objects.
+ * \date 2016
+ */
+/*
+ * Copyright (C) 2016 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef PLUGINMODULE_H
+#define PLUGINMODULE_H
+
+#include <string>
+#include <vector>
+
+#include "flowcacheplugin.h"
+#include "flow_meter.h"
+
+using namespace std;
+
+#define FLOW_METER_PLUGIN_API_VERSION 2
+#define FLOW_METER_PLUGIN_SYMBOL "flow_meter_plugin_info" /**< Name of the entry point of plugin module. */
+
+/**
+ * \brief Version of C++ ABI the module was built with.
+ * Plugins are C++ classes receiving C++ objects, so a module works only when it is built by a compiler with
+ * the same ABI against the same flow_meter headers. Layout changes are caught by sizes in plugin_abi_t.
+ */
+#ifdef __GXX_ABI_VERSION
+#define FLOW_METER_PLUGIN_ABI_VERSION ((uint32_t) __GXX_ABI_VERSION)
+#else
+#define FLOW_METER_PLUGIN_ABI_VERSION 0
+#endif
+
+/**
+ * \brief Plain C description of the interface the module was built against, checked before anything else is used.
+ */
+struct plugin_abi_t {
+   uint32_t api_version;  /**< FLOW_METER_PLUGIN_API_VERSION. */
+   uint32_t abi_version;  /**< FLOW_METER_PLUGIN_ABI_VERSION. */
+   uint32_t options_size; /**< Size of options_t. */
+   uint32_t plugin_size;  /**< Size of FlowCachePlugin. */
+   uint32_t record_size;  /**< Size of FlowRecord. */
+   uint32_t packet_size;  /**< Size of Packet. */
+};
+
+/**
+ * \brief Initializer of plugin_abi_t for the headers the module is compiled with.
+ */
+#define FLOW_METER_PLUGIN_ABI {FLOW_METER_PLUGIN_API_VERSION, FLOW_METER_PLUGIN_ABI_VERSION, \
+   sizeof(options_t), sizeof(FlowCachePlugin), sizeof(FlowRecord), sizeof(Packet)}
+
+/**
+ * \brief Create instance of plugin.
+ * \param [in] module_options Module options.
+ * \param [in] plugin_options Extension headers of the plugin with type ids assigned by flow_meter, in order of plugin_module_info_t::ext_names.
+ * \return New plugin instance, flow_meter deletes it at exit.
+ */
+typedef FlowCachePlugin *(*plugin_create_func_t)(const options_t &module_options, vector<plugin_opt> plugin_options);
+
+/**
+ * \brief Description of plugin module.
+ */
+struct plugin_module_info_t {
+   plugin_abi_t abi;             /**< Set to FLOW_METER_PLUGIN_ABI, it has to be the first member. */
+   const char *name;             /**< Name of the plugin. */
+   const char *const *ext_names; /**< NULL terminated list of extension header names. */
+   const char *unirec_fields;    /**< Definition of UniRec fields used by plugin, e.g. "uint16 FOO,string BAR", or NULL. */
+   plugin_create_func_t create;  /**< Create plugin instance. */
+};
+
+/**
+ * \brief Entry point of plugin module, it has to be exported with C linkage as FLOW_METER_PLUGIN_SYMBOL:
+ * extern "C" const plugin_module_info_t *flow_meter_plugin_info();
+ * Only the symbol lookup is C, the rest of the interface is C++ and is guarded by plugin_module_info_t::abi.
+ */
+typedef const plugin_module_info_t *(*plugin_info_func_t)();
+
+FlowCachePlugin *load_plugin_module(const string &path, const options_t &module_options, int ifc_num, void *&handle);
+
+#endif
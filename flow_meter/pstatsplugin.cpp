@@ -0,0 +1,171 @@
+/**
+ * \file pstatsplugin.cpp
+ * \brief Plugin for computing packet length and inter-arrival time statistics of flows.
+ * \date 2016
+ */
+/*
+ * Copyright (C) 2016 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <iostream>
+#include <string.h>
+
+#include <unirec/unirec.h>
+
+#include "flowifc.h"
+#include "flowcacheplugin.h"
+#include "flow_meter.h"
+#include "pstatsplugin.h"
+#include "packet.h"
+
+using namespace std;
+
+#define PSTATS_UNIREC_TEMPLATE "PSTATS_PKT_LENGTHS,PSTATS_PKT_DIRECTIONS,PSTATS_LENGTH_HIST,PSTATS_IAT_HIST"
+
+UR_FIELDS (
+   bytes PSTATS_PKT_LENGTHS,
+   bytes PSTATS_PKT_DIRECTIONS,
+   bytes PSTATS_LENGTH_HIST,
+   bytes PSTATS_IAT_HIST
+)
+
+PSTATSPlugin::PSTATSPlugin(const options_t &module_options)
+{
+   print_stats = module_options.print_stats;
+   total = 0;
+}
+
+PSTATSPlugin::PSTATSPlugin(const options_t &module_options, vector<plugin_opt> plugin_options) : FlowCachePlugin(plugin_options)
+{
+   print_stats = module_options.print_stats;
+   total = 0;
+}
+
+int PSTATSPlugin::post_create(FlowRecord &rec, const Packet &pkt)
+{
+   RecordExtPSTATS *ext = new RecordExtPSTATS();
+
+   ext->data.last_ts = pkt.timestamp;
+   rec.addExtension(ext);
+   update_record(ext, rec, pkt);
+
+   return 0;
+}
+
+int PSTATSPlugin::post_update(FlowRecord &rec, const Packet &pkt)
+{
+   RecordExtPSTATS *ext = static_cast<RecordExtPSTATS *>(rec.getExtension(pstats));
+   if (ext != NULL) {
+      update_record(ext, rec, pkt);
+   }
+
+   return 0;
+}
+
+/**
+ * \brief Add packet into statistics of the flow.
+ * \param [in,out] ext Statistics of the flow.
+ * \param [in] rec Flow record the packet belongs to.
+ * \param [in] pkt Parsed packet.
+ */
+void PSTATSPlugin::update_record(RecordExtPSTATS *ext, const FlowRecord &rec, const Packet &pkt)
+{
+   pstats_data_t &data = ext->data;
+   int64_t iat = (int64_t) (pkt.timestamp - data.last_ts) / 1000000;
+
+   total++;
+   data.length_hist[pstats_hist_bin(pkt.ip_length)]++;
+   if (rec.pkt_total_cnt + rec.dst_pkt_total_cnt > 1) {
+      data.iat_hist[pstats_hist_bin(iat > 0 ? iat : 0)]++;
+   }
+   data.last_ts = pkt.timestamp;
+
+   if (data.pkt_count < PSTATS_PKT_COUNT) {
+      bool reverse;
+      if (rec.ip_version == 4) {
+         reverse = pkt.src_ip.v4 != rec.src_ip.v4;
+      } else {
+         reverse = memcmp(pkt.src_ip.v6, rec.src_ip.v6, sizeof(pkt.src_ip.v6)) != 0;
+      }
+      reverse = reverse || pkt.src_port != rec.src_port;
+
+      data.pkt_lengths[data.pkt_count] = pkt.ip_length;
+      data.pkt_dirs[data.pkt_count] = (reverse ? -1 : 1);
+      data.pkt_count++;
+   }
+}
+
+void PSTATSPlugin::finish()
+{
+   if (print_stats) {
+      cout << "PSTATS plugin stats:" << endl;
+      cout << "   Processed packets: " << total << endl;
+   }
+}
+
+string PSTATSPlugin::get_unirec_field_string()
+{
+   return PSTATS_UNIREC_TEMPLATE;
+}
+
+vector<ipfix_field_t> PSTATSPlugin::get_ipfix_fields(uint16_t ext_type)
+{
+   vector<ipfix_field_t> fields;
+
+   if (ext_type == pstats) {
+      fields.push_back(ipfix_field_t(IPFIX_CESNET_PEN, PSTATS_IPFIX_PKT_LENGTHS, IPFIX_VAR_LENGTH));
+      fields.push_back(ipfix_field_t(IPFIX_CESNET_PEN, PSTATS_IPFIX_PKT_DIRECTIONS, IPFIX_VAR_LENGTH));
+      fields.push_back(ipfix_field_t(IPFIX_CESNET_PEN, PSTATS_IPFIX_LENGTH_HIST, IPFIX_VAR_LENGTH));
+      fields.push_back(ipfix_field_t(IPFIX_CESNET_PEN, PSTATS_IPFIX_IAT_HIST, IPFIX_VAR_LENGTH));
+   }
+
+   return fields;
+}
+
+RecordExt *PSTATSPlugin::deserialize_ext(uint16_t ext_type, const uint8_t *buffer, int size)
+{
+   if (ext_type != pstats || size != (int) sizeof(pstats_data_t)) {
+      return NULL;
+   }
+
+   RecordExtPSTATS *ext = new RecordExtPSTATS();
+   memcpy(&ext->data, buffer, sizeof(ext->data));
+   if (ext->data.pkt_count > PSTATS_PKT_COUNT) {
+      delete ext; // Damaged checkpoint, packet arrays would be overrun.
+      return NULL;
+   }
+   return ext;
+}
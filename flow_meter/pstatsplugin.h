@@ -0,0 +1,189 @@
+/**
+ * \file pstatsplugin.h
+ * \brief Plugin for computing packet length and inter-arrival time statistics of flows.
+ * \date 2016
+ */
+/*
+ * Copyright (C) 2016 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef PSTATSPLUGIN_H
+#define PSTATSPLUGIN_H
+
+#include <string>
+#include <vector>
+
+#include "fields.h"
+#include "flowifc.h"
+#include "flowcacheplugin.h"
+#include "packet.h"
+#include "flow_meter.h"
+
+using namespace std;
+
+#define PSTATS_PKT_COUNT 30    /**< Number of first packets whose lengths and directions are stored. */
+#define PSTATS_HIST_BINS 8     /**< Number of histogram bins. */
+#define PSTATS_HIST_MIN_BITS 4 /**< First bin holds values below 2^PSTATS_HIST_MIN_BITS. */
+
+#define PSTATS_IPFIX_PKT_LENGTHS    1000
+#define PSTATS_IPFIX_PKT_DIRECTIONS 1001
+#define PSTATS_IPFIX_LENGTH_HIST    1002
+#define PSTATS_IPFIX_IAT_HIST       1003
+
+/**
+ * \brief Statistics of a flow, plain data so they can be copied to checkpoint as a whole.
+ */
+struct pstats_data_t {
+   uint32_t length_hist[PSTATS_HIST_BINS]; /**< Histogram of IP packet lengths in bytes. */
+   uint32_t iat_hist[PSTATS_HIST_BINS];    /**< Histogram of packet inter-arrival times in milliseconds. */
+   uint16_t pkt_lengths[PSTATS_PKT_COUNT]; /**< IP lengths of the first packets. */
+   int8_t pkt_dirs[PSTATS_PKT_COUNT];      /**< Directions of the first packets, 1 from source, -1 from destination. */
+   uint8_t pkt_count;                      /**< Number of stored packet lengths. */
+   timestamp_t last_ts;                    /**< Timestamp of the last packet. */
+};
+
+/**
+ * \brief Get histogram bin of a value, bins cover 0-15, 16-31, 32-63, ..., 1024 and more.
+ * \param [in] value Value to classify.
+ * \return Bin index.
+ */
+inline int pstats_hist_bin(uint32_t value)
+{
+   if (value < (1U << PSTATS_HIST_MIN_BITS)) {
+      return 0;
+   }
+
+   int bin = (31 - __builtin_clz(value)) - PSTATS_HIST_MIN_BITS + 1;
+   return (bin < PSTATS_HIST_BINS ? bin : PSTATS_HIST_BINS - 1);
+}
+
+/**
+ * \brief Flow record extension header for storing packet statistics.
+ */
+struct RecordExtPSTATS : RecordExt {
+   pstats_data_t data;
+
+   /**
+    * \brief Constructor.
+    */
+   RecordExtPSTATS() : RecordExt(pstats)
+   {
+      memset(&data, 0, sizeof(data));
+   }
+
+   /**
+    * \brief Write statistics in network byte order.
+    * \param [out] lengths Packet lengths, 2 bytes per packet.
+    * \param [out] length_hist Histogram of lengths, 4 bytes per bin.
+    * \param [out] iat_hist Histogram of inter-arrival times, 4 bytes per bin.
+    */
+   void to_network_order(uint16_t *lengths, uint32_t *length_hist, uint32_t *iat_hist) const
+   {
+      for (int i = 0; i < data.pkt_count; i++) {
+         lengths[i] = htons(data.pkt_lengths[i]);
+      }
+      for (int i = 0; i < PSTATS_HIST_BINS; i++) {
+         length_hist[i] = htonl(data.length_hist[i]);
+         iat_hist[i] = htonl(data.iat_hist[i]);
+      }
+   }
+
+   virtual void fillUnirec(ur_template_t *tmplt, void *record)
+   {
+      uint16_t lengths[PSTATS_PKT_COUNT];
+      uint32_t length_hist[PSTATS_HIST_BINS];
+      uint32_t iat_hist[PSTATS_HIST_BINS];
+
+      to_network_order(lengths, length_hist, iat_hist);
+      ur_set_var(tmplt, record, F_PSTATS_PKT_LENGTHS, lengths, data.pkt_count * sizeof(uint16_t));
+      ur_set_var(tmplt, record, F_PSTATS_PKT_DIRECTIONS, data.pkt_dirs, data.pkt_count);
+      ur_set_var(tmplt, record, F_PSTATS_LENGTH_HIST, length_hist, sizeof(length_hist));
+      ur_set_var(tmplt, record, F_PSTATS_IAT_HIST, iat_hist, sizeof(iat_hist));
+   }
+
+   virtual int fillIPFIX(uint8_t *buffer, int size)
+   {
+      uint16_t lengths[PSTATS_PKT_COUNT];
+      uint32_t length_hist[PSTATS_HIST_BINS];
+      uint32_t iat_hist[PSTATS_HIST_BINS];
+      const void *fields[] = {lengths, data.pkt_dirs, length_hist, iat_hist};
+      int sizes[] = {data.pkt_count * (int) sizeof(uint16_t), data.pkt_count, (int) sizeof(length_hist), (int) sizeof(iat_hist)};
+      int len, total = 0;
+
+      to_network_order(lengths, length_hist, iat_hist);
+      for (unsigned int i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+         len = ipfix_fill_bytes(buffer + total, size - total, fields[i], sizes[i]);
+         if (len < 0) {
+            return -1;
+         }
+         total += len;
+      }
+      return total;
+   }
+
+   virtual int serialize(uint8_t *buffer, int size) const
+   {
+      if (size < (int) sizeof(data)) {
+         return -1;
+      }
+      memcpy(buffer, &data, sizeof(data));
+      return sizeof(data);
+   }
+};
+
+/**
+ * \brief Flow cache plugin computing packet length and inter-arrival time statistics.
+ */
+class PSTATSPlugin : public FlowCachePlugin
+{
+public:
+   PSTATSPlugin(const options_t &module_options);
+   PSTATSPlugin(const options_t &module_options, vector<plugin_opt> plugin_options);
+   int post_create(FlowRecord &rec, const Packet &pkt);
+   int post_update(FlowRecord &rec, const Packet &pkt);
+   void finish();
+   string get_unirec_field_string();
+   vector<ipfix_field_t> get_ipfix_fields(uint16_t ext_type);
+   RecordExt *deserialize_ext(uint16_t ext_type, const uint8_t *buffer, int size);
+
+private:
+   void update_record(RecordExtPSTATS *ext, const FlowRecord &rec, const Packet &pkt);
+
+   bool print_stats; /**< Indicator whether to print stats when flow cache is finishing or not. */
+   uint64_t total;   /**< Total number of processed packets. */
+};
+
+#endif
@@ -52,7 +52,7 @@
 using namespace std;
 
 // Constructor
-StatsPlugin::StatsPlugin(struct timeval interval, ostream &out)
+StatsPlugin::StatsPlugin(timestamp_t interval, ostream &out)
  : interval(interval), out(out)
 {
 }
@@ -102,12 +102,9 @@ void StatsPlugin::check_timestamp(const Packet &pkt)
       return;
    }
 
-   struct timeval tmp;
-   timeradd(&last_ts, &interval, &tmp);
-
-   if (timercmp(&pkt.timestamp, &tmp, >)) {
+   if (pkt.timestamp > last_ts + interval) {
       print_stats(last_ts);
-      timeradd(&last_ts, &interval, &last_ts);
+      last_ts += interval;
       packets = 0;
       new_flows = 0;
       cache_hits = 0;
@@ -119,8 +116,8 @@ void StatsPlugin::print_header() const
    out << "#timestamp packets hits newflows incache" << endl;
 }
 
-void StatsPlugin::print_stats(const struct timeval &ts) const
+void StatsPlugin::print_stats(timestamp_t ts) const
 {
-   out << ts.tv_sec << "." << ts.tv_usec << " ";
+   out << ts / NSEC_PER_SEC << "." << setw(9) << setfill('0') << ts % NSEC_PER_SEC << setfill(' ') << " ";
    out << packets << " " << cache_hits << " " << new_flows << " " << flows_in_cache << endl;
 }
@@ -59,17 +59,17 @@ class StatsPlugin : public FlowCachePlugin
    unsigned long cache_hits;
    unsigned long flows_in_cache;
 
-   struct timeval interval;
-   struct timeval last_ts;
+   timestamp_t interval;
+   timestamp_t last_ts;
    ostream &out;
    bool init_ts;
 
    void check_timestamp(const Packet &pkt);
    void print_header() const;
-   void print_stats(const struct timeval &ts) const;
+   void print_stats(timestamp_t ts) const;
 
 public:
-   StatsPlugin(struct timeval interval, ostream &out);
+   StatsPlugin(timestamp_t interval, ostream &out);
 
    void init();
    int post_create(FlowRecord &rec, const Packet &pkt);
@@ -0,0 +1,6 @@
+#!/bin/sh
+
+. ./test_plugin.sh
+
+test_plugin pstats "$pcap_dir/http-sample.pcap"
+
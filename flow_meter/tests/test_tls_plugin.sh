@@ -0,0 +1,6 @@
+#!/bin/sh
+
+. ./test_plugin.sh
+
+test_plugin tls "$pcap_dir/tls-sample.pcap"
+
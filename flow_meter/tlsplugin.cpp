@@ -0,0 +1,443 @@
+/**
+ * \file tlsplugin.cpp
+ * \brief Plugin for parsing TLS ClientHello messages (SNI and JA3 fingerprint).
+ * \date 2016
+ */
+/*
+ * Copyright (C) 2016 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+
+#include <unirec/unirec.h>
+
+#include "flowifc.h"
+#include "flowcacheplugin.h"
+#include "flow_meter.h"
+#include "tlsplugin.h"
+#include "packet.h"
+
+using namespace std;
+
+//#define DEBUG_TLS
+
+// Print debug message if debugging is allowed.
+#ifdef DEBUG_TLS
+#define DEBUG_MSG(format, ...) fprintf(stderr, format, ##__VA_ARGS__)
+#else
+#define DEBUG_MSG(format, ...)
+#endif
+
+#define TLS_UNIREC_TEMPLATE "TLS_VERSION,TLS_SNI,TLS_JA3"
+
+UR_FIELDS (
+   uint16 TLS_VERSION,
+   string TLS_SNI,
+   string TLS_JA3
+)
+
+#define TLS_CONTENT_HANDSHAKE 0x16
+#define TLS_HANDSHAKE_CLIENT_HELLO 1
+#define TLS_EXT_SERVER_NAME 0
+#define TLS_EXT_SUPPORTED_GROUPS 10
+#define TLS_EXT_EC_POINT_FORMATS 11
+
+/**
+ * \brief Incremental MD5 computation (RFC 1321), used for JA3 digest.
+ */
+struct md5_ctx_t {
+   uint32_t state[4];
+   uint64_t length;
+   uint8_t block[64];
+};
+
+static const uint32_t md5_k[64] = {
+   0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee,
+   0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+   0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+   0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+   0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
+   0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+   0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed,
+   0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+   0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+   0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+   0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05,
+   0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+   0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039,
+   0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+   0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+   0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+static const uint8_t md5_shift[16] = {7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21};
+
+static void md5_transform(uint32_t state[4], const uint8_t *block)
+{
+   uint32_t w[16];
+   uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+
+   for (int i = 0; i < 16; i++) {
+      w[i] = block[i * 4] | (block[i * 4 + 1] << 8) | (block[i * 4 + 2] << 16) | ((uint32_t) block[i * 4 + 3] << 24);
+   }
+
+   for (int i = 0; i < 64; i++) {
+      uint32_t f;
+      int g;
+      if (i < 16) {
+         f = (b & c) | (~b & d);
+         g = i;
+      } else if (i < 32) {
+         f = (d & b) | (~d & c);
+         g = (5 * i + 1) % 16;
+      } else if (i < 48) {
+         f = b ^ c ^ d;
+         g = (3 * i + 5) % 16;
+      } else {
+         f = c ^ (b | ~d);
+         g = (7 * i) % 16;
+      }
+
+      uint32_t tmp = d;
+      uint32_t x = a + f + md5_k[i] + w[g];
+      int s = md5_shift[(i / 16) * 4 + i % 4];
+      d = c;
+      c = b;
+      b = b + ((x << s) | (x >> (32 - s)));
+      a = tmp;
+   }
+
+   state[0] += a;
+   state[1] += b;
+   state[2] += c;
+   state[3] += d;
+}
+
+static void md5_init(md5_ctx_t &ctx)
+{
+   ctx.state[0] = 0x67452301;
+   ctx.state[1] = 0xefcdab89;
+   ctx.state[2] = 0x98badcfe;
+   ctx.state[3] = 0x10325476;
+   ctx.length = 0;
+}
+
+static void md5_update(md5_ctx_t &ctx, const void *data, int len)
+{
+   const uint8_t *p = (const uint8_t *) data;
+   int used = ctx.length % 64;
+
+   ctx.length += len;
+   while (len > 0) {
+      int n = (len < 64 - used ? len : 64 - used);
+      memcpy(ctx.block + used, p, n);
+      used += n;
+      p += n;
+      len -= n;
+      if (used == 64) {
+         md5_transform(ctx.state, ctx.block);
+         used = 0;
+      }
+   }
+}
+
+static void md5_final(md5_ctx_t &ctx, uint8_t digest[16])
+{
+   uint8_t pad[72];
+   uint64_t bits = ctx.length * 8;
+   int pad_len = (ctx.length % 64 < 56 ? 56 : 120) - ctx.length % 64;
+
+   memset(pad, 0, sizeof(pad));
+   pad[0] = 0x80;
+   for (int i = 0; i < 8; i++) {
+      pad[pad_len + i] = bits >> (i * 8);
+   }
+   md5_update(ctx, pad, pad_len + 8);
+
+   for (int i = 0; i < 16; i++) {
+      digest[i] = ctx.state[i / 4] >> ((i % 4) * 8);
+   }
+}
+
+/**
+ * \brief Append decimal number to JA3 string, preceded by separator unless it is the first item of a field.
+ * \param [in,out] ctx MD5 context of JA3 string.
+ * \param [in] value Value to append.
+ * \param [in,out] first Value is the first item of a field.
+ */
+static void ja3_append(md5_ctx_t &ctx, uint16_t value, bool &first)
+{
+   char buffer[8];
+   int len = snprintf(buffer, sizeof(buffer), (first ? "%u" : "-%u"), value);
+
+   md5_update(ctx, buffer, len);
+   first = false;
+}
+
+/**
+ * \brief Check if value is GREASE value (RFC 8701), which is skipped in JA3.
+ */
+static inline bool is_grease(uint16_t value)
+{
+   return (value & 0x0F0F) == 0x0A0A && (value >> 8) == (value & 0xFF);
+}
+
+TLSPlugin::TLSPlugin(const options_t &module_options)
+{
+   print_stats = module_options.print_stats;
+   parsed = 0;
+   total = 0;
+}
+
+TLSPlugin::TLSPlugin(const options_t &module_options, vector<plugin_opt> plugin_options) : FlowCachePlugin(plugin_options)
+{
+   print_stats = module_options.print_stats;
+   parsed = 0;
+   total = 0;
+}
+
+int TLSPlugin::post_create(FlowRecord &rec, const Packet &pkt)
+{
+   add_ext_tls(rec, pkt);
+   return 0;
+}
+
+int TLSPlugin::post_update(FlowRecord &rec, const Packet &pkt)
+{
+   add_ext_tls(rec, pkt);
+   return 0;
+}
+
+/**
+ * \brief Parse ClientHello from the first payload packet of TCP flow and add extension on success.
+ * \param [in,out] rec Flow record.
+ * \param [in] pkt Parsed packet.
+ */
+void TLSPlugin::add_ext_tls(FlowRecord &rec, const Packet &pkt)
+{
+   if (pkt.payload_length == 0 || rec.ip_proto != 6 || rec.pkt_total_cnt > TLS_PARSE_PKT_LIMIT ||
+      rec.getExtension(tls) != NULL) {
+      return;
+   }
+
+   /* Most inspected payloads are not ClientHello, so the extension is allocated only after a successful parse. */
+   tls_data_t hello;
+   if (parse_client_hello((const uint8_t *) pkt.payload, pkt.payload_length, hello)) {
+      rec.addExtension(new RecordExtTLS(hello));
+   }
+}
+
+/**
+ * \brief Parse TLS ClientHello, compute JA3 digest and copy SNI.
+ * Whole message must be contained in the payload.
+ * \param [in] data Pointer to packet payload.
+ * \param [in] payload_len Length of payload.
+ * \param [out] hello Parsed data, valid only if true is returned.
+ * \return True if payload contains ClientHello.
+ */
+bool TLSPlugin::parse_client_hello(const uint8_t *data, int payload_len, tls_data_t &hello)
+{
+   const uint8_t *end = data + payload_len;
+   const uint8_t *p = data;
+
+   total++;
+
+   /* Record header: content type, version, length. Handshake header: type, 24-bit length. */
+   if (payload_len < 9 || p[0] != TLS_CONTENT_HANDSHAKE || p[1] != 3 || p[5] != TLS_HANDSHAKE_CLIENT_HELLO) {
+      return false;
+   }
+   uint32_t hs_len = (p[6] << 16) | (p[7] << 8) | p[8];
+   p += 9;
+   if (hs_len > (uint32_t) (end - p)) {
+      DEBUG_MSG("TLS: truncated ClientHello\n");
+      return false;
+   }
+   end = p + hs_len;
+   hello.sni[0] = 0;
+
+   /* Client version, random, session id. */
+   if (end - p < 35 || end - p < 35 + p[34]) {
+      return false;
+   }
+   hello.version = (p[0] << 8) | p[1];
+   p += 35 + p[34];
+
+   md5_ctx_t ctx;
+   char buffer[8];
+   bool first = true;
+   md5_init(ctx);
+   md5_update(ctx, buffer, snprintf(buffer, sizeof(buffer), "%u,", hello.version));
+
+   /* Cipher suites. */
+   if (end - p < 2) {
+      return false;
+   }
+   int len = (p[0] << 8) | p[1];
+   p += 2;
+   if (end - p < len || len % 2 != 0) {
+      return false;
+   }
+   for (const uint8_t *c = p; c < p + len; c += 2) {
+      uint16_t cipher = (c[0] << 8) | c[1];
+      if (!is_grease(cipher)) {
+         ja3_append(ctx, cipher, first);
+      }
+   }
+   p += len;
+   md5_update(ctx, ",", 1);
+
+   /* Compression methods. */
+   if (end - p < 1 || end - p < 1 + p[0]) {
+      return false;
+   }
+   p += 1 + p[0];
+
+   /* Extensions, supported groups and point formats are appended after the list of extension types. */
+   const uint8_t *groups = NULL, *formats = NULL;
+   int groups_len = 0, formats_len = 0;
+   first = true;
+
+   if (end - p >= 2) {
+      len = (p[0] << 8) | p[1];
+      p += 2;
+      if (end - p < len) {
+         return false;
+      }
+      end = p + len;
+   }
+   while (end - p >= 4) {
+      uint16_t type = (p[0] << 8) | p[1];
+      len = (p[2] << 8) | p[3];
+      p += 4;
+      if (end - p < len) {
+         return false;
+      }
+
+      if (type == TLS_EXT_SERVER_NAME && len >= 5 && p[2] == 0) {
+         /* Server name list length, name type, name length, name. */
+         int name_len = (p[3] << 8) | p[4];
+         if (name_len > len - 5) {
+            return false;
+         }
+         if (name_len >= TLS_SNI_LENGTH) {
+            name_len = TLS_SNI_LENGTH - 1;
+         }
+         memcpy(hello.sni, p + 5, name_len);
+         hello.sni[name_len] = 0;
+      } else if (type == TLS_EXT_SUPPORTED_GROUPS && len >= 2) {
+         groups_len = (p[0] << 8) | p[1];
+         groups = p + 2;
+         if (groups_len > len - 2) {
+            return false;
+         }
+      } else if (type == TLS_EXT_EC_POINT_FORMATS && len >= 1) {
+         formats_len = p[0];
+         formats = p + 1;
+         if (formats_len > len - 1) {
+            return false;
+         }
+      }
+
+      if (!is_grease(type)) {
+         ja3_append(ctx, type, first);
+      }
+      p += len;
+   }
+   md5_update(ctx, ",", 1);
+
+   first = true;
+   for (int i = 0; i + 1 < groups_len; i += 2) {
+      uint16_t group = (groups[i] << 8) | groups[i + 1];
+      if (!is_grease(group)) {
+         ja3_append(ctx, group, first);
+      }
+   }
+   md5_update(ctx, ",", 1);
+
+   first = true;
+   for (int i = 0; i < formats_len; i++) {
+      ja3_append(ctx, formats[i], first);
+   }
+
+   md5_final(ctx, hello.ja3);
+   parsed++;
+
+   DEBUG_MSG("TLS: version %u, SNI %s\n", hello.version, hello.sni);
+   return true;
+}
+
+void TLSPlugin::finish()
+{
+   if (print_stats) {
+      cout << "TLS plugin stats:" << endl;
+      cout << "   Parsed ClientHello messages: " << parsed << endl;
+      cout << "   Total inspected packets: " << total << endl;
+   }
+}
+
+string TLSPlugin::get_unirec_field_string()
+{
+   return TLS_UNIREC_TEMPLATE;
+}
+
+vector<ipfix_field_t> TLSPlugin::get_ipfix_fields(uint16_t ext_type)
+{
+   vector<ipfix_field_t> fields;
+
+   if (ext_type == tls) {
+      fields.push_back(ipfix_field_t(IPFIX_CESNET_PEN, TLS_IPFIX_VERSION, 2));
+      fields.push_back(ipfix_field_t(IPFIX_CESNET_PEN, TLS_IPFIX_SNI, IPFIX_VAR_LENGTH));
+      fields.push_back(ipfix_field_t(IPFIX_CESNET_PEN, TLS_IPFIX_JA3, TLS_JA3_LENGTH));
+   }
+
+   return fields;
+}
+
+RecordExt *TLSPlugin::deserialize_ext(uint16_t ext_type, const uint8_t *buffer, int size)
+{
+   if (ext_type != tls) {
+      return NULL;
+   }
+
+   RecordExtTLS *ext = new RecordExtTLS();
+   if (ext->deserialize(buffer, size)) {
+      return ext;
+   }
+   delete ext;
+   return NULL;
+}
@@ -0,0 +1,185 @@
+/**
+ * \file tlsplugin.h
+ * \brief Plugin for parsing TLS ClientHello messages (SNI and JA3 fingerprint).
+ * \date 2016
+ */
+/*
+ * Copyright (C) 2016 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef TLSPLUGIN_H
+#define TLSPLUGIN_H
+
+#include <string>
+#include <vector>
+
+#include "fields.h"
+#include "flowifc.h"
+#include "flowcacheplugin.h"
+#include "packet.h"
+#include "flow_meter.h"
+
+using namespace std;
+
+#define TLS_SNI_LENGTH 256      /**< Size of buffer for server name including terminating zero. */
+#define TLS_JA3_LENGTH 16       /**< Length of MD5 digest of JA3 string. */
+#define TLS_PARSE_PKT_LIMIT 3   /**< ClientHello is searched only in payload of the first packets sent by flow source. */
+
+#define TLS_IPFIX_VERSION 820
+#define TLS_IPFIX_SNI     821
+#define TLS_IPFIX_JA3     822
+
+/**
+ * \brief Parsed TLS ClientHello, plain data so it can be copied to checkpoint as a whole.
+ */
+struct tls_data_t {
+   uint16_t version;            /**< Version offered by client. */
+   char sni[TLS_SNI_LENGTH];    /**< Server name indication. */
+   uint8_t ja3[TLS_JA3_LENGTH]; /**< MD5 digest of JA3 string. */
+};
+
+/**
+ * \brief Flow record extension header for storing parsed TLS ClientHello.
+ */
+struct RecordExtTLS : RecordExt {
+   tls_data_t data;
+
+   /**
+    * \brief Constructor.
+    */
+   RecordExtTLS() : RecordExt(tls)
+   {
+      memset(&data, 0, sizeof(data));
+   }
+
+   /**
+    * \brief Constructor.
+    * \param [in] parsed Successfully parsed ClientHello.
+    */
+   RecordExtTLS(const tls_data_t &parsed) : RecordExt(tls), data(parsed)
+   {
+   }
+
+   /**
+    * \brief Get JA3 digest as hexadecimal string.
+    * \param [out] buffer Buffer of at least 2 * TLS_JA3_LENGTH + 1 bytes.
+    */
+   void ja3_hex(char *buffer) const
+   {
+      static const char digits[] = "0123456789abcdef";
+      for (int i = 0; i < TLS_JA3_LENGTH; i++) {
+         buffer[i * 2] = digits[data.ja3[i] >> 4];
+         buffer[i * 2 + 1] = digits[data.ja3[i] & 0x0F];
+      }
+      buffer[TLS_JA3_LENGTH * 2] = 0;
+   }
+
+   virtual void fillUnirec(ur_template_t *tmplt, void *record)
+   {
+      char hex[TLS_JA3_LENGTH * 2 + 1];
+
+      ja3_hex(hex);
+      ur_set(tmplt, record, F_TLS_VERSION, data.version);
+      ur_set_string(tmplt, record, F_TLS_SNI, data.sni);
+      ur_set_string(tmplt, record, F_TLS_JA3, hex);
+   }
+
+   virtual int fillIPFIX(uint8_t *buffer, int size)
+   {
+      if (size < 2 + TLS_JA3_LENGTH) {
+         return -1;
+      }
+      *(uint16_t *) buffer = htons(data.version);
+
+      int len = ipfix_fill_string(buffer + 2, size - 2 - TLS_JA3_LENGTH, data.sni);
+      if (len < 0) {
+         return -1;
+      }
+      memcpy(buffer + 2 + len, data.ja3, TLS_JA3_LENGTH);
+      return 2 + len + TLS_JA3_LENGTH;
+   }
+
+   virtual int serialize(uint8_t *buffer, int size) const
+   {
+      if (size < (int) sizeof(data)) {
+         return -1;
+      }
+      memcpy(buffer, &data, sizeof(data));
+      return sizeof(data);
+   }
+
+   /**
+    * \brief Restore extension from data written by serialize.
+    * \param [in] buffer Serialized data.
+    * \param [in] size Size of data.
+    * \return True on success, false if size does not match.
+    */
+   bool deserialize(const uint8_t *buffer, int size)
+   {
+      if (size != (int) sizeof(data)) {
+         return false;
+      }
+      memcpy(&data, buffer, sizeof(data));
+      data.sni[sizeof(data.sni) - 1] = 0;
+      return true;
+   }
+};
+
+/**
+ * \brief Flow cache plugin for parsing TLS ClientHello messages.
+ */
+class TLSPlugin : public FlowCachePlugin
+{
+public:
+   TLSPlugin(const options_t &module_options);
+   TLSPlugin(const options_t &module_options, vector<plugin_opt> plugin_options);
+   int post_create(FlowRecord &rec, const Packet &pkt);
+   int post_update(FlowRecord &rec, const Packet &pkt);
+   void finish();
+   string get_unirec_field_string();
+   vector<ipfix_field_t> get_ipfix_fields(uint16_t ext_type);
+   RecordExt *deserialize_ext(uint16_t ext_type, const uint8_t *buffer, int size);
+
+private:
+   void add_ext_tls(FlowRecord &rec, const Packet &pkt);
+   bool parse_client_hello(const uint8_t *data, int payload_len, tls_data_t &hello);
+
+   bool print_stats;    /**< Indicator whether to print stats when flow cache is finishing or not. */
+   uint32_t parsed;     /**< Total number of parsed ClientHello messages. */
+   uint32_t total;      /**< Total number of inspected packets. */
+};
+
+#endif
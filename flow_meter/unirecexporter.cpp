@@ -60,21 +60,26 @@ using namespace std;
 
 #define BASIC_FLOW_TEMPLATE "SRC_IP,DST_IP,SRC_PORT,DST_PORT,PROTOCOL,PACKETS,BYTES,TIME_FIRST,TIME_LAST,TCP_FLAGS,LINK_BIT_FIELD,DIR_BIT_FIELD,TOS,TTL"
 
+#define BIFLOW_TEMPLATE "PACKETS_REV,BYTES_REV,TCP_FLAGS_REV"
+
 #define PACKET_TEMPLATE "SRC_MAC,DST_MAC,ETHERTYPE,TIME"
 
 UR_FIELDS (
    ipaddr DST_IP,
    ipaddr SRC_IP,
    uint64 BYTES,
+   uint64 BYTES_REV,
    uint64 LINK_BIT_FIELD,
    time TIME_FIRST,
    time TIME_LAST,
    uint32 PACKETS,
+   uint32 PACKETS_REV,
    uint16 DST_PORT,
    uint16 SRC_PORT,
    uint8 DIR_BIT_FIELD,
    uint8 PROTOCOL,
    uint8 TCP_FLAGS,
+   uint8 TCP_FLAGS_REV,
    uint8 TOS,
    uint8 TTL,
 
@@ -87,7 +92,7 @@ UR_FIELDS (
 /**
  * \brief Constructor.
  */
-UnirecExporter::UnirecExporter() : out_ifc_cnt(0), tmplt(NULL), record(NULL)
+UnirecExporter::UnirecExporter() : out_ifc_cnt(0), biflow(false), tmplt(NULL), record(NULL)
 {
 }
 
@@ -96,14 +101,21 @@ UnirecExporter::UnirecExporter() : out_ifc_cnt(0), tmplt(NULL), record(NULL)
  * \param [in] plugins Active plugins.
  * \param [in] ifc_cnt Output interface count.
  * \param [in] basic_ifc_num Basic output interface number.
+ * \param [in] biflow_mode Export reverse direction counters of biflows.
  * \return 0 on success or negative value when error occur.
  */
-int UnirecExporter::init(const vector<FlowCachePlugin *> &plugins, int ifc_cnt, int basic_ifc_number)
+int UnirecExporter::init(const vector<FlowCachePlugin *> &plugins, int ifc_cnt, int basic_ifc_number, bool biflow_mode)
 {
    out_ifc_cnt = ifc_cnt;
    basic_ifc_num = basic_ifc_number;
+   biflow = biflow_mode;
    ifc_mapping.clear();
 
+   string basic_template = BASIC_FLOW_TEMPLATE;
+   if (biflow) {
+      basic_template += string(",") + BIFLOW_TEMPLATE;
+   }
+
    tmplt = new ur_template_t*[out_ifc_cnt];
    record = new void*[out_ifc_cnt];
 
@@ -114,7 +126,7 @@ int UnirecExporter::init(const vector<FlowCachePlugin *> &plugins, int ifc_cnt,
 
    char *error = NULL;
    if (basic_ifc_num >= 0) {
-      tmplt[basic_ifc_num] = ur_create_output_template(basic_ifc_num, BASIC_FLOW_TEMPLATE, &error);
+      tmplt[basic_ifc_num] = ur_create_output_template(basic_ifc_num, basic_template.c_str(), &error);
       if (tmplt[basic_ifc_num] == NULL) {
          fprintf(stderr, "UnirecExporter: %s\n", error);
          free(error);
@@ -141,7 +153,7 @@ int UnirecExporter::init(const vector<FlowCachePlugin *> &plugins, int ifc_cnt,
       // Create unirec templates.
       template_str = tmp->get_unirec_field_string();
       if (tmp->include_basic_flow_fields()) {
-         template_str += string(",") + BASIC_FLOW_TEMPLATE;
+         template_str += string(",") + basic_template;
       } else {
          template_str += string (",") + PACKET_TEMPLATE;
       }
@@ -310,8 +322,6 @@ int UnirecExporter::export_flow(FlowRecord &flow)
  */
 void UnirecExporter::fill_basic_flow(FlowRecord &flow, ur_template_t *tmplt_ptr, void *record_ptr)
 {
-   ur_time_t tmp_time;
-
    if (flow.ip_version == 4) {
       ur_set(tmplt_ptr, record_ptr, F_SRC_IP, ip_from_4_bytes_be((char *) &flow.src_ip.v4));
       ur_set(tmplt_ptr, record_ptr, F_DST_IP, ip_from_4_bytes_be((char *) &flow.dst_ip.v4));
@@ -320,11 +330,8 @@ void UnirecExporter::fill_basic_flow(FlowRecord &flow, ur_template_t *tmplt_ptr,
       ur_set(tmplt_ptr, record_ptr, F_DST_IP, ip_from_16_bytes_be((char *) flow.dst_ip.v6));
    }
 
-   tmp_time = ur_time_from_sec_msec(flow.start_timestamp.tv_sec, flow.start_timestamp.tv_usec / 1000.0);
-   ur_set(tmplt_ptr, record_ptr, F_TIME_FIRST, tmp_time);
-
-   tmp_time = ur_time_from_sec_msec(flow.end_timestamp.tv_sec, flow.end_timestamp.tv_usec / 1000.0);
-   ur_set(tmplt_ptr, record_ptr, F_TIME_LAST, tmp_time);
+   ur_set(tmplt_ptr, record_ptr, F_TIME_FIRST, timestamp_to_ur_time(flow.start_timestamp));
+   ur_set(tmplt_ptr, record_ptr, F_TIME_LAST, timestamp_to_ur_time(flow.end_timestamp));
 
    ur_set(tmplt_ptr, record_ptr, F_PROTOCOL, flow.ip_proto);
    ur_set(tmplt_ptr, record_ptr, F_SRC_PORT, flow.src_port);
@@ -335,6 +342,12 @@ void UnirecExporter::fill_basic_flow(FlowRecord &flow, ur_template_t *tmplt_ptr,
    ur_set(tmplt_ptr, record_ptr, F_TOS, flow.ip_tos);
    ur_set(tmplt_ptr, record_ptr, F_TTL, flow.ip_ttl);
 
+   if (biflow) {
+      ur_set(tmplt_ptr, record_ptr, F_PACKETS_REV, flow.dst_pkt_total_cnt);
+      ur_set(tmplt_ptr, record_ptr, F_BYTES_REV, flow.dst_octet_total_length);
+      ur_set(tmplt_ptr, record_ptr, F_TCP_FLAGS_REV, flow.dst_tcp_control_bits);
+   }
+
    //ur_set(tmplt_ptr, record_ptr, F_DIR_BIT_FIELD, 0);
    //ur_set(tmplt_ptr, record_ptr, F_LINK_BIT_FIELD, 0);
 }
@@ -348,11 +361,9 @@ void UnirecExporter::fill_basic_flow(FlowRecord &flow, ur_template_t *tmplt_ptr,
  */
 void UnirecExporter::fill_packet_fields(Packet &pkt, ur_template_t *tmplt_ptr, void *record_ptr)
 {
-   ur_time_t tmp_time = ur_time_from_sec_msec(pkt.timestamp.tv_sec, pkt.timestamp.tv_usec / 1000.0);
-
    ur_set_var(tmplt_ptr, record_ptr, F_DST_MAC, pkt.packet, 6);
    ur_set_var(tmplt_ptr, record_ptr, F_SRC_MAC, pkt.packet + 6, 6);
    ur_set(tmplt_ptr, record_ptr, F_ETHERTYPE, pkt.ethertype);
-   ur_set(tmplt_ptr, record_ptr, F_TIME, tmp_time);
+   ur_set(tmplt_ptr, record_ptr, F_TIME, timestamp_to_ur_time(pkt.timestamp));
 }
 
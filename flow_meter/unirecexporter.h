@@ -66,7 +66,7 @@ class UnirecExporter : public FlowExporter
 {
 public:
    UnirecExporter();
-   int init(const vector<FlowCachePlugin *> &plugins, int ifc_cnt, int basic_ifc_num);
+   int init(const vector<FlowCachePlugin *> &plugins, int ifc_cnt, int basic_ifc_num, bool biflow_mode);
    void close();
    int export_flow(FlowRecord &flow);
    int export_packet(Packet &pkt);
@@ -78,6 +78,7 @@ private:
 
    int out_ifc_cnt;           /**< Number of output interfaces. */
    int basic_ifc_num;         /**< Basic output interface number. */
+   bool biflow;               /**< Export reverse direction counters. */
    map<int, int> ifc_mapping; /**< Contain extension id -> output interface number mapping. */
    ur_template_t **tmplt;     /**< Pointer to unirec templates. */
    void **record;             /**< Pointer to unirec records. */
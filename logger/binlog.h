@@ -0,0 +1,85 @@
+/**
+ * \file binlog.h
+ * \brief Format of binary output of logger (read by logreplay).
+ * \date 2016
+ */
+/*
+ * Copyright (C) 2016 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include <stdint.h>
+
+/*
+ * Binary log is a dump of UniRec records as they were received, so it can be replayed without
+ * any parsing. File starts with binlog_file_hdr_t and it is followed by blocks. Every block holds
+ * entries of one input interface - binlog_block_hdr_t is followed by size bytes of entries,
+ * compressed by LZ4 when size differs from raw_size. Entry is binlog_entry_hdr_t followed by len
+ * bytes of UniRec record or of UniRec data format specifier of the interface (without terminating
+ * zero). Every block starts with format entry, so blocks (and rotated files) can be read independently.
+ * All numbers are stored in host byte order.
+ */
+
+#define BINLOG_MAGIC       "URBINLOG" // First 8 bytes of file
+#define BINLOG_MAGIC_LEN   8
+#define BINLOG_VERSION     1
+
+#define BINLOG_FLAG_LZ4    0x1 // Blocks may be compressed
+
+#define BINLOG_ENTRY_RECORD 1
+#define BINLOG_ENTRY_FORMAT 2
+
+typedef struct binlog_file_hdr_s {
+   char magic[BINLOG_MAGIC_LEN];
+   uint32_t version;
+   uint32_t flags;
+} binlog_file_hdr_t;
+
+typedef struct binlog_block_hdr_s {
+   uint32_t size;        // Size of block in file (without header)
+   uint32_t raw_size;    // Size of uncompressed entries
+   uint32_t ifc;         // Input interface of logger
+   uint32_t records;     // Number of records in block
+} binlog_block_hdr_t;
+
+typedef struct binlog_entry_hdr_s {
+   uint16_t type;        // BINLOG_ENTRY_RECORD or BINLOG_ENTRY_FORMAT
+   uint16_t len;         // Size of data following the header
+} binlog_entry_hdr_t;
+
+#endif
@@ -60,6 +60,12 @@
 #include <unirec/unirec.h>
 #include <omp.h>
 #include <ctype.h>
+#include <string.h>
+#include <limits.h>
+#ifdef HAVE_LIBLZ4
+#include <lz4.h>
+#endif
+#include "binlog.h"
 #include "fields.h"
 
 UR_FIELDS()
@@ -73,6 +79,11 @@ trap_module_info_t *module_info = NULL;
 #define MODULE_PARAMS(PARAM) \
   PARAM('w', "write", "Write output to FILE instead of stdout (rewrite the file).", required_argument, "string") \
   PARAM('a', "append", "Write output to FILE instead of stdout (append to the end).", required_argument, "string") \
+  PARAM('s', "split", "Write records of each interface into separate file FILE.N, where N is the number of the interface (requires -w or -a).", no_argument, "none") \
+  PARAM('b', "binary", "Write binary log - UniRec records as they were received, which can be replayed by logreplay without parsing.", no_argument, "none") \
+  PARAM('z', "compress", "Write binary log compressed by LZ4 (implies -b).", no_argument, "none") \
+  PARAM('r', "rotate_size", "Start new output file when the current one reaches SIZE MB, time of creation is appended to file names (requires -w or -a).", required_argument, "uint32") \
+  PARAM('R', "rotate_time", "Start new output file every SEC seconds, time of creation is appended to file names (requires -w or -a).", required_argument, "uint32") \
   PARAM('o', "output_fields", "Set of fields included in the output (UniRec data format example:\"uint32 FOO,time BAR\")", required_argument, "string") \
   PARAM('t', "title", "Write names of fields on the first line.", no_argument, "none") \
   PARAM('T', "time", "Add the time when the record was received as the first field.", no_argument, "none") \
@@ -118,15 +129,574 @@ unsigned int max_num_records = 0; // Exit after this number of records is receiv
 char enabled_max_num_records = 0; // Limit of message is set when non-zero
 
 
-static FILE *file; // Output file
+/**
+ * Output file, it may be rotated.
+ */
+typedef struct output_s {
+   FILE *f;              // Current output file
+   const char *name;     // Name of output file (without suffix of rotated file), NULL for stdout
+   uint64_t size;        // Number of bytes written into current file
+   time_t opened;        // Time when current file was opened
+   time_t name_time;     // Time in name of current file (rotation)
+   int name_cnt;         // Number of files created within name_time (rotation)
+} output_t;
+
+/**
+ * Output buffer of input thread.
+ */
+typedef struct writer_s {
+   output_t *out;        // Output file
+   int index;            // Index of input interface
+   char *buffer;         // Output buffer (block with header space in binary mode)
+   size_t len;           // Length of data in buffer
+   uint32_t records;     // Number of records in buffer
+   char *cbuffer;        // Buffer for compressed block
+   char *spec;           // Data format of input interface (binary mode)
+} writer_t;
+
+static output_t output; // Output shared by all interfaces
+static output_t *ifc_outputs = NULL; // Output of each interface (-s), NULL when all interfaces share one output
+static char *title_line = NULL; // Header of CSV output written at the beginning of each file
+static int append = 0; // Append to existing output file
+static int binary = 0; // Write binary log instead of CSV
+static int compress = 0; // Compress blocks of binary log
+static uint64_t rotate_size = 0; // Start new output file when it reaches this size (0 = never)
+static time_t rotate_interval = 0; // Start new output file after this interval (0 = never)
+
+#define OUTPUT_BUFFER_SIZE (1024 * 1024) // Size of output buffer of each thread
+#define FLUSH_TIMEOUT      500000 // Output buffer is written when no data arrive within this timeout (in microseconds)
+#define MAX_PREFIX_LEN     64 // Maximal length of receive time and interface number written before fields
 
 TRAP_DEFAULT_SIGNAL_HANDLER(stop = 1);
 
+struct formatter_s;
+struct field_op_s;
+
+/**
+ * Function writing one field of record into output buffer.
+ *
+ * @param [out] out Output buffer.
+ * @param [in,out] fmt Formatter of the record.
+ * @param [in] op Field to write.
+ * @param [in] rec Record.
+ * @return Pointer behind the written text.
+ */
+typedef char *(*format_field_t)(char *out, struct formatter_s *fmt, const struct field_op_s *op, const void *rec);
+
+/**
+ * Output field compiled for one input template.
+ */
+typedef struct field_op_s {
+   format_field_t format; // Formatter of the field type, NULL if field is not present in input
+   ur_field_id_t id;      // Field ID
+   uint16_t offset;       // Offset of static field in input record
+} field_op_t;
+
+/**
+ * Formatter of records of one input - output fields compiled for input template.
+ */
+typedef struct formatter_s {
+   field_op_t *ops;       // Output fields in output order
+   int count;             // Number of output fields
+   size_t max_static_len; // Maximal length of line without contents of dynamic fields
+   const ur_template_t *tmplt; // Input template
+   char delimiter;
+   time_t cached_sec;     // Second of cached_time
+   char cached_time[32];  // Formatted date and time of cached_sec
+} formatter_t;
+
+static const char hex_digits[] = "0123456789abcdef";
+
+/**
+ * Write unsigned integer in decimal.
+ */
+static inline char *write_uint(char *out, uint64_t val)
+{
+   char tmp[20];
+   int len = 0;
+
+   do {
+      tmp[len++] = '0' + val % 10;
+      val /= 10;
+   } while (val != 0);
+   while (len > 0) {
+      *out++ = tmp[--len];
+   }
+   return out;
+}
+
+/**
+ * Write signed integer in decimal.
+ */
+static inline char *write_int(char *out, int64_t val)
+{
+   if (val < 0) {
+      *out++ = '-';
+      return write_uint(out, -(uint64_t) val);
+   }
+   return write_uint(out, val);
+}
+
+/**
+ * Write date and time in format YYYY-MM-DDTHH:MM:SS (UTC), the last formatted second is cached.
+ */
+static inline char *write_datetime(char *out, formatter_t *fmt, time_t sec)
+{
+   if (sec != fmt->cached_sec) {
+      struct tm tm;
+      gmtime_r(&sec, &tm);
+      strftime(fmt->cached_time, sizeof(fmt->cached_time), "%FT%T", &tm);
+      fmt->cached_sec = sec;
+   }
+   for (const char *p = fmt->cached_time; *p != 0; p++) {
+      *out++ = *p;
+   }
+   return out;
+}
+
+#define FIELD_PTR(type, op, rec) ((const type *) ((const char *) (rec) + (op)->offset))
+
+#define INT_FORMATTER(name, type, write) \
+static char *name(char *out, formatter_t *fmt, const field_op_t *op, const void *rec) \
+{ \
+   return write(out, *FIELD_PTR(type, op, rec)); \
+}
+
+INT_FORMATTER(format_uint8, uint8_t, write_uint)
+INT_FORMATTER(format_uint16, uint16_t, write_uint)
+INT_FORMATTER(format_uint32, uint32_t, write_uint)
+INT_FORMATTER(format_uint64, uint64_t, write_uint)
+INT_FORMATTER(format_int8, int8_t, write_int)
+INT_FORMATTER(format_int16, int16_t, write_int)
+INT_FORMATTER(format_int32, int32_t, write_int)
+INT_FORMATTER(format_int64, int64_t, write_int)
+
+static char *format_char(char *out, formatter_t *fmt, const field_op_t *op, const void *rec)
+{
+   *out++ = *FIELD_PTR(char, op, rec);
+   return out;
+}
+
+static char *format_float(char *out, formatter_t *fmt, const field_op_t *op, const void *rec)
+{
+   return out + sprintf(out, "%f", *FIELD_PTR(float, op, rec));
+}
+
+static char *format_double(char *out, formatter_t *fmt, const field_op_t *op, const void *rec)
+{
+   return out + sprintf(out, "%f", *FIELD_PTR(double, op, rec));
+}
+
+static char *format_ip(char *out, formatter_t *fmt, const field_op_t *op, const void *rec)
+{
+   const ip_addr_t *ip = FIELD_PTR(ip_addr_t, op, rec);
+
+   if (ip_is4(ip)) {
+      const uint8_t *bytes = (const uint8_t *) ip_get_v4_as_bytes(ip);
+      for (int i = 0; i < 4; i++) {
+         if (i != 0) {
+            *out++ = '.';
+         }
+         out = write_uint(out, bytes[i]);
+      }
+      return out;
+   }
+   ip_to_str(ip, out);
+   return out + strlen(out);
+}
+
+static char *format_time(char *out, formatter_t *fmt, const field_op_t *op, const void *rec)
+{
+   ur_time_t time = *FIELD_PTR(ur_time_t, op, rec);
+   int msec = ur_time_get_msec(time);
+
+   out = write_datetime(out, fmt, ur_time_get_sec(time));
+   *out++ = '.';
+   *out++ = '0' + msec / 100;
+   *out++ = '0' + msec / 10 % 10;
+   *out++ = '0' + msec % 10;
+   return out;
+}
+
+static char *format_string(char *out, formatter_t *fmt, const field_op_t *op, const void *rec)
+{
+   // Printable string - print it as it is
+   int size = ur_get_var_len(fmt->tmplt, rec, op->id);
+   const char *data = ur_get_ptr_by_id(fmt->tmplt, rec, op->id);
+
+   *out++ = '"';
+   while (size--) {
+      switch (*data) {
+         case '\n': // Replace newline with space
+                    *out++ = ' ';
+                    break;
+         case '"' : // Double quotes in string
+                    *out++ = '"';
+                    *out++ = '"';
+                    break;
+         default  : // Check if character is printable
+                    if (isprint((unsigned char) *data)) {
+                       *out++ = *data;
+                    }
+      }
+      data++;
+   }
+   *out++ = '"';
+   return out;
+}
+
+static char *format_bytes(char *out, formatter_t *fmt, const field_op_t *op, const void *rec)
+{
+   // Generic string of bytes - print each byte as two hex digits
+   int size = ur_get_var_len(fmt->tmplt, rec, op->id);
+   const unsigned char *data = ur_get_ptr_by_id(fmt->tmplt, rec, op->id);
+
+   while (size--) {
+      *out++ = hex_digits[*data >> 4];
+      *out++ = hex_digits[*data & 0x0f];
+      data++;
+   }
+   return out;
+}
+
+static char *format_unknown(char *out, formatter_t *fmt, const field_op_t *op, const void *rec)
+{
+   // Unknown type - print the value in hex
+   int size = ur_get_len(fmt->tmplt, rec, op->id);
+   const unsigned char *data = ur_get_ptr_by_id(fmt->tmplt, rec, op->id);
+
+   *out++ = '0';
+   *out++ = 'x';
+   while (size--) {
+      *out++ = hex_digits[*data >> 4];
+      *out++ = hex_digits[*data & 0x0f];
+      data++;
+   }
+   return out;
+}
+
+/**
+ * Compile output fields for input template: select formatter of each field by its type
+ * and resolve offsets of static fields.
+ *
+ * @param [in,out] fmt Formatter.
+ * @param [in] tmplt Input template.
+ * @return 0 on success, -1 on allocation error.
+ */
+static int compile_formatter(formatter_t *fmt, const ur_template_t *tmplt)
+{
+   int i = 0, n = 0;
+   ur_field_id_t id;
+
+   while (ur_iter_fields_record_order(out_template, n) != UR_ITER_END) {
+      n++;
+   }
+   field_op_t *ops = (field_op_t *) realloc(fmt->ops, (n + 1) * sizeof(field_op_t));
+   if (ops == NULL) {
+      fprintf(stderr, "Memory allocation error\n");
+      return -1;
+   }
+   fmt->ops = ops;
+   fmt->count = n;
+   fmt->tmplt = tmplt;
+   fmt->max_static_len = MAX_PREFIX_LEN + n + 1; // Delimiters and end of line
+
+   while ((id = ur_iter_fields_record_order(out_template, i)) != UR_ITER_END) {
+      field_op_t *op = &ops[i++];
+      size_t len = 0;
+
+      op->id = id;
+      op->format = NULL;
+      if (!ur_is_present(tmplt, id)) {
+         continue;
+      }
+      if (ur_is_static(id)) {
+         op->offset = tmplt->offset[id];
+      }
+      switch (ur_get_type(id)) {
+         case UR_TYPE_UINT8:  op->format = format_uint8;  len = 3; break;
+         case UR_TYPE_UINT16: op->format = format_uint16; len = 5; break;
+         case UR_TYPE_UINT32: op->format = format_uint32; len = 10; break;
+         case UR_TYPE_UINT64: op->format = format_uint64; len = 20; break;
+         case UR_TYPE_INT8:   op->format = format_int8;   len = 4; break;
+         case UR_TYPE_INT16:  op->format = format_int16;  len = 6; break;
+         case UR_TYPE_INT32:  op->format = format_int32;  len = 11; break;
+         case UR_TYPE_INT64:  op->format = format_int64;  len = 20; break;
+         case UR_TYPE_CHAR:   op->format = format_char;   len = 1; break;
+         case UR_TYPE_FLOAT:  op->format = format_float;  len = 48; break;
+         case UR_TYPE_DOUBLE: op->format = format_double; len = 320; break;
+         case UR_TYPE_IP:     op->format = format_ip;     len = 46; break;
+         case UR_TYPE_TIME:   op->format = format_time;   len = sizeof(fmt->cached_time) + 4; break;
+         case UR_TYPE_STRING: op->format = format_string; len = 2; break; // Contents are bounded by record size
+         case UR_TYPE_BYTES:  op->format = format_bytes;  len = 0; break;
+         default:             op->format = format_unknown; len = 2; break;
+      }
+      fmt->max_static_len += len;
+   }
+   return 0;
+}
+
+/**
+ * Write record as one line into output buffer using compiled formatter.
+ *
+ * @param [out] out Output buffer, it must have at least max_static_len + 2 * rec_size bytes free.
+ * @param [in,out] fmt Formatter.
+ * @param [in] rec Record.
+ * @param [in] index Index of input interface.
+ * @return Pointer behind the written line.
+ */
+static char *format_record(char *out, formatter_t *fmt, const void *rec, int index)
+{
+   if (print_time) {
+      out = write_datetime(out, fmt, time(NULL));
+      *out++ = ',';
+   }
+   if (print_ifc_num) {
+      out = write_int(out, index);
+      *out++ = ',';
+   }
+   for (int i = 0; i < fmt->count; i++) {
+      if (i != 0) {
+         *out++ = fmt->delimiter;
+      }
+      if (fmt->ops[i].format != NULL) {
+         out = fmt->ops[i].format(out, fmt, &fmt->ops[i], rec);
+      }
+   }
+   *out++ = '\n';
+   return out;
+}
+
+/**
+ * Open output file. When rotation is enabled, time of opening is appended to file name.
+ *
+ * @param [in,out] o Output.
+ * @return 0 on success, -1 on error.
+ */
+static int open_output(output_t *o)
+{
+   char name[PATH_MAX];
+   time_t now = time(NULL);
+
+   o->size = 0;
+   o->opened = now;
+   if (o->name == NULL) {
+      o->f = stdout;
+   } else {
+      if (rotate_size != 0 || rotate_interval != 0) {
+         char suffix[32];
+         struct tm tm;
+         strftime(suffix, sizeof(suffix), "%Y%m%d%H%M%S", gmtime_r(&now, &tm));
+         if (now == o->name_time) {
+            // More files within one second
+            snprintf(name, sizeof(name), "%s.%s_%i", o->name, suffix, ++o->name_cnt);
+         } else {
+            snprintf(name, sizeof(name), "%s.%s", o->name, suffix);
+            o->name_time = now;
+            o->name_cnt = 0;
+         }
+      } else {
+         snprintf(name, sizeof(name), "%s", o->name);
+      }
+      if (verbose >= 0) {
+         printf("Creating output file \"%s\" ...\n", name);
+      }
+      // Appended file is also read to check header of existing binary log
+      o->f = fopen(name, (append ? "a+" : "w"));
+      if (o->f == NULL) {
+         perror("Error: can't open output file:");
+         return -1;
+      }
+      if (append && fseek(o->f, 0, SEEK_END) == 0) {
+         o->size = ftell(o->f);
+      }
+   }
+
+   if (binary && o->size > 0) {
+      // Blocks are appended after header of existing log, which must be compatible
+      binlog_file_hdr_t hdr;
+      rewind(o->f);
+      if (fread(&hdr, sizeof(hdr), 1, o->f) != 1 || memcmp(hdr.magic, BINLOG_MAGIC, BINLOG_MAGIC_LEN) != 0 ||
+          hdr.version != BINLOG_VERSION || (compress && !(hdr.flags & BINLOG_FLAG_LZ4))) {
+         fprintf(stderr, "Error: Output file \"%s\" is not a binary log of the same format, can't append to it.\n", name);
+         fclose(o->f);
+         o->f = NULL;
+         return -1;
+      }
+      fseek(o->f, 0, SEEK_END);
+   } else if (binary) {
+      binlog_file_hdr_t hdr;
+      memcpy(hdr.magic, BINLOG_MAGIC, BINLOG_MAGIC_LEN);
+      hdr.version = BINLOG_VERSION;
+      hdr.flags = (compress ? BINLOG_FLAG_LZ4 : 0);
+      fwrite(&hdr, sizeof(hdr), 1, o->f);
+      o->size += sizeof(hdr);
+   } else if (title_line != NULL) {
+      // New file of rotated output
+      fputs(title_line, o->f);
+      o->size += strlen(title_line);
+   }
+   return 0;
+}
+
+/**
+ * Write data into output file, the file is rotated before the data when it is full or old enough.
+ * Caller must hold the output lock when the output is shared.
+ *
+ * @param [in,out] o Output.
+ * @param [in] data Data to write.
+ * @param [in] len Length of data.
+ */
+static void write_output(output_t *o, const char *data, size_t len)
+{
+   if (o->f == NULL) {
+      return;
+   }
+   if (o->size > 0 && ((rotate_size != 0 && o->size + len > rotate_size) ||
+                       (rotate_interval != 0 && time(NULL) - o->opened >= rotate_interval))) {
+      fclose(o->f);
+      if (open_output(o) != 0) {
+         o->f = NULL;
+         stop = 1;
+         return;
+      }
+   }
+   fwrite(data, 1, len, o->f);
+   fflush(o->f);
+   o->size += len;
+}
+
+/**
+ * Append entry to binary block in output buffer, caller ensures free space.
+ */
+static void append_entry(writer_t *w, uint16_t type, const void *data, uint16_t len)
+{
+   binlog_entry_hdr_t hdr;
+
+   hdr.type = type;
+   hdr.len = len;
+   memcpy(w->buffer + w->len, &hdr, sizeof(hdr));
+   memcpy(w->buffer + w->len + sizeof(hdr), data, len);
+   w->len += sizeof(hdr) + len;
+}
+
+/**
+ * Start new (empty) output buffer. Binary block starts with data format of the interface.
+ */
+static void begin_block(writer_t *w)
+{
+   w->len = 0;
+   w->records = 0;
+   if (binary) {
+      w->len = sizeof(binlog_block_hdr_t);
+      if (w->spec != NULL) {
+         append_entry(w, BINLOG_ENTRY_FORMAT, w->spec, strlen(w->spec));
+      }
+   }
+}
+
+/**
+ * Write contents of output buffer into output file. Buffers of all threads are appended to
+ * the shared output file as a whole, so lines of different interfaces are never mixed.
+ * Binary block is compressed before that, outside of the lock.
+ *
+ * @param [in,out] w Writer of the thread, its buffer is emptied.
+ */
+static void write_buffer(writer_t *w)
+{
+   const char *data = w->buffer;
+   size_t len = w->len;
+
+   if (w->records == 0) {
+      begin_block(w);
+      return;
+   }
+   if (binary) {
+      binlog_block_hdr_t hdr;
+      hdr.raw_size = w->len - sizeof(hdr);
+      hdr.size = hdr.raw_size;
+      hdr.ifc = w->index;
+      hdr.records = w->records;
+#ifdef HAVE_LIBLZ4
+      if (compress) {
+         int size = LZ4_compress_default(w->buffer + sizeof(hdr), w->cbuffer + sizeof(hdr), hdr.raw_size,
+                                         LZ4_compressBound(OUTPUT_BUFFER_SIZE));
+         if (size > 0 && (uint32_t) size < hdr.raw_size) {
+            hdr.size = size;
+            data = w->cbuffer;
+         }
+      }
+#endif
+      memcpy((char *) data, &hdr, sizeof(hdr));
+      len = sizeof(hdr) + hdr.size;
+   }
+
+   if (ifc_outputs != NULL) {
+      // Output file is not shared
+      write_output(w->out, data, len);
+   } else {
+      #pragma omp critical (output)
+      {
+         write_output(w->out, data, len);
+      }
+   }
+   begin_block(w);
+}
+
+/**
+ * Create header of CSV output - names of output UniRec fields.
+ *
+ * @param [in] delimiter Delimiter of fields.
+ * @return Header line or NULL on allocation error.
+ */
+static char *create_title(char delimiter)
+{
+   char *data_format = ur_template_string_delimiter(out_template, delimiter);
+   char *title;
+
+   if (data_format == NULL) {
+      fprintf(stderr, "Memory allocation error\n");
+      return NULL;
+   }
+   title = (char *) malloc(strlen(data_format) + 16);
+   if (title == NULL) {
+      fprintf(stderr, "Memory allocation error\n");
+   } else {
+      sprintf(title, "%s%s%s\n", (print_time ? "time," : ""), (print_ifc_num ? "ifc," : ""), data_format);
+   }
+   free(data_format);
+   return title;
+}
+
 void capture_thread(int index, char delimiter)
 {
    int fail = 0;
    int ret;
    uint8_t data_fmt = TRAP_FMT_UNKNOWN;
+   int ifc_title = (ifc_outputs != NULL); // Title of own output file is not written yet (if enabled)
+   formatter_t fmt;
+   writer_t w;
+
+   memset(&fmt, 0, sizeof(fmt));
+   fmt.delimiter = delimiter;
+   fmt.cached_sec = -1;
+   memset(&w, 0, sizeof(w));
+   w.out = (ifc_outputs != NULL ? &ifc_outputs[index] : &output);
+   w.index = index;
+   w.buffer = (char *) malloc(OUTPUT_BUFFER_SIZE);
+#ifdef HAVE_LIBLZ4
+   if (compress) {
+      w.cbuffer = (char *) malloc(sizeof(binlog_block_hdr_t) + LZ4_compressBound(OUTPUT_BUFFER_SIZE));
+   }
+#endif
+   if (w.buffer == NULL || (compress && w.cbuffer == NULL)) {
+      fprintf(stderr, "Memory allocation error\n");
+      free(w.buffer);
+      free(w.cbuffer);
+      stop = 1;
+      return;
+   }
+   begin_block(&w);
 
    if (verbose >= 1) {
       printf("Thread %i started.\n", index);
@@ -154,43 +724,57 @@ void capture_thread(int index, char delimiter)
                fprintf(stderr, "Error: Template could not be created.\n");
                break;
             }
-            #pragma omp critical
-            {
-               if (out_template_defined == 0) { // Check whether it is first thread trying to define output ifc template
-                  out_template = ur_define_fields_and_update_template(spec, out_template);
-                  if (out_template == NULL) {
-                    fprintf(stderr, "Error: Output interface template couldn't be created.\n");
-                    fflush(stderr);
-                    fail = 1;
-                  } else {
-                     out_template_defined = 1;
-                  }
+            if (binary) {
+               // Records are stored as received, only data format is logged
+               free(w.spec);
+               w.spec = strdup(spec);
+               if (w.spec == NULL) {
+                  fprintf(stderr, "Memory allocation error\n");
+                  break;
                }
-
-               if (print_title == 1 && out_template_defined == 1) {
-                  print_title = 0;
-                  // Print a header - names of output UniRec fields
-                  if (print_time) {
-                     fprintf(file, "time,");
-                  }
-                  if (print_ifc_num) {
-                     fprintf(file, "ifc,");
+               if (OUTPUT_BUFFER_SIZE - w.len < sizeof(binlog_entry_hdr_t) + strlen(spec)) {
+                  write_buffer(&w);
+               }
+               append_entry(&w, BINLOG_ENTRY_FORMAT, w.spec, strlen(w.spec));
+            } else {
+               #pragma omp critical
+               {
+                  if (out_template_defined == 0) { // Check whether it is first thread trying to define output ifc template
+                     out_template = ur_define_fields_and_update_template(spec, out_template);
+                     if (out_template == NULL) {
+                       fprintf(stderr, "Error: Output interface template couldn't be created.\n");
+                       fflush(stderr);
+                       fail = 1;
+                     } else {
+                        out_template_defined = 1;
+                     }
                   }
-                  char *data_format = ur_template_string_delimiter(out_template, delimiter);
-                  if (data_format == NULL) {
-                     fprintf(stderr, "Memory allocation error\n");
-                     fail = 1;
-                  } else {
-                     fprintf(file, "%s\n", data_format);
-                     free(data_format);
-                     fflush(file);
+
+                  if (print_title == 1 && out_template_defined == 1) {
+                     print_title = 0;
+                     title_line = create_title(delimiter);
+                     if (title_line == NULL) {
+                        fail = 1;
+                     } else if (ifc_outputs == NULL) {
+                        #pragma omp critical (output)
+                        {
+                           write_output(&output, title_line, strlen(title_line));
+                        }
+                     }
                   }
+               } // End of critical section
+               if (fail == 0 && ifc_title && title_line != NULL) {
+                  ifc_title = 0;
+                  write_output(w.out, title_line, strlen(title_line));
+               }
+               if (fail == 1 || compile_formatter(&fmt, templates[index]) != 0) {
+                  break;
                }
-            } // End of critical section
-            if (fail == 1) {
-               break;
             }
          }
+      } else if (ret == TRAP_E_TIMEOUT) {
+         write_buffer(&w);
+         continue;
       } else {
         TRAP_DEFAULT_RECV_ERROR_HANDLING(ret, continue, break);
       }
@@ -213,145 +797,40 @@ void capture_thread(int index, char delimiter)
          }
       }
 
-      // Print contents of received UniRec to output
-      #pragma omp critical
-      {
-         if (print_time) {
-            char str[32];
-            time_t ts = time(NULL);
-            strftime(str, 31, "%FT%T", gmtime(&ts));
-            fprintf(file, "%s,", str);
+      // Count the record, records over the limit are not written
+      unsigned int cnt = __atomic_add_fetch(&num_records, 1, __ATOMIC_RELAXED);
+      if (max_num_records && cnt > max_num_records) {
+         break;
+      }
+
+      // Write contents of received UniRec into output buffer of the thread
+      if (binary) {
+         if (OUTPUT_BUFFER_SIZE - w.len < sizeof(binlog_entry_hdr_t) + rec_size) {
+            write_buffer(&w);
          }
-         if (print_ifc_num) {
-            fprintf(file,"%i,", index);
+         append_entry(&w, BINLOG_ENTRY_RECORD, rec, rec_size);
+      } else {
+         if (OUTPUT_BUFFER_SIZE - w.len < fmt.max_static_len + 2 * (size_t) rec_size) {
+            write_buffer(&w);
          }
-         // Iterate over all output fields
-         int delim = 0;
-         int i = 0;
-         ur_field_id_t id = 0;
-         while ((id = ur_iter_fields_record_order(out_template, i++)) != UR_ITER_END) {
-            if (delim != 0) {
-               fprintf(file,"%c", delimiter);
-            }
-            delim = 1;
-            if (ur_is_present(templates[index], id)) {
-               // Get pointer to the field (valid for static fields only)
-               void *ptr = ur_get_ptr_by_id(templates[index], rec, id);
-                  // Static field - check what type is it and use appropriate format
-               switch (ur_get_type(id)) {
-                  case UR_TYPE_UINT8:
-                     fprintf(file, "%u", *(uint8_t*)ptr);
-                     break;
-                  case UR_TYPE_UINT16:
-                     fprintf(file, "%u", *(uint16_t*)ptr);
-                     break;
-                  case UR_TYPE_UINT32:
-                     fprintf(file, "%u", *(uint32_t*)ptr);
-                     break;
-                  case UR_TYPE_UINT64:
-                     fprintf(file, "%lu", *(uint64_t*)ptr);
-                     break;
-                  case UR_TYPE_INT8:
-                     fprintf(file, "%i", *(int8_t*)ptr);
-                     break;
-                  case UR_TYPE_INT16:
-                     fprintf(file, "%i", *(int16_t*)ptr);
-                     break;
-                  case UR_TYPE_INT32:
-                     fprintf(file, "%i", *(int32_t*)ptr);
-                     break;
-                  case UR_TYPE_INT64:
-                     fprintf(file, "%li", *(int64_t*)ptr);
-                     break;
-                  case UR_TYPE_CHAR:
-                     fprintf(file, "%c", *(char*)ptr);
-                     break;
-                  case UR_TYPE_FLOAT:
-                     fprintf(file, "%f", *(float*)ptr);
-                     break;
-                  case UR_TYPE_DOUBLE:
-                     fprintf(file, "%f", *(double*)ptr);
-                     break;
-                  case UR_TYPE_IP:
-                     {
-                        // IP address - convert to human-readable format and print
-                        char str[46];
-                        ip_to_str((ip_addr_t*)ptr, str);
-                        fprintf(file, "%s", str);
-                     }
-                     break;
-                  case UR_TYPE_TIME:
-                     {
-                        // Timestamp - convert to human-readable format and print
-                        time_t sec = ur_time_get_sec(*(ur_time_t*)ptr);
-                        int msec = ur_time_get_msec(*(ur_time_t*)ptr);
-                        char str[32];
-                        strftime(str, 31, "%FT%T", gmtime(&sec));
-                        fprintf(file, "%s.%03i", str, msec);
-                     }
-                     break;
-                  case UR_TYPE_STRING:
-                     {
-                        // Printable string - print it as it is
-                        int size = ur_get_var_len(templates[index], rec, id);
-                        char *data = ur_get_ptr_by_id(templates[index], rec, id);
-                        putc('"', file);
-                        while (size--) {
-                           switch (*data) {
-                              case '\n': // Replace newline with space
-                                         putc(' ', file);
-                                         break;
-                              case '"' : // Double quotes in string
-                                         putc('"', file);
-                                         putc('"', file);
-                                         break;
-                              default  : // Check if character is printable
-                                         if (isprint(*data)) {
-                                            putc(*data, file);
-                                         }
-                           }
-                           data++;
-                        }
-                        putc('"', file);
-                     }
-                     break;
-                  case UR_TYPE_BYTES:
-                     {
-                        // Generic string of bytes - print each byte as two hex digits
-                        int size = ur_get_var_len(templates[index], rec, id);
-                        unsigned char *data = ur_get_ptr_by_id(templates[index], rec, id);
-                        while (size--) {
-                           fprintf(file, "%02x", *data++);
-                        }
-                     }
-                     break;
-                  default:
-                     {
-                        // Unknown type - print the value in hex
-                        int size = ur_get_len(templates[index], rec, id);
-                        fprintf(file, "0x");
-                        for (int i = 0; i < size; i++) {
-                           fprintf(file, "%02x", ((unsigned char*)ptr)[i]);
-                        }
-                     }
-                     break;
-               } // case (field type)
-            } // if present
-         } // loop over fields
-         fprintf(file,"\n");
-         fflush(file);
-
-         num_records++;
-      } // end critical section
+         w.len = format_record(w.buffer + w.len, &fmt, rec, index) - w.buffer;
+      }
+      w.records++;
 
       // Check whether maximum number of records has been reached
-      if (max_num_records && num_records >= max_num_records) {
+      if (max_num_records && cnt == max_num_records) {
          stop = 1;
          trap_terminate();
          break;
       }
    } // end while (!stop)
 
+   write_buffer(&w);
+   free(w.buffer);
+   free(w.cbuffer);
+   free(w.spec);
+   free(fmt.ops);
+
    if (verbose >= 1) {
       printf("Thread %i exitting.\n", index);
    }
@@ -363,7 +842,7 @@ int main(int argc, char **argv)
    int ret;
    char *out_template_str = NULL;
    char *out_filename = NULL;
-   int append = 0;
+   int split = 0;
    char delimiter = ',';
    out_template_defined = 0;
 
@@ -401,6 +880,21 @@ int main(int argc, char **argv)
          }
          out_filename = optarg;
          break;
+      case 's':
+         split = 1;
+         break;
+      case 'z':
+         compress = 1;
+         // continue below...
+      case 'b':
+         binary = 1;
+         break;
+      case 'r':
+         rotate_size = (uint64_t) atoi(optarg) * 1024 * 1024;
+         break;
+      case 'R':
+         rotate_interval = atoi(optarg);
+         break;
       case 'o':
          out_template_str = optarg;
          break;
@@ -455,7 +949,19 @@ int main(int argc, char **argv)
       FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
       return 4;
    }
-   if (out_template_str == NULL && n_inputs > 1) {
+   if ((split || rotate_size != 0 || rotate_interval != 0) && out_filename == NULL) {
+      fprintf(stderr, "Error: Output file has to be specified (-w or -a) with -s, -r and -R.\n");
+      FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
+      return 1;
+   }
+#ifndef HAVE_LIBLZ4
+   if (compress) {
+      fprintf(stderr, "Error: Compression is not supported, logger was compiled without liblz4.\n");
+      FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
+      return 1;
+   }
+#endif
+   if (out_template_str == NULL && n_inputs > 1 && !binary) {
       fprintf(stderr, "Error: If you use more than one interface, output template has to be specified.\n");
       FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
       return 4;
@@ -501,6 +1007,8 @@ int main(int argc, char **argv)
          goto exit;
       }
       trap_set_required_fmt(i, TRAP_FMT_UNIREC, NULL);
+      // Output buffers are written also when no data arrive
+      trap_ifcctl(TRAPIFC_INPUT, i, TRAPCTL_SETTIMEOUT, FLUSH_TIMEOUT);
    }
 
    // Create output UniRec template (user-specified or union of all inputs)
@@ -527,23 +1035,34 @@ Available types are: int8, int16, int32, int64, uint8, uint16, uint32, uint64, c
 
    // ***** Open output file *****
 
-   // Open output file if specified
-   if (out_filename != NULL) {
-      if (verbose >= 0) {
-         printf("Creating output file \"%s\" ...\n", out_filename);
+   // Open output file if specified (stdout otherwise)
+   if (split) {
+      ifc_outputs = (output_t *) calloc(n_inputs, sizeof(output_t));
+      if (ifc_outputs == NULL) {
+         fprintf(stderr, "Memory allocation error.\n");
+         ret = -1;
+         goto exit;
       }
-      if (append) {
-         file = fopen(out_filename, "a");
-      } else {
-         file = fopen(out_filename, "w");
+      for (int i = 0; i < n_inputs; i++) {
+         char *name = (char *) malloc(strlen(out_filename) + 16);
+         if (name == NULL) {
+            fprintf(stderr, "Memory allocation error.\n");
+            ret = -1;
+            goto exit;
+         }
+         sprintf(name, "%s.%i", out_filename, i);
+         ifc_outputs[i].name = name;
+         if (open_output(&ifc_outputs[i]) != 0) {
+            ret = 3;
+            goto exit;
+         }
       }
-      if (file == NULL) {
-         perror("Error: can't open output file:");
+   } else {
+      output.name = out_filename;
+      if (open_output(&output) != 0) {
          ret = 3;
          goto exit;
       }
-   } else {
-      file = stdout;
    }
 
    if (verbose >= 0) {
@@ -583,6 +1102,20 @@ exit:
    free(templates);
    }
 
+   if (ifc_outputs) {
+      for (int i = 0; i < n_inputs; i++) {
+         if (ifc_outputs[i].f != NULL) {
+            fclose(ifc_outputs[i].f);
+         }
+         free((char *) ifc_outputs[i].name);
+      }
+      free(ifc_outputs);
+   }
+   if (output.f != NULL && output.f != stdout) {
+      fclose(output.f);
+   }
+   free(title_line);
+
    ur_free_template(out_template);
    ur_finalize();
    FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
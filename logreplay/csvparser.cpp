@@ -0,0 +1,446 @@
+/**
+ * \file csvparser.cpp
+ * \brief Parser of CSV written by logger.
+ * \date 2016
+ */
+/*
+ * Copyright (C) 2016 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#define __STDC_LIMIT_MACROS // INTn_MAX in C++98
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "csvparser.h"
+
+using namespace std;
+
+enum column_kind {
+   KIND_UINT8, KIND_UINT16, KIND_UINT32, KIND_UINT64,
+   KIND_INT8, KIND_INT16, KIND_INT32, KIND_INT64,
+   KIND_CHAR, KIND_IP, KIND_TIME, KIND_STRING, KIND_BYTES, KIND_GENERIC
+};
+
+/**
+ * \brief Parse unsigned decimal number.
+ * \return True on success, false when value is not a plain number or is out of range.
+ */
+static inline bool parse_uint(const char *p, const char *end, uint64_t max, uint64_t &val)
+{
+   if (p == end || end - p > 20) {
+      return false;
+   }
+   val = 0;
+   for (; p < end; p++) {
+      unsigned digit = (unsigned) (*p - '0');
+      if (digit > 9 || val > (max - digit) / 10) {
+         return false;
+      }
+      val = val * 10 + digit;
+   }
+   return true;
+}
+
+/**
+ * \brief Parse signed decimal number.
+ * \return True on success, false when value is not a plain number or is out of range.
+ */
+static inline bool parse_int(const char *p, const char *end, int64_t min, int64_t max, int64_t &val)
+{
+   uint64_t abs;
+
+   if (p != end && *p == '-') {
+      if (!parse_uint(p + 1, end, (uint64_t) -(min + 1) + 1, abs)) {
+         return false;
+      }
+      val = (int64_t) (0 - abs);
+      return true;
+   }
+   if (!parse_uint(p, end, (uint64_t) max, abs)) {
+      return false;
+   }
+   val = (int64_t) abs;
+   return true;
+}
+
+/**
+ * \brief Parse IPv4 address in dotted decimal notation.
+ */
+static inline bool parse_ipv4(const char *p, const char *end, ip_addr_t *ip)
+{
+   uint32_t addr = 0;
+
+   for (int i = 0; i < 4; i++) {
+      const char *dot = p;
+      uint64_t octet;
+      while (dot < end && *dot != '.') {
+         dot++;
+      }
+      if ((dot == end) != (i == 3) || !parse_uint(p, dot, 255, octet)) {
+         return false;
+      }
+      addr = (addr << 8) | (uint32_t) octet;
+      p = dot + 1;
+   }
+   *ip = ip_from_int(addr);
+   return true;
+}
+
+/**
+ * \brief Number of days from 1970-01-01 to given date (proleptic Gregorian calendar).
+ */
+static inline int64_t days_from_civil(int64_t y, unsigned m, unsigned d)
+{
+   y -= (m <= 2);
+   const int64_t era = (y >= 0 ? y : y - 399) / 400;
+   const unsigned yoe = (unsigned) (y - era * 400);
+   const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+   const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+   return era * 146097 + (int64_t) doe - 719468;
+}
+
+/**
+ * \brief Parse timestamp written by logger: YYYY-MM-DDTHH:MM:SS with optional .mmm (UTC).
+ */
+static inline bool parse_time(const char *p, const char *end, ur_time_t *time)
+{
+   uint64_t year, mon, day, hour, min, sec, msec = 0;
+
+   if ((end - p != 19 && end - p != 23) || p[4] != '-' || p[7] != '-' || p[10] != 'T' || p[13] != ':' || p[16] != ':' ||
+       !parse_uint(p, p + 4, 9999, year) || !parse_uint(p + 5, p + 7, 12, mon) || !parse_uint(p + 8, p + 10, 31, day) ||
+       !parse_uint(p + 11, p + 13, 23, hour) || !parse_uint(p + 14, p + 16, 59, min) || !parse_uint(p + 17, p + 19, 60, sec) ||
+       mon == 0 || day == 0) {
+      return false;
+   }
+   if (end - p == 23 && (p[19] != '.' || !parse_uint(p + 20, end, 999, msec))) {
+      return false;
+   }
+   int64_t t = days_from_civil(year, mon, day) * 86400 + hour * 3600 + min * 60 + sec;
+   if (t < 0) {
+      return false;
+   }
+   *time = ur_time_from_sec_msec((uint64_t) t, msec);
+   return true;
+}
+
+static inline int hex_value(char c)
+{
+   if (c >= '0' && c <= '9') {
+      return c - '0';
+   } else if (c >= 'a' && c <= 'f') {
+      return c - 'a' + 10;
+   } else if (c >= 'A' && c <= 'F') {
+      return c - 'A' + 10;
+   }
+   return -1;
+}
+
+CsvParser::CsvParser() : tmplt_(NULL), skip_first_(false), delimiter_(',')
+{
+}
+
+/**
+ * \brief Select parsers of columns.
+ * \param [in] tmplt Template of records.
+ * \param [in] columns Fields in order of CSV columns.
+ * \param [in] skip_first Skip the first column of each line (time added by logger).
+ * \param [in] delimiter Delimiter of fields.
+ * \return 0 on success, -1 when a column is not in template.
+ */
+int CsvParser::init(ur_template_t *tmplt, const vector<ur_field_id_t> &columns, bool skip_first, char delimiter)
+{
+   tmplt_ = tmplt;
+   skip_first_ = skip_first;
+   delimiter_ = delimiter;
+   columns_.clear();
+   dynamic_.clear();
+
+   for (size_t i = 0; i < columns.size(); i++) {
+      column_t col;
+      col.id = columns[i];
+      if (!ur_is_present(tmplt, col.id)) {
+         return -1;
+      }
+      switch (ur_get_type(col.id)) {
+         case UR_TYPE_UINT8:  col.kind = KIND_UINT8; break;
+         case UR_TYPE_UINT16: col.kind = KIND_UINT16; break;
+         case UR_TYPE_UINT32: col.kind = KIND_UINT32; break;
+         case UR_TYPE_UINT64: col.kind = KIND_UINT64; break;
+         case UR_TYPE_INT8:   col.kind = KIND_INT8; break;
+         case UR_TYPE_INT16:  col.kind = KIND_INT16; break;
+         case UR_TYPE_INT32:  col.kind = KIND_INT32; break;
+         case UR_TYPE_INT64:  col.kind = KIND_INT64; break;
+         case UR_TYPE_CHAR:   col.kind = KIND_CHAR; break;
+         case UR_TYPE_IP:     col.kind = KIND_IP; break;
+         case UR_TYPE_TIME:   col.kind = KIND_TIME; break;
+         case UR_TYPE_STRING: col.kind = KIND_STRING; break;
+         case UR_TYPE_BYTES:  col.kind = KIND_BYTES; break;
+         default:             col.kind = KIND_GENERIC; break;
+      }
+      columns_.push_back(col);
+   }
+
+   // Dynamic fields are stored in template order, so they are only appended to the record
+   ur_field_id_t id = UR_ITER_BEGIN;
+   while ((id = ur_iter_fields(tmplt, id)) != UR_ITER_END) {
+      if (ur_is_dynamic(id)) {
+         for (size_t i = 0; i < columns_.size(); i++) {
+            if (columns_[i].id == id) {
+               dynamic_.push_back(i);
+               break;
+            }
+         }
+      }
+   }
+   slices_.resize(columns_.size());
+   return 0;
+}
+
+/**
+ * \brief Value of the last field which could not be parsed.
+ */
+const string &CsvParser::invalid_value() const
+{
+   return scratch_;
+}
+
+/**
+ * \brief Find the next field of line.
+ * \param [in] p Beginning of the field.
+ * \param [in] end End of line.
+ * \param [out] value Value of the field (without quotes).
+ * \return Beginning of the following field.
+ */
+const char *CsvParser::next_field(const char *p, const char *end, slice_t &value) const
+{
+   value.escaped = false;
+   if (p < end && *p == '"') {
+      // Quoted value, quotes inside are doubled
+      value.begin = ++p;
+      while (p < end) {
+         if (*p == '"') {
+            if (p + 1 < end && p[1] == '"') {
+               value.escaped = true;
+               p += 2;
+               continue;
+            }
+            break;
+         }
+         p++;
+      }
+      value.end = p;
+      while (p < end && *p != delimiter_) {
+         p++;
+      }
+   } else {
+      value.begin = p;
+      while (p < end && *p != delimiter_) {
+         p++;
+      }
+      value.end = p;
+   }
+   return (p < end ? p + 1 : p);
+}
+
+/**
+ * \brief Copy quoted value into buffer and replace doubled quotes.
+ */
+void CsvParser::unescape(const slice_t &value)
+{
+   unescaped_.clear();
+   for (const char *p = value.begin; p < value.end; p++) {
+      unescaped_ += *p;
+      if (*p == '"' && p + 1 < value.end && p[1] == '"') {
+         p++;
+      }
+   }
+}
+
+/**
+ * \brief Parse value by UniRec (slow path).
+ */
+bool CsvParser::parse_generic(ur_field_id_t id, const char *begin, const char *end, void *rec)
+{
+   scratch_.assign(begin, end);
+   return ur_set_from_string(tmplt_, rec, id, scratch_.c_str()) == 0;
+}
+
+/**
+ * \brief Parse value of static field into record.
+ */
+bool CsvParser::parse_value(const column_t &col, const slice_t &value, void *rec)
+{
+   void *ptr = ur_get_ptr_by_id(tmplt_, rec, col.id);
+   uint64_t u;
+   int64_t i;
+
+   switch (col.kind) {
+      case KIND_UINT8:
+         if (parse_uint(value.begin, value.end, UINT8_MAX, u)) {
+            *(uint8_t *) ptr = u;
+            return true;
+         }
+         break;
+      case KIND_UINT16:
+         if (parse_uint(value.begin, value.end, UINT16_MAX, u)) {
+            *(uint16_t *) ptr = u;
+            return true;
+         }
+         break;
+      case KIND_UINT32:
+         if (parse_uint(value.begin, value.end, UINT32_MAX, u)) {
+            *(uint32_t *) ptr = u;
+            return true;
+         }
+         break;
+      case KIND_UINT64:
+         if (parse_uint(value.begin, value.end, UINT64_MAX, u)) {
+            *(uint64_t *) ptr = u;
+            return true;
+         }
+         break;
+      case KIND_INT8:
+         if (parse_int(value.begin, value.end, INT8_MIN, INT8_MAX, i)) {
+            *(int8_t *) ptr = i;
+            return true;
+         }
+         break;
+      case KIND_INT16:
+         if (parse_int(value.begin, value.end, INT16_MIN, INT16_MAX, i)) {
+            *(int16_t *) ptr = i;
+            return true;
+         }
+         break;
+      case KIND_INT32:
+         if (parse_int(value.begin, value.end, INT32_MIN, INT32_MAX, i)) {
+            *(int32_t *) ptr = i;
+            return true;
+         }
+         break;
+      case KIND_INT64:
+         if (parse_int(value.begin, value.end, INT64_MIN, INT64_MAX, i)) {
+            *(int64_t *) ptr = i;
+            return true;
+         }
+         break;
+      case KIND_CHAR:
+         if (value.end - value.begin == 1) {
+            *(char *) ptr = *value.begin;
+            return true;
+         }
+         break;
+      case KIND_IP:
+         if (parse_ipv4(value.begin, value.end, (ip_addr_t *) ptr)) {
+            return true;
+         }
+         break;
+      case KIND_TIME:
+         if (parse_time(value.begin, value.end, (ur_time_t *) ptr)) {
+            return true;
+         }
+         break;
+   }
+   return parse_generic(col.id, value.begin, value.end, rec);
+}
+
+/**
+ * \brief Parse one line into record.
+ * \param [in] line Beginning of line.
+ * \param [in] end End of line (without line delimiter).
+ * \param [out] rec Record created from the template.
+ * \return True on success, false when a value is invalid (see invalid_value()).
+ */
+bool CsvParser::parse_line(const char *line, const char *end, void *rec)
+{
+   const char *p = line;
+   slice_t value;
+
+   if (skip_first_) {
+      p = next_field(p, end, value);
+   }
+   for (size_t i = 0; i < columns_.size(); i++) {
+      p = next_field(p, end, value);
+      if (ur_is_dynamic(columns_[i].id)) {
+         // Dynamic fields are stored after all static ones
+         slices_[i] = value;
+      } else if (!parse_value(columns_[i], value, rec)) {
+         return false;
+      }
+   }
+
+   ur_clear_varlen(tmplt_, rec);
+   for (size_t j = 0; j < dynamic_.size(); j++) {
+      const column_t &col = columns_[dynamic_[j]];
+      slice_t &value = slices_[dynamic_[j]];
+      const char *begin = value.begin;
+      size_t len = value.end - value.begin;
+
+      if (value.escaped) {
+         unescape(value);
+         begin = unescaped_.data();
+         len = unescaped_.size();
+      }
+      // Check size of dynamic field and if longer than maximum size then cut it
+      if (len > DYN_FIELD_MAX_SIZE) {
+         len = DYN_FIELD_MAX_SIZE;
+      }
+
+      if (col.kind == KIND_STRING) {
+         if (ur_set_var(tmplt_, rec, col.id, begin, len) != UR_OK) {
+            scratch_.assign(begin, len);
+            return false;
+         }
+      } else if (col.kind == KIND_BYTES && len % 2 == 0) {
+         char bytes[DYN_FIELD_MAX_SIZE / 2];
+         for (size_t k = 0; k < len / 2; k++) {
+            int hi = hex_value(begin[2 * k]), lo = hex_value(begin[2 * k + 1]);
+            if (hi < 0 || lo < 0) {
+               scratch_.assign(begin, len);
+               return false;
+            }
+            bytes[k] = (char) (hi << 4 | lo);
+         }
+         if (ur_set_var(tmplt_, rec, col.id, bytes, len / 2) != UR_OK) {
+            scratch_.assign(begin, len);
+            return false;
+         }
+      } else if (!parse_generic(col.id, begin, begin + len, rec)) {
+         return false;
+      }
+   }
+   return true;
+}
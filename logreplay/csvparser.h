@@ -0,0 +1,94 @@
+/**
+ * \file csvparser.h
+ * \brief Parser of CSV written by logger.
+ * \date 2016
+ */
+/*
+ * Copyright (C) 2016 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef CSVPARSER_H
+#define CSVPARSER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unirec/unirec.h>
+
+#define DYN_FIELD_MAX_SIZE 1024 // Maximum size of dynamic field, longer fields will be cutted to this size
+
+/**
+ * \brief Parser of CSV lines written by logger.
+ *
+ * Parser of each column is selected once from the header. Fields are sliced in place (lines
+ * are not copied) and integers, IP addresses and timestamps are converted directly into
+ * the UniRec record. Other values (and values in unexpected format) are passed to ur_set_from_string.
+ * One instance must not be used by more threads at once.
+ */
+class CsvParser {
+public:
+   CsvParser();
+   int init(ur_template_t *tmplt, const std::vector<ur_field_id_t> &columns, bool skip_first, char delimiter);
+   bool parse_line(const char *line, const char *end, void *rec);
+   const std::string &invalid_value() const;
+
+private:
+   struct column_t {
+      ur_field_id_t id;   /**< Field ID. */
+      int kind;           /**< Parser of the field. */
+   };
+   struct slice_t {
+      const char *begin;
+      const char *end;
+      bool escaped;       /**< Quoted value contains doubled quotes. */
+   };
+
+   ur_template_t *tmplt_;
+   std::vector<column_t> columns_;
+   std::vector<int> dynamic_;      /**< Columns of dynamic fields in template order. */
+   std::vector<slice_t> slices_;   /**< Values of dynamic fields of the current line. */
+   bool skip_first_;               /**< Skip the first column (time added by logger). */
+   char delimiter_;
+   std::string scratch_;           /**< Copy of value for generic parser (invalid value). */
+   std::string unescaped_;         /**< Quoted value with doubled quotes replaced. */
+
+   const char *next_field(const char *p, const char *end, slice_t &value) const;
+   bool parse_value(const column_t &col, const slice_t &value, void *rec);
+   bool parse_generic(ur_field_id_t id, const char *begin, const char *end, void *rec);
+   void unescape(const slice_t &value);
+};
+
+#endif
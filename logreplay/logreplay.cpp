@@ -59,25 +59,38 @@
 #include <stdlib.h>
 #include <signal.h>
 #include <getopt.h>
+#include <omp.h>
 #include <libtrap/trap.h>
-#include <map>
+#include <string.h>
+#ifdef HAVE_LIBLZ4
+#include <lz4.h>
+#endif
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../logger/binlog.h"
+#include "csvparser.h"
+#include "pacer.h"
 #include "fields.h"
 
 UR_FIELDS(
 )
 
-#define DYN_FIELD_MAX_SIZE 1024 // Maximum size of dynamic field, longer fields will be cutted to this size
-
 // Struct with information about module
 trap_module_info_t *module_info = NULL;
 
 #define MODULE_BASIC_INFO(BASIC) \
-  BASIC("LogReplay","This module converts CSV from logger and sends it in UniRec. The first row of CSV file has to be data format of fields.",0,1)
+  BASIC("LogReplay","This module converts CSV from logger and sends it in UniRec. The first row of CSV file has to be data format of fields. Binary log of logger (-b) is detected automatically and its records are sent as they were stored.",0,1)
 
 #define MODULE_PARAMS(PARAM) \
   PARAM('f', "file", "Specify path to a file to be read.", required_argument, "string") \
   PARAM('c', "cut", "Quit after N records are received.", required_argument, "uint32") \
-  PARAM('n', "no_eof", "Don't send 'EOF message' at the end.", no_argument, "none")
+  PARAM('n', "no_eof", "Don't send 'EOF message' at the end.", no_argument, "none") \
+  PARAM('r', "rate", "Send at most N records per second.", required_argument, "uint64") \
+  PARAM('R', "realtime", "Real-time replay, keep gaps between timestamps of records divided by SPEED (1 = original speed).", required_argument, "float") \
+  PARAM('T', "time_field", "Timestamp field used by -R (default TIME_FIRST).", required_argument, "string") \
+  PARAM('p', "parsers", "Number of threads parsing CSV (default: number of CPUs - 1).", required_argument, "uint32")
 
 static int stop = 0;
 
@@ -87,63 +100,285 @@ TRAP_DEFAULT_SIGNAL_HANDLER(stop = 1);
 
 using namespace std;
 
-string get_next_field(stringstream &line)
+#define CHUNK_SIZE (1 << 20) // Size of CSV chunk parsed by one thread at once
+#define SLOTS_PER_PARSER 4 // Number of parsed chunks waiting for sending (per parser thread)
+#define CHUNK_WAIT_USLEEP 20 // Wait for free slot / parsed chunk
+
+/**
+ * Slot for one chunk of CSV file, slots are reused in a ring.
+ */
+struct chunk_t {
+   uint64_t seq;           // Number of chunk the slot is reserved for, set by send thread
+   int ready;              // Chunk is parsed, set by parser thread
+   vector<char> batch;     // Lines of chunk, each one is uint16_t size followed by record (size 0 = invalid line)
+   vector<string> invalid; // Invalid values of skipped lines
+};
+
+/**
+ * CSV file split into chunks, shared by parser threads and send thread.
+ */
+struct csv_replay_t {
+   const char *begin;      // Data part of mapped file
+   const char *end;
+   char delimiter;         // Record delimiter
+   uint64_t n_chunks;
+   uint64_t next_chunk;    // Next chunk to be parsed
+   vector<chunk_t> slots;
+   int done;               // Send thread finished, parser threads stop
+};
+
+string replace_string(string subject, const string &search, const string &replace) {
+   size_t pos = 0;
+   while ((pos = subject.find(search, pos)) != std::string::npos) {
+      subject.replace(pos, search.length(), replace);
+      pos += replace.length();
+   }
+   return subject;
+}
+
+/**
+ * Wait until the record can be sent. Buffered records are flushed before sleeping,
+ * so that they are not held back by the pacing.
+ */
+static inline void pace(trap_ctx_t *ctx, Pacer &pacer, ur_time_t time)
+{
+   uint64_t deadline = pacer.deadline(time);
+   if (deadline != 0) {
+      trap_ctx_send_flush(ctx, 0);
+      Pacer::sleep_until(deadline);
+   }
+}
+
+/**
+ * Find timestamp field for real-time replay in the template.
+ *
+ * \param[in] tmplt Output template.
+ * \param[in] name Name of the field.
+ * \return ID of the field or UR_E_INVALID_NAME when template does not contain such field.
+ */
+static ur_field_id_t find_time_field(ur_template_t *tmplt, const char *name)
+{
+   int id = ur_get_id_by_name(name);
+   if (id < 0 || !ur_is_present(tmplt, id) || ur_get_type(id) != UR_TYPE_TIME) {
+      fprintf(stderr, "Error: Data format does not contain timestamp field %s required by -R.\n", name);
+      return UR_E_INVALID_NAME;
+   }
+   return id;
+}
+
+/**
+ * Replay binary log of logger - records are sent as they were stored, output data format
+ * is changed according to format entries.
+ *
+ * \param[in] ctx TRAP context.
+ * \param[in] f_in Input file.
+ * \param[in,out] utmpl Output template.
+ * \param[in] max_num_records Maximal number of records to send (0 = unlimited).
+ * \param[in] pacer Pacing of sent records.
+ * \param[in] time_field Timestamp field used in real-time mode.
+ * \return 0 on success, 1 on error.
+ */
+int replay_binary(trap_ctx_t *ctx, ifstream &f_in, ur_template_t **utmpl, unsigned int max_num_records,
+                  Pacer &pacer, const char *time_field)
 {
-   string column;
-   uint32_t quotes = 0;
-   uint32_t in_quotes = 0;
-   char prev = 0;
-   bool fin = false;
-   int ch;
-
-   // skip first quote (only in dynamic fields)
-   if (line.peek() == '"') {
-      ++quotes;
-      line.get(); // remove quote from input
+   ur_field_id_t time_id = UR_E_INVALID_NAME;
+   binlog_file_hdr_t file_hdr;
+   binlog_block_hdr_t hdr;
+   vector<char> block, raw;
+   string spec;
+   unsigned int num_records = 0;
+
+   if (!f_in.read((char *) &file_hdr, sizeof(file_hdr)) || file_hdr.version != BINLOG_VERSION) {
+      fprintf(stderr, "Error: Unsupported version of binary log.\n");
+      return 1;
    }
 
-   while (!fin && ((ch = line.get()) != EOF)) {
-       switch(ch) {
-          case '"':
-            if (prev != '\\') { 
-               ++quotes;
-               ++in_quotes;
+   while (!stop && f_in.read((char *) &hdr, sizeof(hdr))) {
+      if (hdr.size == 0) {
+         continue;
+      }
+      block.resize(hdr.size);
+      if (!f_in.read(&block[0], hdr.size)) {
+         fprintf(stderr, "Error: Binary log is truncated.\n");
+         return 1;
+      }
+      const char *data = &block[0];
+      if (hdr.size != hdr.raw_size) {
+#ifdef HAVE_LIBLZ4
+         raw.resize(hdr.raw_size);
+         if (LZ4_decompress_safe(&block[0], &raw[0], hdr.size, hdr.raw_size) != (int) hdr.raw_size) {
+            fprintf(stderr, "Error: Corrupted block in binary log.\n");
+            return 1;
+         }
+         data = &raw[0];
+#else
+         fprintf(stderr, "Error: Binary log is compressed, logreplay was compiled without liblz4.\n");
+         return 1;
+#endif
+      }
+
+      uint32_t pos = 0;
+      while (!stop && pos + sizeof(binlog_entry_hdr_t) <= hdr.raw_size) {
+         binlog_entry_hdr_t entry;
+         memcpy(&entry, data + pos, sizeof(entry));
+         pos += sizeof(entry);
+         if (pos + entry.len > hdr.raw_size) {
+            fprintf(stderr, "Error: Corrupted block in binary log.\n");
+            return 1;
+         }
+         if (entry.type == BINLOG_ENTRY_FORMAT) {
+            string new_spec(data + pos, entry.len);
+            if (new_spec != spec) {
+               spec = new_spec;
+               *utmpl = ur_define_fields_and_update_template(spec.c_str(), *utmpl);
+               if (*utmpl == NULL || ur_ctx_set_output_template(ctx, 0, *utmpl) != UR_OK) {
+                  fprintf(stderr, "Error: Cannot create unirec template from data format %s.\n", spec.c_str());
+                  return 1;
+               }
+               if (pacer.realtime() && (time_id = find_time_field(*utmpl, time_field)) == UR_E_INVALID_NAME) {
+                  return 1;
+               }
             }
-            break;
-          case ',': // if it was static field (no quotes were present)
-                    // or if it was dynamic field (even count of quotes)
-           if (quotes == 0 || (prev == '"' && (quotes & 1) == 0)) {
-              fin = true;
-           }
-           break;
-       }
-       // skip last comma and deduplicate double quotes (store only one)
-       if ((ch != '"' || ((in_quotes & 1) == 0)) && !fin) {
-          column += ch;
-       }
-       prev = ch;
+         } else if (entry.type == BINLOG_ENTRY_RECORD) {
+            if (max_num_records != 0 && num_records >= max_num_records) {
+               return 0;
+            }
+            if (pacer.enabled()) {
+               ur_time_t time = 0;
+               if (time_id != UR_E_INVALID_NAME) {
+                  memcpy(&time, (const char *) ur_get_ptr_by_id(*utmpl, data + pos, time_id), sizeof(time));
+               }
+               pace(ctx, pacer, time);
+            }
+            trap_ctx_send(ctx, 0, data + pos, entry.len);
+            num_records++;
+         }
+         pos += entry.len;
+      }
    }
-   return column;
+   return 0;
 }
 
+/**
+ * Get beginning of the first line starting in the given chunk.
+ */
+static const char *chunk_begin(const csv_replay_t &csv, uint64_t num)
+{
+   if (num == 0) {
+      return csv.begin;
+   }
+   if (num >= csv.n_chunks) {
+      return csv.end;
+   }
+   const char *p = csv.begin + num * CHUNK_SIZE - 1;
+   const char *eol = (const char *) memchr(p, csv.delimiter, csv.end - p);
+   return (eol != NULL ? eol + 1 : csv.end);
+}
 
-int store_value(ur_template_t *t, void *data, int f_id, string &column)
+/**
+ * Parser thread - takes chunks in order, parses lines starting in them and stores records
+ * into their slots. Parsing of a chunk starts when its slot is released by send thread.
+ *
+ * \param[in,out] csv Shared state.
+ * \param[in] parser Parser of lines (copy for the thread).
+ * \param[in] tmplt Output template.
+ * \param[in] rec Record buffer of the thread.
+ */
+static void parse_thread(csv_replay_t &csv, CsvParser parser, ur_template_t *tmplt, void *rec)
 {
-   // Check size of dynamic field and if longer than maximum size then cut it
-   if (column.length() > DYN_FIELD_MAX_SIZE) {
-      column[DYN_FIELD_MAX_SIZE] = 0;
+   while (1) {
+      uint64_t num = __atomic_fetch_add(&csv.next_chunk, 1, __ATOMIC_RELAXED);
+      if (num >= csv.n_chunks) {
+         return;
+      }
+      chunk_t &chunk = csv.slots[num % csv.slots.size()];
+      while (__atomic_load_n(&chunk.seq, __ATOMIC_ACQUIRE) != num) {
+         if (__atomic_load_n(&csv.done, __ATOMIC_RELAXED)) {
+            return;
+         }
+         usleep(CHUNK_WAIT_USLEEP);
+      }
+
+      chunk.batch.clear();
+      chunk.invalid.clear();
+      const char *p = chunk_begin(csv, num);
+      const char *end = chunk_begin(csv, num + 1);
+      while (p < end) {
+         const char *eol = (const char *) memchr(p, csv.delimiter, end - p);
+         if (eol == NULL) {
+            break; // Last line is not complete
+         }
+         uint16_t size = 0;
+         size_t pos = chunk.batch.size();
+         if (parser.parse_line(p, eol, rec)) {
+            size = ur_rec_size(tmplt, rec);
+            chunk.batch.resize(pos + sizeof(size) + size);
+            memcpy(&chunk.batch[pos + sizeof(size)], rec, size);
+         } else {
+            chunk.batch.resize(pos + sizeof(size));
+            chunk.invalid.push_back(parser.invalid_value());
+         }
+         memcpy(&chunk.batch[pos], &size, sizeof(size));
+         p = eol + 1;
+      }
+      __atomic_store_n(&chunk.ready, 1, __ATOMIC_RELEASE);
    }
-   return ur_set_from_string(t, data, f_id, column.c_str());
 }
 
+/**
+ * Send thread - sends parsed chunks in order of the file and releases their slots.
+ *
+ * \param[in] ctx TRAP context.
+ * \param[in,out] csv Shared state.
+ * \param[in] tmplt Output template.
+ * \param[in] max_num_records Maximal number of lines to process (0 = unlimited).
+ * \param[in] pacer Pacing of sent records.
+ * \param[in] time_id Timestamp field used in real-time mode.
+ */
+static void csv_send_thread(trap_ctx_t *ctx, csv_replay_t &csv, ur_template_t *tmplt, unsigned int max_num_records,
+                            Pacer &pacer, ur_field_id_t time_id)
+{
+   unsigned int num_records = 0;
 
-string replace_string(string subject, const string &search, const string &replace) {
-   size_t pos = 0;
-   while ((pos = subject.find(search, pos)) != std::string::npos) {
-      subject.replace(pos, search.length(), replace);
-      pos += replace.length();
+   for (uint64_t num = 0; num < csv.n_chunks && !stop; num++) {
+      chunk_t &chunk = csv.slots[num % csv.slots.size()];
+      while (!__atomic_load_n(&chunk.ready, __ATOMIC_ACQUIRE)) {
+         if (stop) {
+            goto done;
+         }
+         usleep(CHUNK_WAIT_USLEEP);
+      }
+
+      size_t pos = 0, invalid = 0;
+      while (!stop && pos < chunk.batch.size()) {
+         if (max_num_records != 0 && num_records >= max_num_records) {
+            goto done;
+         }
+         num_records++;
+         uint16_t size;
+         memcpy(&size, &chunk.batch[pos], sizeof(size));
+         pos += sizeof(size);
+         if (size == 0) {
+            fprintf(stderr, "Warning: invalid field \"%s\", record %d skipped.\n", chunk.invalid[invalid++].c_str(), num_records);
+            continue;
+         }
+         const char *rec = &chunk.batch[pos];
+         if (pacer.enabled()) {
+            ur_time_t time = 0;
+            if (time_id != UR_E_INVALID_NAME) {
+               memcpy(&time, (const char *) ur_get_ptr_by_id(tmplt, rec, time_id), sizeof(time));
+            }
+            pace(ctx, pacer, time);
+         }
+         trap_ctx_send(ctx, 0, rec, size);
+         pos += size;
+      }
+
+      chunk.ready = 0;
+      __atomic_store_n(&chunk.seq, num + csv.slots.size(), __ATOMIC_RELEASE);
    }
-   return subject;
+done:
+   __atomic_store_n(&csv.done, 1, __ATOMIC_RELAXED);
 }
 
 int main(int argc, char **argv)
@@ -157,12 +392,17 @@ int main(int argc, char **argv)
    ifstream f_in;
    string line;
    ur_template_t *utmpl = NULL;
-   void *data = NULL;
-   map<int,string> dynamic_field_map;
-   unsigned int num_records = 0; // Number of records received (total of all inputs)
+   vector<void *> records; // Record buffers of parser threads
+   char *file_map = NULL; // Mapped input file (CSV)
+   size_t map_size = 0;
    unsigned int max_num_records = 0; // Exit after this number of records is received
    char is_limited = 0;
    trap_ctx_t *ctx = NULL;
+   Pacer pacer;
+   const char *time_field = "TIME_FIRST";
+   ur_field_id_t time_id = UR_E_INVALID_NAME;
+   int n_parsers = omp_get_num_procs() - 1;
+   csv_replay_t csv;
 
    INIT_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
    // ***** Process parameters *****
@@ -209,15 +449,41 @@ int main(int argc, char **argv)
          //   field_delim = (optarg[0] != '\\' ? optarg[0] : (optarg[1] == 't'?'\t':'\n'));
          //   printf("Field delimiter: 0x%02X\n", field_delim);
          //   break;
-         //case 'r':
-         //   record_delim = (optarg[0] != '\\' ? optarg[0] : (optarg[1] == 't'?'\t':'\n'));
-         //   printf("Record delimiter: 0x%02X\n", record_delim);
-         //   break;
+         case 'r':
+            pacer.set_rate(strtoull(optarg, NULL, 10));
+            if (!pacer.enabled()) {
+               fprintf(stderr, "Error: Parameter of -r option must be integer > 0.\n");
+               FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
+               return 1;
+            }
+            break;
+         case 'R':
+            pacer.set_speed(atof(optarg));
+            if (!pacer.realtime()) {
+               fprintf(stderr, "Error: Parameter of -R option must be number > 0.\n");
+               FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
+               return 1;
+            }
+            break;
+         case 'T':
+            time_field = optarg;
+            break;
+         case 'p':
+            n_parsers = atoi(optarg);
+            if (n_parsers <= 0) {
+               fprintf(stderr, "Error: Parameter of -p option must be integer > 0.\n");
+               FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
+               return 1;
+            }
+            break;
          default:
             fprintf(stderr, "Error: Invalid arguments.\n");
             goto exit;
       }
    }
+   if (n_parsers < 1) {
+      n_parsers = 1;
+   }
    if (in_filename == NULL) {
       fprintf(stderr, "Error: Missing parameter -f with input file.\n");
       goto exit;
@@ -226,6 +492,27 @@ int main(int argc, char **argv)
    f_in.open(in_filename);
 
    if (f_in.good()) {
+      char magic[BINLOG_MAGIC_LEN];
+      if (f_in.read(magic, BINLOG_MAGIC_LEN) && memcmp(magic, BINLOG_MAGIC, BINLOG_MAGIC_LEN) == 0) {
+         // Binary log of logger
+         if (verbose >= 0) {
+            printf("Initializing TRAP library ...\n");
+         }
+         ctx = trap_ctx_init(module_info, ifc_spec);
+         if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+            fprintf(stderr, "ERROR in TRAP initialization: %s\n", trap_last_error_msg);
+            ret = 2;
+            goto exit;
+         }
+         trap_ctx_ifcctl(ctx, TRAPIFC_OUTPUT, 0, TRAPCTL_SETTIMEOUT, TRAP_WAIT);
+
+         f_in.seekg(0);
+         ret = replay_binary(ctx, f_in, &utmpl, (is_limited ? max_num_records : 0), pacer, time_field);
+         goto exit;
+      }
+      f_in.clear();
+      f_in.seekg(0);
+
       getline(f_in, line, record_delim);
       if (line.compare(0, 5, "time,") == 0) {
          time_flag = 1;
@@ -276,11 +563,14 @@ int main(int argc, char **argv)
          }
       }
 
-      data = ur_create_record(utmpl, memory_needed);
-      if (data == NULL) {
-         fprintf(stderr, "Error: Cannot create template for dynamic fields (not enough memory?).\n");
-         ret = 1;
-         goto exit;
+      for (int i = 0; i < n_parsers; i++) {
+         void *rec = ur_create_record(utmpl, memory_needed);
+         if (rec == NULL) {
+            fprintf(stderr, "Error: Cannot create template for dynamic fields (not enough memory?).\n");
+            ret = 1;
+            goto exit;
+         }
+         records.push_back(rec);
       }
 
       stringstream ss(line);
@@ -300,56 +590,65 @@ int main(int argc, char **argv)
       }
 
 
-      /* main loop */
-      while (f_in.good()) {
-         if ((num_records++ >= max_num_records) && (is_limited == 1)) {
-            break;
-         }
+      CsvParser parser;
+      if (parser.init(utmpl, field_ids, time_flag, field_delim) != 0) {
+         fprintf(stderr, "Error: Cannot create parser of header fields.\n");
+         ret = 3;
+         goto exit;
+      }
+      if (pacer.realtime() && (time_id = find_time_field(utmpl, time_field)) == UR_E_INVALID_NAME) {
+         ret = 3;
+         goto exit;
+      }
 
-         getline(f_in, line, record_delim);
-         if (!f_in.good()) {
-            break;
-         }
-         stringstream sl(line);
-         int skipped_time = 0;
-         bool valid = true;
-         for (vector<ur_field_id_t>::iterator it = field_ids.begin(); it != field_ids.end(); ++it) {
-            column = get_next_field(sl);
-            // Skip timestamp added by logger
-            if (!skipped_time && time_flag) {
-               column = get_next_field(sl);
-               skipped_time = 1;
-            }
-            // check if current field is dynamic
-            if (ur_is_dynamic(*it) != 0) {
-               // dynamic field, just store it in a map for later use
-               dynamic_field_map[*it] = column;
-            } else {
-               // store static field in unirec structure
-               if (store_value(utmpl, data, *it, column) != 0) {
-                  fprintf(stderr, "Warning: invalid field \"%s\", record %d skipped.\n", column.c_str(), num_records);
-                  valid = false;
-                  break;
-               }
-            }
-         }
-         // store dynamic fields in correct order to unirec structure
-         ur_field_id_t field_id = UR_ITER_BEGIN;
-
-         while ((field_id = ur_iter_fields(utmpl, field_id)) != UR_ITER_END) {
-            if (ur_is_dynamic(field_id) != 0) {
-               if (store_value(utmpl, data, field_id, dynamic_field_map[field_id]) != 0) {
-                     fprintf(stderr, "Warning: invalid field \"%s\", record %d skipped.\n", column.c_str(), num_records);
-                     valid = false;
-                     break;
-               };
-            }
+      // Map the file, lines are parsed in place
+      streamoff offset = f_in.tellg();
+      int fd = open(in_filename, O_RDONLY);
+      struct stat st;
+      if (fd < 0 || fstat(fd, &st) != 0) {
+         perror("Error: Cannot open file");
+         if (fd >= 0) {
+            close(fd);
          }
-         if (valid) {
-            trap_ctx_send(ctx, 0, data, ur_rec_size(utmpl, data));
-            //trap_ctx_send_flush(ctx, 0);
+         ret = 4;
+         goto exit;
+      }
+      map_size = st.st_size;
+      if (offset > 0 && map_size > (size_t) offset) {
+         file_map = (char *) mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+         if (file_map == MAP_FAILED) {
+            perror("Error: Cannot map file");
+            file_map = NULL;
+            close(fd);
+            ret = 4;
+            goto exit;
          }
+         madvise(file_map, map_size, MADV_SEQUENTIAL);
+      }
+      close(fd);
+
+      // Split the file into chunks, parse them in parallel and send them in order
+      csv.begin = (file_map != NULL ? file_map + offset : NULL);
+      csv.end = (file_map != NULL ? file_map + map_size : NULL);
+      csv.delimiter = record_delim;
+      csv.n_chunks = (csv.end - csv.begin + CHUNK_SIZE - 1) / CHUNK_SIZE;
+      csv.next_chunk = 0;
+      csv.done = 0;
+      csv.slots.resize(n_parsers * SLOTS_PER_PARSER);
+      for (size_t i = 0; i < csv.slots.size(); i++) {
+         csv.slots[i].seq = i;
+         csv.slots[i].ready = 0;
+      }
 
+      omp_set_dynamic(0);
+      #pragma omp parallel num_threads(n_parsers + 1)
+      {
+         int thread = omp_get_thread_num();
+         if (thread < n_parsers) {
+            parse_thread(csv, parser, utmpl, records[thread]);
+         } else {
+            csv_send_thread(ctx, csv, utmpl, (is_limited ? max_num_records : 0), pacer, time_id);
+         }
       }
    } else {
       fprintf(stderr, "Error: Cannot open file.\n");
@@ -365,6 +664,9 @@ exit:
    if (f_in.is_open()) {
       f_in.close();
    }
+   if (file_map != NULL) {
+      munmap(file_map, map_size);
+   }
    if (verbose >= 0) {
       printf("Exitting ...\n");
    }
@@ -381,9 +683,8 @@ exit:
       ur_free_template(utmpl);
       utmpl = NULL;
    }
-   if (data != NULL) {
-      ur_free_record(data);
-      data = NULL;
+   for (size_t i = 0; i < records.size(); i++) {
+      ur_free_record(records[i]);
    }
    ur_finalize();
    FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
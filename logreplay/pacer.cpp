@@ -0,0 +1,156 @@
+/**
+ * \file pacer.cpp
+ * \brief Pacing of replayed records.
+ * \date 2016
+ */
+/*
+ * Copyright (C) 2016 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <time.h>
+
+#include "pacer.h"
+
+/**
+ * \brief Get monotonic clock in nanoseconds.
+ */
+static inline uint64_t now_ns()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * \brief Convert UniRec timestamp to nanoseconds.
+ */
+static inline uint64_t ur_time_to_ns(ur_time_t time)
+{
+   return ur_time_get_sec(time) * 1000000000ULL + (((time & 0xffffffffULL) * 1000000000ULL) >> 32);
+}
+
+Pacer::Pacer() : rate_(0), speed_(0), tokens_(0), burst_(0), refill_(0), started_(false), start_(0), first_(0)
+{
+}
+
+/**
+ * \brief Limit number of records sent per second.
+ * \param[in] rate Records per second, 0 disables the limit.
+ */
+void Pacer::set_rate(uint64_t rate)
+{
+   rate_ = rate;
+   burst_ = (rate / 1000 > 1 ? rate / 1000 : 1);
+   tokens_ = burst_;
+   refill_ = now_ns();
+}
+
+/**
+ * \brief Replay records according to their timestamps.
+ * \param[in] speed Speed of replay (1 = original speed, 2 = twice as fast), 0 disables real-time mode.
+ */
+void Pacer::set_speed(double speed)
+{
+   speed_ = speed;
+   started_ = false;
+}
+
+bool Pacer::enabled() const
+{
+   return rate_ != 0 || speed_ > 0;
+}
+
+bool Pacer::realtime() const
+{
+   return speed_ > 0;
+}
+
+/**
+ * \brief Account one record and get time when it can be sent.
+ * \param[in] time Timestamp of the record (used in real-time mode only).
+ * \return Monotonic time in ns to wait for, 0 when the record can be sent immediately.
+ */
+uint64_t Pacer::deadline(ur_time_t time)
+{
+   uint64_t deadline = 0;
+   uint64_t now = 0;
+
+   if (rate_ != 0) {
+      tokens_ -= 1;
+      if (tokens_ < 0) {
+         now = now_ns();
+         tokens_ += (double) (now - refill_) * rate_ / 1e9;
+         refill_ = now;
+         if (tokens_ > burst_) {
+            tokens_ = burst_;
+         }
+         if (tokens_ < 0) {
+            deadline = now + (uint64_t) (-tokens_ * 1e9 / rate_);
+         }
+      }
+   }
+
+   if (speed_ > 0) {
+      uint64_t t = ur_time_to_ns(time);
+      if (!started_) {
+         started_ = true;
+         first_ = t;
+         start_ = now_ns();
+      } else if (t > first_) {
+         uint64_t target = start_ + (uint64_t) ((t - first_) / speed_);
+         if (target > deadline) {
+            if (now == 0) {
+               now = now_ns();
+            }
+            if (target > now) {
+               deadline = target;
+            }
+         }
+      }
+   }
+   return deadline;
+}
+
+/**
+ * \brief Sleep until given monotonic time, returns early when interrupted by a signal.
+ */
+void Pacer::sleep_until(uint64_t deadline)
+{
+   struct timespec ts;
+   ts.tv_sec = deadline / 1000000000ULL;
+   ts.tv_nsec = deadline % 1000000000ULL;
+   clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
@@ -0,0 +1,79 @@
+/**
+ * \file pacer.h
+ * \brief Pacing of replayed records.
+ * \date 2016
+ */
+/*
+ * Copyright (C) 2016 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef PACER_H
+#define PACER_H
+
+#include <stdint.h>
+#include <unirec/unirec.h>
+
+/**
+ * \brief Pacing of sent records.
+ *
+ * Rate limit is a token bucket refilled by monotonic clock, the bucket holds at most 1 ms of
+ * records so that high rates are kept by short bursts instead of sleeping for every record.
+ * Real-time mode keeps gaps between timestamps of records (divided by speed), records older
+ * than the first one (or late records) are sent immediately. Both modes can be combined,
+ * the later deadline is used.
+ */
+class Pacer {
+public:
+   Pacer();
+   void set_rate(uint64_t rate);
+   void set_speed(double speed);
+   bool enabled() const;
+   bool realtime() const;
+   uint64_t deadline(ur_time_t time);
+   static void sleep_until(uint64_t deadline);
+
+private:
+   uint64_t rate_;      /**< Records per second (0 = unlimited). */
+   double speed_;       /**< Speed of real-time replay (0 = disabled). */
+   double tokens_;      /**< Records that can be sent without waiting (negative = debt). */
+   double burst_;       /**< Capacity of the bucket. */
+   uint64_t refill_;    /**< Time of the last refill of the bucket (ns). */
+   bool started_;
+   uint64_t start_;     /**< Clock at the first record (ns). */
+   uint64_t first_;     /**< Timestamp of the first record (ns). */
+};
+
+#endif
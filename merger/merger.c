@@ -52,11 +52,13 @@
 #include <getopt.h>
 #include <time.h>
 #include <unistd.h>
+#include <string.h>
 #include <omp.h>
 
 #include <libtrap/trap.h>
 #include <unirec/unirec.h>
 #include "fields.h"
+#include "queue.h"
 
 #define TS_LAST   0
 #define TS_FIRST  1
@@ -69,6 +71,13 @@
 #define MODE_TIME_IGNORE   0
 #define MODE_TIME_AWARE    1
 
+#define QUEUE_SIZE         (4 * 1024 * 1024) // Size of queue of each input in bytes
+#define QUEUE_FULL_USLEEP  100
+#define MERGE_WAIT_USLEEP  10
+#define SEND_BURST         64 // Maximal number of records taken from one queue at once
+#define REORDER_BUCKETS    128 // Number of buckets of reorder buffer, they cover twice the reorder window
+#define LAG_PRINT_INTERVAL 10 // Interval of printing lag of inputs in seconds (verbose mode with reorder window)
+
 UR_FIELDS (
    time TIME_FIRST,
    time TIME_LAST
@@ -85,7 +94,8 @@ trap_module_info_t *module_info = NULL;
   PARAM('n', "link_count", "Sets count of input links. Must correspond to parameter -i (trap).", required_argument, "int32") \
   PARAM('u', "unirec", "UniRec specifier of input/output data (same to all links). (default <COLLECTOR_FLOW>).", required_argument, "string") \
   PARAM('t', "timeout", "(timestamp aware version) Set initial timeout for incoming interfaces (in seconds). Timeout is set to 0, if no data received in initial timeout (default 1s).", required_argument, "int32") \
-  PARAM('T', "timestamp", "Set mode to timestamp aware (not by default).", no_argument, "none")
+  PARAM('T', "timestamp", "Set mode to timestamp aware (not by default).", no_argument, "none") \
+  PARAM('W', "window", "(timestamp aware version) Reorder window in seconds. Records are buffered and sent once they are older than the newest received record by more than the window, inputs are not waited for (default 0, wait for all inputs).", required_argument, "float")
 
 static int stop = 0;
 static int verbose;
@@ -93,30 +103,106 @@ static int verbose;
 TRAP_DEFAULT_SIGNAL_HANDLER(stop = 1);
 
 static int timestamp_selector = TS_LAST; // Tells to sort timestamps based on TIME_FIRST or TIME_LAST field
-static ur_time_t actual_min_timestamp = 0; // Actual minimal timestamp
 
 static ur_template_t **in_template; // UniRec template of input interface(s)
 static ur_template_t *out_template; // UniRec template of output interface
 
-static int active_interfaces;
 static int initial_timeout = DEFAULT_TIMEOUT; // Initial timeout for incoming interfaces (in miliseconds)
+static ur_time_t reorder_window = 0; // Reorder window (timestamp aware version), 0 means wait for all inputs
+
+/**
+ * State of input link.
+ */
+typedef struct input_s {
+   rec_queue_t queue;    // Records received on the link, filled by receive thread
+   int idle;             // No data arrived within timeout, set by receive thread
+   int in_heap;          // Head of queue is in heap of merge thread
+   int finished;         // Link has ended and its queue is empty
+   int same_template;    // Input template is equal to output template, records are sent without copying
+   ur_time_t watermark;  // Time of the last sent (received with reorder window) record of the link
+   uint64_t records;     // Number of records (reorder window only)
+   uint64_t late;        // Number of records older than already sent ones (reorder window only)
+   ur_time_t max_lag;    // Maximal lag behind the newest record of all links (reorder window only)
+} input_t;
+
+/**
+ * Item of heap of queue heads in merge thread.
+ */
+typedef struct heap_item_s {
+   ur_time_t time;       // Time of the record
+   int index;            // Index of the link
+   const void *rec;      // Record in queue of the link
+   uint32_t len;         // Size of the record
+} heap_item_t;
+
+/**
+ * Record stored in reorder buffer, record data follow.
+ */
+typedef struct reorder_rec_s {
+   ur_time_t time;       // Time of the record
+   uint32_t len;         // Size of the record
+   uint32_t index;       // Index of the link
+} reorder_rec_t;
+
+/**
+ * Bucket of reorder buffer - records with time in one interval, in order of arrival.
+ */
+typedef struct bucket_s {
+   uint8_t *data;        // Records, each one preceded by reorder_rec_t
+   size_t used;
+   size_t size;
+   uint32_t cnt;         // Number of records
+} bucket_t;
+
+/**
+ * Reorder buffer - ring of buckets, bucket number N holds records with time in [N * width, (N + 1) * width).
+ */
+typedef struct reorder_s {
+   bucket_t buckets[REORDER_BUCKETS];
+   ur_time_t width;      // Time interval of one bucket
+   uint64_t release_num; // Number of the first bucket which was not sent yet
+   uint64_t max_num;     // Number of the newest bucket with records
+   int started;          // Some record was added, release_num is valid
+   reorder_rec_t **sorted; // Records of bucket being sent
+   uint32_t sorted_size;
+} reorder_t;
+
+static input_t *inputs = NULL; // Input links
+
+/**
+ * Push entry into queue, wait while the queue is full.
+ *
+ * @param [in] q Queue.
+ * @param [in] type Type of entry.
+ * @param [in] data Entry data.
+ * @param [in] len Length of data.
+ * @return 0 on success, -1 if module was stopped while waiting.
+ */
+static int queue_push(rec_queue_t *q, uint16_t type, const void *data, uint32_t len)
+{
+   while (rq_push(q, type, data, len) != 0) {
+      if (stop) {
+         return -1;
+      }
+      usleep(QUEUE_FULL_USLEEP);
+   }
+   return 0;
+}
 
 /**
- * Timestamp-aware capture thread - handles data incomming from on one interface.
+ * Receive thread - copies data incomming on one interface into its queue.
+ * Templates are handled by sending thread, changes of data format are passed through the queue.
  *
  * @param [in] index Index of the given link.
+ * @param [in] timeout Timeout of the interface, input is marked idle when no data arrive within it.
  */
-void ta_capture_thread(int index)
+void receive_thread(int index, int timeout)
 {
-   int private_stop = 0;
    int ret;
-
-   int outage_flag = 0;
-   int read_next = 1;
-   int timeout = initial_timeout;
-   ur_time_t rec_time;
+   int ended = 0;
    const void *rec;
    uint16_t rec_size;
+   input_t *input = &inputs[index];
 
    if (verbose >= 1) {
       printf("Thread %i started.\n", index);
@@ -124,329 +210,631 @@ void ta_capture_thread(int index)
 
    trap_ifcctl(TRAPIFC_INPUT, index, TRAPCTL_SETTIMEOUT, timeout);
 
+   while (!stop && !ended) {
+      if (verbose >= 2) {
+         printf("Thread %i: calling trap_recv()\n", index);
+      }
+      ret = trap_recv(index, &rec, &rec_size);
 
-   ret = trap_recv(index, &rec, &rec_size);
-   if (ret == TRAP_E_FORMAT_CHANGED) {
-      const char *spec = NULL;
-      uint8_t data_fmt;
-      if (trap_get_data_fmt(TRAPIFC_INPUT, index, &data_fmt, &spec) != TRAP_E_OK) {
-         fprintf(stderr, "Data format was not loaded.");
-         return;
+      if (ret == TRAP_E_FORMAT_CHANGED) {
+         const char *spec = NULL;
+         uint8_t data_fmt;
+         if (trap_get_data_fmt(TRAPIFC_INPUT, index, &data_fmt, &spec) != TRAP_E_OK) {
+            fprintf(stderr, "Data format was not loaded.");
+            break;
+         }
+         if (queue_push(&input->queue, RQ_FORMAT, spec, strlen(spec) + 1) != 0) {
+            break;
+         }
+         ret = TRAP_E_OK;
+      }
+
+      if (ret == TRAP_E_OK) {
+         if (verbose >= 2) {
+            printf("Thread %i: received %hu bytes of data\n", index, rec_size);
+         }
+         __atomic_store_n(&input->idle, 0, __ATOMIC_RELAXED);
+         ended = (rec_size <= 1);
+         if (queue_push(&input->queue, (ended ? RQ_END : RQ_DATA), rec, rec_size) != 0) {
+            break;
+         }
+      } else if (ret == TRAP_E_TIMEOUT) { // input probably (temporary) offline
+         if (verbose >= 0 && !input->idle) {
+            printf("Thread %i: no data received (timeout %u).\n", index, timeout);
+         }
+         __atomic_store_n(&input->idle, 1, __ATOMIC_RELAXED);
+      } else if (ret == TRAP_E_TERMINATED) { // Module was terminated while waiting for new data (e.g. by Ctrl-C)
+         break;
       } else {
-         int fail = 0;
-         #pragma omp critical
-         {
-            in_template[index] = ur_define_fields_and_update_template(spec, in_template[index]);
-            if (in_template[index] == NULL) {
-               fprintf(stderr, "Template could not be edited");
-               fail = 1;
-            } else {
-               ur_expand_template(spec, out_template);
-               char * spec_cpy = ur_template_string(out_template);
-               if (spec_cpy == NULL) {
-                  fprintf(stderr, "Memory allocation problem.");
-                  fail = 1;
-
-               } else {
-                  trap_set_data_fmt(0, TRAP_FMT_UNIREC, spec_cpy);
-               }
-            }
+         // Some error has occured
+         fprintf(stderr, "Error: trap_recv() returned %i (%s)\n", ret, trap_last_error_msg);
+         break;
+      }
+   }
+
+   if (!ended) {
+      queue_push(&input->queue, RQ_END, NULL, 0); // Merge thread must not wait for this input anymore.
+   }
+
+   if (verbose >= 1) {
+      printf("Thread %i exitting.\n", index);
+   }
+}
+
+/**
+ * Insert input into heap of queue heads.
+ *
+ * @param [in,out] heap Heap ordered by record time.
+ * @param [in,out] cnt Number of items in heap.
+ * @param [in] item Inserted item.
+ */
+static void heap_push(heap_item_t *heap, int *cnt, heap_item_t item)
+{
+   int i = (*cnt)++;
+
+   while (i > 0 && heap[(i - 1) / 2].time > item.time) {
+      heap[i] = heap[(i - 1) / 2];
+      i = (i - 1) / 2;
+   }
+   heap[i] = item;
+}
+
+/**
+ * Remove item with minimal time from heap.
+ *
+ * @param [in,out] heap Heap ordered by record time.
+ * @param [in,out] cnt Number of items in heap.
+ */
+static void heap_pop(heap_item_t *heap, int *cnt)
+{
+   heap_item_t last = heap[--(*cnt)];
+   int i = 0, child;
+
+   while ((child = 2 * i + 1) < *cnt) {
+      if (child + 1 < *cnt && heap[child + 1].time < heap[child].time) {
+         child++;
+      }
+      if (last.time <= heap[child].time) {
+         break;
+      }
+      heap[i] = heap[child];
+      i = child;
+   }
+   heap[i] = last;
+}
+
+/**
+ * Check which input templates are equal to output template.
+ *
+ * @param [in] n_inputs Number of input links.
+ */
+static void update_same_templates(int n_inputs)
+{
+   char *out_spec = ur_template_string(out_template);
+
+   for (int i = 0; i < n_inputs; i++) {
+      char *in_spec = ur_template_string(in_template[i]);
+      inputs[i].same_template = (in_spec != NULL && out_spec != NULL && strcmp(in_spec, out_spec) == 0);
+      free(in_spec);
+   }
+   free(out_spec);
+}
+
+/**
+ * Update templates according to new data format of input interface.
+ *
+ * @param [in] index Index of the link.
+ * @param [in] n_inputs Number of input links.
+ * @param [in] spec Data format specifier.
+ * @param [in,out] data_out Output record, reallocated for new output template.
+ * @return 0 on success, -1 on error.
+ */
+static int update_format(int index, int n_inputs, const char *spec, void **data_out)
+{
+   in_template[index] = ur_define_fields_and_update_template(spec, in_template[index]);
+   if (in_template[index] == NULL) {
+      fprintf(stderr, "Template could not be edited");
+      return -1;
+   }
+   out_template = ur_expand_template(spec, out_template);
+   char *spec_cpy = ur_template_string(out_template);
+   if (spec_cpy == NULL) {
+      fprintf(stderr, "Memory allocation problem.");
+      return -1;
+   }
+   trap_set_data_fmt(0, TRAP_FMT_UNIREC, spec_cpy);
+   update_same_templates(n_inputs);
+
+   free(*data_out);
+   *data_out = ur_create_record(out_template, UR_MAX_SIZE);
+   if (*data_out == NULL) {
+      fprintf(stderr, "ERROR: Allocation of record\n");
+      return -1;
+   }
+   return 0;
+}
+
+/**
+ * Get the first record from queue of input, process data format changes and end of input on the way.
+ *
+ * @param [in] index Index of the link.
+ * @param [in] n_inputs Number of input links.
+ * @param [out] item Record, its time is not filled.
+ * @param [in,out] data_out Output record, reallocated when data format changes.
+ * @return 1 if record is available, 0 if queue is empty or input ended, -1 on error.
+ */
+static int next_record(int index, int n_inputs, heap_item_t *item, void **data_out)
+{
+   input_t *input = &inputs[index];
+   const void *rec;
+   uint16_t type;
+   uint32_t len;
+
+   while ((rec = rq_peek(&input->queue, &type, &len)) != NULL) {
+      if (type == RQ_FORMAT) {
+         if (update_format(index, n_inputs, (const char *) rec, data_out) != 0) {
+            return -1;
          }
-         if (fail == 1) {
-            return;
+      } else if (type == RQ_END) {
+         if (verbose >= 0) {
+            printf("Interface %i received ending record, the interface will be closed.\n", index);
          }
+         input->finished = 1;
+         rq_pop(&input->queue);
+         return 0;
+      } else if (*data_out == NULL || len < ur_rec_fixlen_size(in_template[index])) {
+         fprintf(stderr, "Error: data with wrong size received (expected size: >= %hu, received size: %u)\n",
+                 ur_rec_fixlen_size(in_template[index]), len);
+      } else {
+         item->index = index;
+         item->rec = rec;
+         item->len = len;
+         return 1;
       }
+      rq_pop(&input->queue);
+   }
+   return 0;
+}
+
+/**
+ * Get timestamp of record used for ordering.
+ *
+ * @param [in] index Index of the link the record came from.
+ * @param [in] rec Record in input template.
+ * @return TIME_FIRST or TIME_LAST of the record.
+ */
+static inline ur_time_t record_time(int index, const void *rec)
+{
+   if (timestamp_selector == TS_FIRST) {
+      return ur_get(in_template[index], rec, F_TIME_FIRST);
    } else {
-      printf("ERROR on ifc %d: Negotiation was not succesfull\n", index);
-      return;
+      return ur_get(in_template[index], rec, F_TIME_LAST);
    }
+}
 
-   void *data_out = ur_create_record(out_template, UR_MAX_SIZE);
-   if (data_out == NULL) {
-      fprintf(stderr, "ERROR: Allocation of record\n");
-      return;
+/**
+ * Send record to output interface.
+ *
+ * @param [in] index Index of the link the record came from.
+ * @param [in] rec Record in input template.
+ * @param [in] len Size of the record.
+ * @param [in] data_out Output record used when input template differs from output template.
+ */
+static void send_record(int index, const void *rec, uint32_t len, void *data_out)
+{
+   int ret;
+
+   if (inputs[index].same_template) {
+      ret = trap_send(0, rec, len);
+   } else {
+      ur_copy_fields(out_template, data_out, in_template[index], rec);
+      ret = trap_send(0, data_out, ur_rec_size(out_template, data_out));
    }
 
-   // Read data from input and log them to a file
-   while (!stop && !private_stop) {
-      if (stop) private_stop = stop;
+   if (ret != TRAP_E_OK) {
+      if (ret == TRAP_E_TERMINATED) {
+         stop = 1; // Module was terminated while waiting for new data (e.g. by Ctrl-C)
+      } else if (verbose >= 0) {
+         // Some error has occured
+         fprintf(stderr, "Error: trap_send() returned %i (%s)\n", ret, trap_last_error_msg);
+         fprintf(stderr, "   Message skipped...\n");
+      }
+   }
+}
 
-      if (read_next){
-         rec_time = 0;
+/**
+ * Send terminating message to output interface.
+ */
+static void send_terminating_message()
+{
+   char dummy[1] = {0};
+   trap_send(0, dummy, 1); // FIXME: zero-length messages doesn't work, send message of length 1
+}
 
-         if (verbose >= 2) {
-            printf("Thread %i: calling trap_recv()\n", index);
+/**
+ * Sending thread of normal version - sends records of all inputs as they come.
+ * Queues are drained round-robin, at most SEND_BURST records from one queue at once.
+ *
+ * @param [in] n_inputs Number of input links.
+ */
+void send_thread(int n_inputs)
+{
+   int ret = 0, i, j;
+   int finished = 0;
+   void *data_out = NULL;
+
+   while (!stop && finished < n_inputs) {
+      int sent = 0;
+      for (i = 0; i < n_inputs && !stop; i++) {
+         heap_item_t item;
+         if (inputs[i].finished) {
+            continue;
          }
-         // Receive data from index-th input interface, wait until data are available
-
-         ret = trap_recv(index, &rec, &rec_size);
-         //update output template
-         if (ret == TRAP_E_FORMAT_CHANGED) {
-            const char *spec = NULL;
-            uint8_t data_fmt;
-            if (trap_get_data_fmt(TRAPIFC_INPUT, index, &data_fmt, &spec) != TRAP_E_OK) {
-               fprintf(stderr, "Data format was not loaded.");
-               return;
-            } else {
-               int fail = 0;
-               #pragma omp critical
-               {
-                  in_template[index] = ur_define_fields_and_update_template(spec, in_template[index]);
-                  if (in_template[index] == NULL) {
-                     fprintf(stderr, "Template could not be edited");
-                     fail = 1;
-                  } else {
-                     ur_expand_template(spec, out_template);
-                     char * spec_cpy = ur_template_string(out_template);
-                     if (spec_cpy == NULL) {
-                        fprintf(stderr, "Memory allocation problem.");
-                        fail = 1;
-                     }
-                     trap_set_data_fmt(0, TRAP_FMT_UNIREC, spec_cpy);
-                  }
-               }
-               if (fail == 1) {
-                  break;
-               }
-               ret = trap_recv(index, &rec, &rec_size);
-               memset(data_out, 0, UR_MAX_SIZE);
-            }
+         for (j = 0; j < SEND_BURST && !stop && (ret = next_record(i, n_inputs, &item, &data_out)) > 0; j++) {
+            send_record(i, item.rec, item.len, data_out);
+            rq_pop(&inputs[i].queue);
          }
-
-         if (ret != TRAP_E_OK) {
-            if (ret == TRAP_E_TIMEOUT) {//input probably (temporary) offline
-               if (verbose >= 0) {
-                  printf("Thread %i: no data received (timeout %u).\n", index, timeout);
-               }
-            } else if (ret == TRAP_E_TERMINATED) {// Module was terminated while waiting for new data (e.g. by Ctrl-C)
-               private_stop = 1;
-            } else {
-               // Some error has occured
-               if (verbose >= 0) {
-                  fprintf(stderr, "Error: trap_get_data() returned %i (%s)\n", ret, trap_last_error_msg);
-               }
-            }
-            if(!outage_flag){
-               outage_flag = 1;
-               trap_ifcctl(TRAPIFC_INPUT, index, TRAPCTL_SETTIMEOUT, TRAP_NO_WAIT);
-               #pragma omp atomic
-               --active_interfaces;
-            }
-         } else {
-            if (verbose >= 2) {
-               printf("Thread %i: received %hu bytes of data\n", index, rec_size);
-            }
-            // Check size of received data
-            if (rec_size < ur_rec_fixlen_size(in_template[index])) {
-               if (rec_size <= 1) {
-                  if (verbose >= 0) {
-                     printf("Interface %i received ending record, the interface will be closed.\n", index);
-                  }
-//                read_next = 0;
-               } else {
-                  if (verbose >= 0) {
-                     fprintf(stderr, "Error: data with wrong size received (expected size: >= %hu, received size: %hu)\n",
-                          ur_rec_fixlen_size(in_template[index]), rec_size);
-                  }
-               }
-               if(!outage_flag){
-                  outage_flag = 1;
-                  trap_ifcctl(TRAPIFC_INPUT, index, TRAPCTL_SETTIMEOUT, TRAP_NO_WAIT);
-                  #pragma omp atomic
-                  --active_interfaces;
-               }
-            } else {
-               if (outage_flag) {
-                  outage_flag = 0;
-                  trap_ifcctl(TRAPIFC_INPUT, index, TRAPCTL_SETTIMEOUT, timeout);
-                  #pragma omp atomic
-                  ++active_interfaces;
-               }
-               if (timestamp_selector == TS_FIRST){
-                  rec_time = ur_get(in_template[index], rec, F_TIME_FIRST);
-               } else {
-                  rec_time = ur_get(in_template[index], rec, F_TIME_LAST);
-               }
-               read_next = 0;
-            }
+         sent += j;
+         if (ret < 0) {
+            stop = 1;
+         } else if (ret == 0 && inputs[i].finished) {
+            finished++;
          }
       }
+      if (sent == 0 && finished < n_inputs) {
+         usleep(MERGE_WAIT_USLEEP);
+      }
+   }
 
-      #pragma omp barrier
+   if (finished == n_inputs) {
+      send_terminating_message();
+   }
+   free(data_out);
+}
 
-      if (!outage_flag){
-         #pragma omp critical (minimum)
-         {
-            if (actual_min_timestamp == 0 || actual_min_timestamp > rec_time){
-               actual_min_timestamp = rec_time;
-            } else {
-      //       sleep(rec_time - actual_min_timestamp);
-            }
+/**
+ * Timestamp-aware merge thread - sends records of all inputs ordered by timestamp.
+ * Records of each input are expected to be ordered. Record with minimal time from heads of all queues
+ * is sent when no other input can deliver an older one, i.e. every input has a record waiting in its
+ * queue, has already sent a newer record (watermark) or is idle or ended.
+ *
+ * @param [in] n_inputs Number of input links.
+ */
+void ta_merge_thread(int n_inputs)
+{
+   int ret, i;
+   int finished = 0;
+   int heap_cnt = 0;
+   void *data_out = NULL;
+   heap_item_t *heap = (heap_item_t *) malloc(n_inputs * sizeof(heap_item_t));
+
+   if (heap == NULL) {
+      fprintf(stderr, "Error: allocation of heap.\n");
+      stop = 1;
+      return;
+   }
+
+   while (!stop && finished < n_inputs) {
+      // Put heads of queues into heap
+      for (i = 0; i < n_inputs; i++) {
+         heap_item_t item;
+         if (inputs[i].in_heap || inputs[i].finished) {
+            continue;
+         }
+         ret = next_record(i, n_inputs, &item, &data_out);
+         if (ret < 0) {
+            stop = 1;
+            break;
+         } else if (ret > 0) {
+            item.time = record_time(i, item.rec);
+            heap_push(heap, &heap_cnt, item);
+            inputs[i].in_heap = 1;
+         } else if (inputs[i].finished) {
+            finished++;
          }
       }
+      if (stop || heap_cnt == 0) {
+         if (heap_cnt == 0 && finished < n_inputs) {
+            usleep(MERGE_WAIT_USLEEP);
+         }
+         continue;
+      }
 
-      #pragma omp barrier
-
-      if (!outage_flag){
-         if (actual_min_timestamp == rec_time){
-            ur_copy_fields(out_template, data_out, in_template[index], rec);
-            #pragma omp critical (sending)
-            {
-               ret = trap_send(0, data_out, ur_rec_size(out_template, data_out));
-
-               if (ret != TRAP_E_OK) {
-                  if (ret == TRAP_E_TERMINATED) {
-                     private_stop = 1; // Module was terminated while waiting for new data (e.g. by Ctrl-C)
-                     #pragma omp atomic
-                     --active_interfaces;
-                  } else {
-                     // Some error has occured
-                     if (verbose >= 0) {
-                        fprintf(stderr, "Error: trap_send() returned %i (%s)\n", ret, trap_last_error_msg);
-                        fprintf(stderr, "   Message skipped...\n");
-                     }
-                     read_next = 1;
-                  }
-               } else {
-                  read_next = 1;
-                  actual_min_timestamp = 0;
-               }
-            }
+      // Wait for inputs which may still deliver older record
+      for (i = 0; i < n_inputs; i++) {
+         if (!inputs[i].in_heap && !inputs[i].finished && !__atomic_load_n(&inputs[i].idle, __ATOMIC_RELAXED) &&
+             inputs[i].watermark < heap[0].time) {
+            break;
          }
       }
+      if (i < n_inputs) {
+         usleep(MERGE_WAIT_USLEEP);
+         continue;
+      }
+
+      inputs[heap[0].index].watermark = heap[0].time;
+      inputs[heap[0].index].in_heap = 0;
+      send_record(heap[0].index, heap[0].rec, heap[0].len, data_out);
+      rq_pop(&inputs[heap[0].index].queue);
+      heap_pop(heap, &heap_cnt);
+   }
+
+   if (finished == n_inputs) {
+      send_terminating_message();
+   }
+
+   free(data_out);
+   free(heap);
+}
+
+/**
+ * Compare records of reorder buffer by time, records with the same time keep order of arrival.
+ */
+static int reorder_rec_cmp(const void *a, const void *b)
+{
+   const reorder_rec_t *ra = *(const reorder_rec_t **) a;
+   const reorder_rec_t *rb = *(const reorder_rec_t **) b;
 
-      if (!active_interfaces){
-         trap_ifcctl(TRAPIFC_INPUT, index, TRAPCTL_SETTIMEOUT, timeout);
-//       usleep(INACTIVE_USLEEP_TIME);
-//       private_stop = 1;
+   if (ra->time != rb->time) {
+      return (ra->time < rb->time ? -1 : 1);
+   }
+   return (ra < rb ? -1 : (ra > rb));
+}
+
+/**
+ * Send records of bucket ordered by time and empty the bucket.
+ *
+ * @param [in,out] r Reorder buffer.
+ * @param [in,out] b Bucket.
+ * @param [in] data_out Output record.
+ * @return 0 on success, -1 on allocation error.
+ */
+static int reorder_flush_bucket(reorder_t *r, bucket_t *b, void *data_out)
+{
+   size_t pos;
+   uint32_t i;
+
+   if (b->cnt > r->sorted_size) {
+      reorder_rec_t **tmp = (reorder_rec_t **) realloc(r->sorted, b->cnt * sizeof(reorder_rec_t *));
+      if (tmp == NULL) {
+         fprintf(stderr, "Error: allocation of reorder buffer.\n");
+         return -1;
       }
-   } // end while(!stop && !private_stop)
+      r->sorted = tmp;
+      r->sorted_size = b->cnt;
+   }
 
-   if (verbose >= 1) {
-      printf("Thread %i exitting.\n", index);
+   for (pos = 0, i = 0; i < b->cnt; i++) {
+      r->sorted[i] = (reorder_rec_t *) (b->data + pos);
+      pos += sizeof(reorder_rec_t) + RQ_ALIGN(r->sorted[i]->len);
+   }
+   qsort(r->sorted, b->cnt, sizeof(reorder_rec_t *), reorder_rec_cmp);
+
+   for (i = 0; i < b->cnt && !stop; i++) {
+      send_record(r->sorted[i]->index, r->sorted[i] + 1, r->sorted[i]->len, data_out);
    }
+   b->used = 0;
+   b->cnt = 0;
+   return 0;
 }
 
 /**
- * Basic capture thread - handles data incomming from on one interface.
+ * Send all records of buckets with number lower than given one.
  *
- * @param [in] index Index of the given link.
+ * @param [in,out] r Reorder buffer.
+ * @param [in] until Number of the first bucket which is kept.
+ * @param [in] data_out Output record.
+ * @return 0 on success, -1 on allocation error.
  */
-void capture_thread(int index)
+static int reorder_release(reorder_t *r, uint64_t until, void *data_out)
 {
-   int private_stop = 0;
-   int ret, fail = 0;
-   const void *rec;
-   uint16_t rec_size;
-   void *data_out = NULL;
-   uint8_t data_fmt = TRAP_FMT_UNKNOWN;
-//   int timeout = initial_timeout;
+   uint64_t n = (until - r->release_num > REORDER_BUCKETS ? REORDER_BUCKETS : until - r->release_num);
 
-   if (verbose >= 1) {
-      printf("Thread %i started.\n", index);
+   // Buckets further than REORDER_BUCKETS from release_num are empty
+   for (uint64_t i = 0; i < n; i++) {
+      bucket_t *b = &r->buckets[(r->release_num + i) % REORDER_BUCKETS];
+      if (b->cnt > 0 && reorder_flush_bucket(r, b, data_out) != 0) {
+         return -1;
+      }
    }
+   r->release_num = until;
+   return 0;
+}
 
-//   trap_ifcctl(TRAPIFC_INPUT, index, TRAPCTL_SETTIMEOUT, timeout);
-   trap_ifcctl(TRAPIFC_INPUT, index, TRAPCTL_SETTIMEOUT, TRAP_WAIT);
+/**
+ * Insert record into reorder buffer, record older than already sent ones is sent immediately.
+ *
+ * @param [in,out] r Reorder buffer.
+ * @param [in] item Record and its time.
+ * @param [in] data_out Output record.
+ * @return 0 on success, -1 on allocation error.
+ */
+static int reorder_add(reorder_t *r, const heap_item_t *item, void *data_out)
+{
+   uint64_t num = item->time / r->width;
 
-   // Read data from input and log them to a file
-   while (!stop && !private_stop) {
-      if (verbose >= 2) {
-         printf("Thread %i: calling trap_recv()\n", index);
+   if (!r->started) {
+      r->started = 1;
+      r->release_num = (num > REORDER_BUCKETS / 2 ? num - REORDER_BUCKETS / 2 : 0);
+      r->max_num = num;
+   }
+   if (num < r->release_num) {
+      inputs[item->index].late++;
+      send_record(item->index, item->rec, item->len, data_out);
+      return 0;
+   }
+   if (num >= r->release_num + REORDER_BUCKETS && reorder_release(r, num - REORDER_BUCKETS + 1, data_out) != 0) {
+      return -1;
+   }
+
+   if (num > r->max_num) {
+      r->max_num = num;
+   }
+
+   bucket_t *b = &r->buckets[num % REORDER_BUCKETS];
+   size_t need = sizeof(reorder_rec_t) + RQ_ALIGN(item->len);
+   if (b->used + need > b->size) {
+      size_t size = (b->size == 0 ? 65536 : 2 * b->size);
+      while (size < b->used + need) {
+         size *= 2;
+      }
+      uint8_t *tmp = (uint8_t *) realloc(b->data, size);
+      if (tmp == NULL) {
+         fprintf(stderr, "Error: allocation of reorder buffer.\n");
+         return -1;
       }
-      // Receive data from index-th input interface, wait until data are available
+      b->data = tmp;
+      b->size = size;
+   }
 
-      ret = trap_recv(index, &rec, &rec_size);
-      //update output template
-      if (ret == TRAP_E_OK || ret == TRAP_E_FORMAT_CHANGED) {
-         if (ret == TRAP_E_FORMAT_CHANGED) {
-            const char *spec = NULL;
-            if (trap_get_data_fmt(TRAPIFC_INPUT, index, &data_fmt, &spec) != TRAP_E_OK) {
-               fprintf(stderr, "Data format was not loaded.");
-               return;
-            } else {
-               if (data_out != NULL) {
-                  free (data_out);
-                  data_out = NULL;
-               }
-               #pragma omp critical
-               {
-                  in_template[index] = ur_define_fields_and_update_template(spec, in_template[index]);
-                  if (in_template[index] == NULL) {
-                     fprintf(stderr, "Template could not be edited");
-                     fail = 1;
-                  } else {
-                     out_template = ur_expand_template(spec, out_template);
-                     char * spec_cpy = ur_template_string(out_template);
-                     if (spec_cpy == NULL) {
-                        fprintf(stderr, "Memory allocation problem.");
-                        fail = 1;
-                     }
-                     trap_set_data_fmt(0, TRAP_FMT_UNIREC, spec_cpy);
-                  }
-
-                  data_out = ur_create_record(out_template, UR_MAX_SIZE);
-                  if (data_out == NULL) {
-                     fprintf(stderr, "ERROR: Allocation of record\n");
-                     fail = 1;
-                  }               
-               }
-               if (fail == 1) {
-                  break;
-               }
-               memset(data_out, 0, UR_MAX_SIZE);
-            }
-         }
+   reorder_rec_t *rec = (reorder_rec_t *) (b->data + b->used);
+   rec->time = item->time;
+   rec->len = item->len;
+   rec->index = item->index;
+   memcpy(rec + 1, item->rec, item->len);
+   b->used += need;
+   b->cnt++;
+   return 0;
+}
 
-         if (verbose >= 2) {
-            printf("Thread %i: received %hu bytes of data\n", index, rec_size);
-         }
+/**
+ * Convert UniRec time interval to seconds.
+ */
+static double ur_time_to_sec(ur_time_t t)
+{
+   return ur_time_get_sec(t) + ur_time_get_msec(t) / 1000.0;
+}
+
+/**
+ * Print lag of inputs behind the newest received record.
+ *
+ * @param [in] n_inputs Number of input links.
+ * @param [in] max_time Time of the newest received record.
+ */
+static void print_lag(int n_inputs, ur_time_t max_time)
+{
+   for (int i = 0; i < n_inputs; i++) {
+      ur_time_t lag = (inputs[i].records > 0 && max_time > inputs[i].watermark ? max_time - inputs[i].watermark : 0);
+      printf("Input %i: records %lu, late %lu, lag %.3f s, max lag %.3f s%s\n", i,
+             (unsigned long) inputs[i].records, (unsigned long) inputs[i].late,
+             ur_time_to_sec(lag), ur_time_to_sec(inputs[i].max_lag),
+             (inputs[i].finished ? " (ended)" : (inputs[i].idle ? " (idle)" : "")));
+   }
+}
+
+/**
+ * Timestamp-aware merge thread with reorder window - sends records of all inputs ordered by timestamp
+ * with bounded lateness. Records are moved from queues into reorder buffer as they come and sent once
+ * the watermark passes them. Watermark is the newest received time minus the reorder window, or
+ * the oldest of the newest times of all inputs which are not idle, whichever is later.
+ * Records older than already sent ones (late) are sent immediately.
+ *
+ * @param [in] n_inputs Number of input links.
+ */
+void ta_reorder_thread(int n_inputs)
+{
+   int ret = 0, i, j;
+   int finished = 0;
+   void *data_out = NULL;
+   ur_time_t max_time = 0;
+   time_t last_print = time(NULL);
+   reorder_t r;
 
-         // Check size of received data
-         if (rec_size < ur_rec_fixlen_size(in_template[index])) {
-            if (rec_size <= 1) {
-               if (verbose >= 0) {
-                  printf("Interface %i received ending record, the interface will be closed.\n", index);
-               }
-               private_stop = 1;
-               if (--active_interfaces > 0){// Only last thread send terminating message.
-                  break;
-               } else {
-                  char dummy[1] = {0};
-                  trap_send(0, dummy, 1); // FIXME: zero-length messages doesn't work, send message of length 1
-                  break;
-               }
-            } else {
-               fprintf(stderr, "Error: data with wrong size received (expected size: >= %hu, received size: %hu)\n",
-                       ur_rec_fixlen_size(in_template[index]), rec_size);
+   memset(&r, 0, sizeof(r));
+   r.width = reorder_window / (REORDER_BUCKETS / 2) + 1;
+
+   while (!stop && finished < n_inputs) {
+      int received = 0;
+
+      // Move records from queues into reorder buffer
+      for (i = 0; i < n_inputs && !stop; i++) {
+         rec_queue_t *q = &inputs[i].queue;
+         if (inputs[i].finished) {
+            continue;
+         }
+         for (j = 0; j < SEND_BURST && !stop; j++) {
+            heap_item_t item;
+            uint16_t type;
+            uint32_t len;
+
+            // Buffered records of the input must be sent before its template changes
+            if (inputs[i].records > 0 && rq_peek(q, &type, &len) != NULL && type == RQ_FORMAT &&
+                r.max_num >= r.release_num && reorder_release(&r, r.max_num + 1, data_out) != 0) {
+               ret = -1;
                break;
             }
-         }
-      
-         ur_copy_fields(out_template, data_out, in_template[index], rec);
-
-         #pragma omp critical
-         {
-            ret = trap_send(0, data_out, ur_rec_size(out_template, data_out));
-            if (ret != TRAP_E_OK) {
-               if (ret == TRAP_E_TERMINATED) {
-                  private_stop = 1; // Module was terminated while waiting for new data (e.g. by Ctrl-C)
-               } else {
-                  // Some error has occured
-                  fprintf(stderr, "Error: trap_send() returned %i (%s)\n", ret, trap_last_error_msg);
-                  private_stop = 1;
-               }
+            if ((ret = next_record(i, n_inputs, &item, &data_out)) <= 0) {
+               break;
             }
-         } // end critical section
-      } else {
-         TRAP_DEFAULT_GET_DATA_ERROR_HANDLING(ret, continue, break);
+            item.time = record_time(i, item.rec);
+            if (item.time > inputs[i].watermark) {
+               inputs[i].watermark = item.time;
+            }
+            if (item.time > max_time) {
+               max_time = item.time;
+            }
+            inputs[i].records++;
+            ret = reorder_add(&r, &item, data_out);
+            rq_pop(q);
+            if (ret != 0) {
+               break;
+            }
+         }
+         received += j;
+         if (ret < 0) {
+            stop = 1;
+         } else if (ret == 0 && inputs[i].finished) {
+            finished++;
+         }
       }
-   } // end while(!stop && !private_stop)
 
-   if (verbose >= 1) {
-      printf("Thread %i exitting.\n", index);
+      // Compute watermark and send buckets older than it
+      ur_time_t low = 0;
+      int waiting = 0;
+      for (i = 0; i < n_inputs; i++) {
+         if (inputs[i].finished || __atomic_load_n(&inputs[i].idle, __ATOMIC_RELAXED)) {
+            continue;
+         }
+         if (!waiting || inputs[i].watermark < low) {
+            low = inputs[i].watermark;
+         }
+         waiting = 1;
+         if (inputs[i].records > 0 && max_time - inputs[i].watermark > inputs[i].max_lag) {
+            inputs[i].max_lag = max_time - inputs[i].watermark;
+         }
+      }
+      if (r.started && !stop) {
+         ur_time_t mark = (max_time > reorder_window ? max_time - reorder_window : 0);
+         uint64_t until = (waiting ? (low > mark ? low : mark) / r.width : max_time / r.width + 1);
+         if (until > r.release_num && reorder_release(&r, until, data_out) != 0) {
+            stop = 1;
+         }
+      }
+
+      if (verbose >= 1 && time(NULL) - last_print >= LAG_PRINT_INTERVAL) {
+         print_lag(n_inputs, max_time);
+         last_print = time(NULL);
+      }
+      if (received == 0 && finished < n_inputs) {
+         usleep(MERGE_WAIT_USLEEP);
+      }
    }
 
+   if (r.started && !stop && r.max_num >= r.release_num) {
+      reorder_release(&r, r.max_num + 1, data_out);
+   }
+   if (finished == n_inputs) {
+      send_terminating_message();
+   }
+   if (verbose >= 0) {
+      print_lag(n_inputs, max_time);
+   }
+
+   for (i = 0; i < REORDER_BUCKETS; i++) {
+      free(r.buckets[i].data);
+   }
+   free(r.sorted);
+   free(data_out);
 }
 
 int main(int argc, char **argv)
@@ -496,6 +884,9 @@ int main(int argc, char **argv)
          case 'T':
             mode=MODE_TIME_AWARE;
             break;
+         case 'W':
+            reorder_window = (ur_time_t) (atof(optarg) * 4294967296.0); // seconds to UniRec time
+            break;
          default:
             fprintf(stderr, "Error: Invalid arguments.\n");
             FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
@@ -585,15 +976,33 @@ Available types are: int8, int16, int32, int64, uint8, uint16, uint32, uint64, c
       printf("Initialization done.\n");
    }
 
-   active_interfaces = n_inputs;
+   inputs = (input_t *) calloc(n_inputs, sizeof(input_t));
+   if (inputs == NULL) {
+      fprintf(stderr, "Error: allocation of input queues.\n");
+      ret = -1;
+      goto exit;
+   }
+   for (int i = 0; i < n_inputs; i++) {
+      if (rq_init(&inputs[i].queue, QUEUE_SIZE) != 0) {
+         fprintf(stderr, "Error: allocation of input queues.\n");
+         ret = -1;
+         goto exit;
+      }
+   }
 
-    // ***** Start a thread for each interface *****
-   #pragma omp parallel num_threads(n_inputs)
+   // ***** Start a receive thread for each interface and one sending thread *****
+   omp_set_dynamic(0);
+   #pragma omp parallel num_threads(n_inputs + 1)
    {
-      if (mode == MODE_TIME_AWARE)
-         ta_capture_thread(omp_get_thread_num());
+      int thread = omp_get_thread_num();
+      if (thread < n_inputs)
+         receive_thread(thread, (mode == MODE_TIME_AWARE ? initial_timeout : TRAP_WAIT));
+      else if (mode == MODE_TIME_AWARE && reorder_window != 0)
+         ta_reorder_thread(n_inputs);
+      else if (mode == MODE_TIME_AWARE)
+         ta_merge_thread(n_inputs);
       else
-         capture_thread(omp_get_thread_num());
+         send_thread(n_inputs);
    }
 
    ret = 0;
@@ -612,6 +1021,12 @@ Available types are: int8, int16, int32, int64, uint8, uint16, uint32, uint64, c
 
 exit:
    // Do all necessary cleanup before exiting
+   if (inputs != NULL) {
+      for (int i = 0; i < n_inputs; i++) {
+         rq_free(&inputs[i].queue);
+      }
+      free(inputs);
+   }
    ur_finalize();
    TRAP_DEFAULT_FINALIZATION();
    FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
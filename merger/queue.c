@@ -0,0 +1,151 @@
+/**
+ * \file queue.c
+ * \brief Bounded single-producer single-consumer queue of variable-length records.
+ * \date 2016
+ */
+/*
+ * Copyright (C) 2016 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "queue.h"
+
+/**
+ * Allocate queue buffer.
+ *
+ * @param [out] q Queue to initialize.
+ * @param [in] size Size of buffer in bytes.
+ * @return 0 on success, -1 on allocation error.
+ */
+int rq_init(rec_queue_t *q, uint64_t size)
+{
+   q->size = size & ~7ULL;
+   q->write_pos = 0;
+   q->read_pos = 0;
+   q->buffer = (uint8_t *) malloc(q->size);
+   return (q->buffer == NULL ? -1 : 0);
+}
+
+/**
+ * Free queue buffer.
+ *
+ * @param [in] q Queue.
+ */
+void rq_free(rec_queue_t *q)
+{
+   free(q->buffer);
+   q->buffer = NULL;
+}
+
+/**
+ * Append entry to queue (producer side).
+ *
+ * @param [in] q Queue.
+ * @param [in] type Type of entry.
+ * @param [in] data Entry data.
+ * @param [in] len Length of data.
+ * @return 0 on success, -1 when there is not enough free space.
+ */
+int rq_push(rec_queue_t *q, uint16_t type, const void *data, uint32_t len)
+{
+   uint64_t w = q->write_pos;
+   uint64_t r = __atomic_load_n(&q->read_pos, __ATOMIC_ACQUIRE);
+   uint64_t need = sizeof(rq_hdr_t) + RQ_ALIGN(len);
+   uint64_t pos = w % q->size;
+   uint64_t skip = (q->size - pos < need ? q->size - pos : 0);
+   rq_hdr_t *hdr;
+
+   if (w + skip + need - r > q->size) {
+      return -1;
+   }
+
+   if (skip != 0) {
+      /* Entry does not fit before the end of buffer, start it at the beginning. */
+      hdr = (rq_hdr_t *) (q->buffer + pos);
+      hdr->type = RQ_PAD;
+      hdr->len = skip - sizeof(rq_hdr_t);
+      w += skip;
+      pos = 0;
+   }
+
+   hdr = (rq_hdr_t *) (q->buffer + pos);
+   hdr->type = type;
+   hdr->len = len;
+   memcpy(hdr + 1, data, len);
+
+   __atomic_store_n(&q->write_pos, w + need, __ATOMIC_RELEASE);
+   return 0;
+}
+
+/**
+ * Get the oldest entry of queue without removing it (consumer side).
+ *
+ * @param [in] q Queue.
+ * @param [out] type Type of entry.
+ * @param [out] len Length of entry data.
+ * @return Pointer to entry data valid until rq_pop() or NULL when queue is empty.
+ */
+const void *rq_peek(rec_queue_t *q, uint16_t *type, uint32_t *len)
+{
+   uint64_t r = q->read_pos;
+   uint64_t w = __atomic_load_n(&q->write_pos, __ATOMIC_ACQUIRE);
+
+   while (r != w) {
+      const rq_hdr_t *hdr = (const rq_hdr_t *) (q->buffer + r % q->size);
+      if (hdr->type != RQ_PAD) {
+         *type = hdr->type;
+         *len = hdr->len;
+         return hdr + 1;
+      }
+      r += sizeof(rq_hdr_t) + hdr->len;
+      __atomic_store_n(&q->read_pos, r, __ATOMIC_RELEASE);
+   }
+   return NULL;
+}
+
+/**
+ * Remove the oldest entry returned by rq_peek() (consumer side).
+ *
+ * @param [in] q Queue.
+ */
+void rq_pop(rec_queue_t *q)
+{
+   const rq_hdr_t *hdr = (const rq_hdr_t *) (q->buffer + q->read_pos % q->size);
+
+   __atomic_store_n(&q->read_pos, q->read_pos + sizeof(rq_hdr_t) + RQ_ALIGN(hdr->len), __ATOMIC_RELEASE);
+}
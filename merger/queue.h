@@ -0,0 +1,85 @@
+/**
+ * \file queue.h
+ * \brief Bounded single-producer single-consumer queue of variable-length records.
+ * \date 2016
+ */
+/*
+ * Copyright (C) 2016 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stdint.h>
+
+#define RQ_ALIGN(x) (((x) + 7) & ~7U) /**< Entries are aligned to 8 bytes. */
+#define RQ_CACHE_LINE 64
+
+/* Types of queue entries. */
+#define RQ_PAD    0 /**< Unused space at the end of buffer (internal). */
+#define RQ_DATA   1 /**< UniRec record. */
+#define RQ_FORMAT 2 /**< New data format specifier (null terminated string). */
+#define RQ_END    3 /**< Input has ended, no more entries follow. */
+
+/**
+ * \brief Header of queue entry, entry data follow.
+ */
+typedef struct rq_hdr_s {
+   uint32_t len;     /**< Length of data. */
+   uint16_t type;    /**< Type of entry. */
+   uint16_t reserved;
+} rq_hdr_t;
+
+/**
+ * \brief Queue of records passed from one thread to another without locks.
+ *
+ * Producer owns write_pos and consumer owns read_pos, each of them is only read by the other
+ * thread. Positions are logical offsets growing from 0, they are mapped to the buffer by modulo.
+ */
+typedef struct rec_queue_s {
+   uint8_t *buffer;
+   uint64_t size;
+   uint64_t write_pos __attribute__((aligned(RQ_CACHE_LINE)));
+   uint64_t read_pos __attribute__((aligned(RQ_CACHE_LINE)));
+} rec_queue_t;
+
+int rq_init(rec_queue_t *q, uint64_t size);
+void rq_free(rec_queue_t *q);
+int rq_push(rec_queue_t *q, uint16_t type, const void *data, uint32_t len);
+const void *rq_peek(rec_queue_t *q, uint16_t *type, uint32_t *len);
+void rq_pop(rec_queue_t *q);
+
+#endif
@@ -219,6 +219,119 @@ struct ast *newString(char *column, char *cmp, char *s)
    return (struct ast *) newast;
 }
 
+struct ip_set *newIPList(struct ip_set *set, char *prefix)
+{
+   if (set == NULL) {
+      set = ip_set_create();
+   }
+   if (set != NULL) {
+      ip_set_add(set, prefix);
+   }
+   free(prefix);
+   return set;
+}
+
+struct ast *newIPSet(char *column, struct ip_set *set, char *file)
+{
+   // Filter with set which could not be loaded is invalid, it would silently match nothing
+   if (file != NULL && (set = ip_set_create()) != NULL && ip_set_load(set, file) != 0) {
+      ip_set_free(set);
+      free(column);
+      free(file);
+      return NULL;
+   }
+
+   struct ipset *newast = (struct ipset *) malloc(sizeof(struct ipset));
+   newast->type = NODE_T_IP_SET;
+   newast->column = column;
+   newast->file = file;
+
+   if (set == NULL) {
+      set = ip_set_create();
+   }
+   if (set != NULL) {
+      ip_set_finish(set);
+   }
+   newast->set = set;
+
+   int id = ur_get_id_by_name(column);
+   if (id == UR_E_INVALID_NAME) {
+      printf("Warning: %s is not present in input format.\n", column);
+      newast->id = UR_INVALID_FIELD;
+   } else {
+      newast->id = id;
+   }
+   if (ur_get_type(newast->id) != UR_TYPE_IP) {
+      printf("Warning: Type of %s is not IP address.\n", column);
+   }
+   return (struct ast *) newast;
+}
+
+struct str_set *newStrList(struct str_set *set, char *s)
+{
+   if (set == NULL) {
+      set = str_set_create();
+   }
+   if (set != NULL) {
+      str_set_add(set, s);
+   }
+   free(s);
+   return set;
+}
+
+struct ast *newStrSet(char *column, char *cmp, struct str_set *set, char *file)
+{
+   // Filter with set which could not be loaded is invalid, it would silently match nothing
+   if (file != NULL && (set = str_set_create()) != NULL && str_set_load(set, file) != 0) {
+      str_set_free(set);
+      free(column);
+      free(cmp);
+      free(file);
+      return NULL;
+   }
+
+   struct strset *newast = (struct strset *) malloc(sizeof(struct strset));
+   newast->type = NODE_T_STR_SET;
+   newast->column = column;
+   newast->file = file;
+
+   // Set without operator is a set of exact strings
+   newast->cmp = (cmp != NULL ? get_op_type(cmp) : OP_EQ);
+   free(cmp);
+   if (newast->cmp != OP_EQ && newast->cmp != OP_NE && newast->cmp != OP_RE) {
+      printf("Warning: Operator is not supported for set of strings.\n");
+      newast->cmp = OP_INVALID;
+   }
+
+   if (set == NULL) {
+      set = str_set_create();
+   }
+   if (set != NULL && str_set_finish(set, newast->cmp == OP_RE) != 0) {
+      str_set_free(set);
+      set = NULL;
+   }
+   newast->set = set;
+
+   int id = ur_get_id_by_name(column);
+   if (id == UR_E_INVALID_NAME) {
+      printf("Warning: %s is not present in input format.\n", column);
+      newast->id = UR_INVALID_FIELD;
+   } else {
+      newast->id = id;
+   }
+   return (struct ast *) newast;
+}
+
+struct ast *newFileSet(char *column, char *file)
+{
+   // Type of set in file is given by type of field
+   int id = ur_get_id_by_name(column);
+   if (id != UR_E_INVALID_NAME && (ur_get_type(id) == UR_TYPE_STRING || ur_get_type(id) == UR_TYPE_BYTES)) {
+      return newStrSet(column, NULL, NULL, file);
+   }
+   return newIPSet(column, NULL, file);
+}
+
 struct ast *newBrack(struct ast *b)
 {
    struct brack *newast = (struct brack *) malloc(sizeof(struct brack));
@@ -373,6 +486,37 @@ void printAST(struct ast *ast)
       }
       printf("\"%s\"", ((struct str*) ast)->s);
       break;
+   case NODE_T_IP_SET:
+      printf("%s in ", ((struct ipset*) ast)->column);
+      if (((struct ipset*) ast)->file != NULL) {
+         printf("file:%s ", ((struct ipset*) ast)->file);
+      }
+      if (((struct ipset*) ast)->set != NULL) {
+         printf("[%u IPv4 and %u IPv6 ranges]", ((struct ipset*) ast)->set->n_v4, ((struct ipset*) ast)->set->n_v6);
+      }
+      break;
+   case NODE_T_STR_SET:
+      printf("%s", ((struct strset*) ast)->column);
+      switch (((struct strset*) ast)->cmp) {
+      case (OP_EQ):
+         printf(" in ");
+         break;
+      case (OP_NE):
+         printf(" != ");
+         break;
+      case (OP_RE):
+         printf(" =~ ");
+         break;
+      default:
+         printf(" <invalid operator> ");
+      }
+      if (((struct strset*) ast)->file != NULL) {
+         printf("file:%s ", ((struct strset*) ast)->file);
+      }
+      if (((struct strset*) ast)->set != NULL) {
+         printf("{%u %s}", ((struct strset*) ast)->set->n, (((struct strset*) ast)->cmp == OP_RE ? "patterns" : "strings"));
+      }
+      break;
    case NODE_T_BRACKET:
       printf("( ");
       printAST(((struct brack*) ast)->b);
@@ -421,6 +565,16 @@ void freeAST(struct ast *ast)
       }
       ((struct str*) ast)->s = NULL;
       break;
+   case NODE_T_IP_SET:
+      free(((struct ipset*) ast)->column);
+      free(((struct ipset*) ast)->file);
+      ip_set_free(((struct ipset*) ast)->set);
+      break;
+   case NODE_T_STR_SET:
+      free(((struct strset*) ast)->column);
+      free(((struct strset*) ast)->file);
+      str_set_free(((struct strset*) ast)->set);
+      break;
    case NODE_T_BRACKET:
    case NODE_T_NEGATION:
       freeAST(((struct brack*) ast)->b);
@@ -430,178 +584,6 @@ void freeAST(struct ast *ast)
 }
 
 
-int compareUnsigned(uint64_t a, uint64_t b, cmp_op op) {
-   switch (op) {
-      case OP_LE:
-         return a <= b;
-      case OP_LT:
-         return a < b;
-      case OP_NE:
-         return a != b;
-      case OP_GE:
-         return a >= b;
-      case OP_GT:
-         return a > b;
-      case OP_EQ:
-         return a == b;
-      default:
-         fprintf(stderr, "Warning: Invalid comparisson operator.\n");
-         return 0;
-   }
-   return 0;
-}
-
-int compareSigned(int64_t a, int64_t b, cmp_op op) {
-   switch (op) {
-      case OP_LE:
-         return a <= b;
-      case OP_LT:
-         return a < b;
-      case OP_NE:
-         return a != b;
-      case OP_GE:
-         return a >= b;
-      case OP_GT:
-         return a > b;
-      case OP_EQ:
-         return a == b;
-      default:
-         fprintf(stderr, "Warning: Invalid comparisson operator.\n");
-         return 0;
-   }
-   return 0;
-}
-
-int compareFloating(double a, double b, cmp_op op) {
-   double EPS = 1e-8;
-   switch (op) {
-      case OP_LE:
-         return a <= b;
-      case OP_LT:
-         return a < b;
-      case OP_NE:
-         return a != b;
-      case OP_GE:
-         return a >= b;
-      case OP_GT:
-         return a > b;
-      case OP_EQ:
-         return abs(a - b) < EPS;
-      default:
-         fprintf(stderr, "Warning: Invalid comparisson operator.\n");
-         return 0;
-   }
-   return 0;
-}
-
-int evalAST(struct ast *ast, const ur_template_t *in_tmplt, const void *in_rec)
-{
-   size_t size;
-   char *expr;
-   int is_equal;
-
-   if (!ast) {
-      return 0; // NULL
-   }
-   switch (ast->type) {
-   case NODE_T_AST:
-      if (ast->operator == OP_NOP) {
-         return evalAST(ast->l, in_tmplt, in_rec);
-      } else if (ast->operator == OP_OR) {
-         return (evalAST(ast->l, in_tmplt, in_rec) || evalAST(ast->r, in_tmplt, in_rec) ? 1 : 0);
-      } else if (ast->operator == OP_AND) {
-         return (evalAST(ast->l, in_tmplt, in_rec) && evalAST(ast->r, in_tmplt, in_rec) ? 1 : 0);
-      }
-   case NODE_T_EXPRESSION:
-      if (((struct expression*) ast)->id == UR_INVALID_FIELD) {
-         return 0;
-      }
-      int type = ur_get_type(((struct expression*) ast)->id);
-      switch (type) {
-      case UR_TYPE_UINT8:
-         return compareSigned(*(uint8_t *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct expression*) ast)->id)), ((struct expression*) ast)->number, ((struct expression*) ast)->cmp);
-      case UR_TYPE_INT8:
-         return compareUnsigned(*(int8_t *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct expression*) ast)->id)), ((struct expression*) ast)->number, ((struct expression*) ast)->cmp);
-      case UR_TYPE_INT16:
-         return compareSigned(*(int16_t *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct expression*) ast)->id)), ((struct expression*) ast)->number, ((struct expression*) ast)->cmp);
-      case UR_TYPE_UINT16:
-         return compareUnsigned(*(uint16_t *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct expression*) ast)->id)), ((struct expression*) ast)->number, ((struct expression*) ast)->cmp);
-      case UR_TYPE_INT32:
-         return compareSigned(*(int32_t *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct expression*) ast)->id)), ((struct expression*) ast)->number, ((struct expression*) ast)->cmp);
-      case UR_TYPE_UINT32:
-         return compareUnsigned(*(uint32_t *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct expression*) ast)->id)), ((struct expression*) ast)->number, ((struct expression*) ast)->cmp);
-      case UR_TYPE_INT64:
-         return compareSigned(*(int64_t *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct expression*) ast)->id)), ((struct expression*) ast)->number, ((struct expression*) ast)->cmp);
-      case UR_TYPE_UINT64:
-         return compareUnsigned(*(uint64_t *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct expression*) ast)->id)), ((struct expression*) ast)->number, ((struct expression*) ast)->cmp);
-      }
-      return 0;
-   case NODE_T_EXPRESSION_FP:
-      if (((struct expression*) ast)->id == UR_INVALID_FIELD) {
-         return 0;
-      }
-      return compareFloating(*(double *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct expression_fp*) ast)->id)), ((struct expression_fp*) ast)->number, ((struct expression_fp*) ast)->cmp);
-   case NODE_T_IP:
-      if (((struct ip*) ast)->id == UR_INVALID_FIELD) {
-         return 0;
-      }
-      int cmp_res = ip_cmp((ip_addr_t *) (ur_get_ptr_by_id(in_tmplt, in_rec, ((struct ip*) ast)->id)), &(((struct ip*) ast)->ipAddr));
-      cmp_op cmp = ((struct ip*) ast)->cmp;
-
-      if (cmp_res == 0) {
-      // Same addresses
-         return cmp == OP_EQ || cmp == OP_LE || cmp == OP_GE;
-      } else if (cmp_res < 0) {
-       // Address in record is lower than the given one
-         return cmp == OP_NE || cmp == OP_LT || cmp == OP_LE;
-      } else {
-      // Address in record is higher than the given one
-         return cmp == OP_NE || cmp == OP_GT || cmp == OP_GE;
-      }
-   case NODE_T_STRING:
-      size = ur_get_var_len(in_tmplt, in_rec, ((struct str*) ast)->id); // only relevant for strings
-      expr = (char *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct str*) ast)->id));
-
-      if (((struct str*) ast)->id == UR_INVALID_FIELD) {
-         return 0;
-      }
-      // char
-      if (ur_get_type(((struct str*) ast)->id) == UR_TYPE_CHAR) {
-         // boolean value - record matches filter
-         is_equal = (strlen(((struct str*) ast)->s) == 1 && *(((struct str*) ast)->s) == *expr);
-         // return value depending on used operator (1 and OP_EQ || 0 and OP_NE)
-         return is_equal == (((struct str*) ast)->cmp == OP_EQ);
-      } else { // string
-         if (((struct str*) ast)->cmp == OP_RE) {
-
-            memcpy(str_buffer, expr, size);
-            str_buffer[size] = '\0';
-
-            if (regexec(&((struct str*) ast)->re, str_buffer, 0, NULL, 0) == REG_NOMATCH) {
-               // string does not match regular expression
-               return 0;
-            } else {
-               // match
-               return 1;
-            }
-         } else {
-            // boolean value - record matches filter
-            // strings are the same in size & content (size comparisson necessary for zero-sized strings)
-            is_equal = (strlen(((struct str*) ast)->s) == size && strncmp(((struct str*) ast)->s, expr, size) == 0);
-            // return value depending on used operator (1 and OP_EQ || 0 and OP_NE)
-            return is_equal == (((struct str*) ast)->cmp == OP_EQ);
-         }
-      }
-   case NODE_T_BRACKET:
-      return evalAST(((struct brack*) ast)->b, in_tmplt, in_rec);
-   case NODE_T_NEGATION:
-      return ! evalAST(((struct brack*) ast)->b, in_tmplt, in_rec);
-   default:
-      fprintf(stderr, "Warning: Unknown node type.\n");
-      return 0;
-   }
-}
-
 void changeProtocol(struct ast **ast)
 {
    int protocol = 0;
@@ -635,7 +617,9 @@ void changeProtocol(struct ast **ast)
       *ast = newExpression(retezec, cmp, protocol, 0);
       return;
    case NODE_T_IP:
+   case NODE_T_IP_SET:
    case NODE_T_STRING:
+   case NODE_T_STR_SET:
    case NODE_T_NEGATION:
       return;
    case NODE_T_BRACKET:
@@ -11,6 +11,11 @@
     struct ast *newExpressionFP(char *column, char *cmp, double number);
     struct ast *newIP(char *column, char *cmp, char *ip);
     struct ast *newString(char *column, char *cmp, char *s);
+    struct ast *newIPSet(char *column, struct ip_set *set, char *file);
+    struct ip_set *newIPList(struct ip_set *set, char *prefix);
+    struct ast *newStrSet(char *column, char *cmp, struct str_set *set, char *file);
+    struct str_set *newStrList(struct str_set *set, char *s);
+    struct ast *newFileSet(char *column, char *file);
     struct ast *newProtocol(char *cmp, char *data);
     struct ast *newBrack(struct ast *b);
     struct ast *newNegation(struct ast *b);
@@ -25,6 +30,8 @@
     int64_t number;
     double floating;
     struct ast* ast;
+    struct ip_set *ipset;
+    struct str_set *strset;
 }
 
 %token <number> SIGNED
@@ -36,8 +43,11 @@
 %token <string> VAL
 %token <string> IP
 %token <string> STRING
+%token <string> PREFIX
+%token <string> FILENAME
 %token AND OR
 %token LEFT RIGHT PROTOCOL
+%token IN LSQUARE RSQUARE LBRACE RBRACE COMMA
 %token END
 
 %right OR
@@ -45,6 +55,8 @@
 %right NOT
 
 %type <ast> exp explist
+%type <ipset> iplist
+%type <strset> strlist
 %start body
 %%
 
@@ -70,10 +82,27 @@ exp:
     | COLUMN EQ SIGNED { $$ = newExpression($1, $2, $3, 1); }
     | COLUMN EQ UNSIGNED { $$ = newExpression($1, $2, $3, 0); }
     | COLUMN EQ FLOAT { $$ = newExpressionFP($1, $2, $3); }
+    | COLUMN IN LSQUARE iplist RSQUARE { $$ = newIPSet($1, $4, NULL); }
+    | COLUMN IN FILENAME { if (($$ = newFileSet($1, $3)) == NULL) YYABORT; }
+    | COLUMN IN LBRACE strlist RBRACE { $$ = newStrSet($1, NULL, $4, NULL); }
+    | COLUMN EQ LBRACE strlist RBRACE { $$ = newStrSet($1, $2, $4, NULL); }
+    | COLUMN EQ FILENAME { if (($$ = newStrSet($1, $2, NULL, $3)) == NULL) YYABORT; }
     | NOT explist {$$ = (struct ast *) newNegation($2);}
     | LEFT explist RIGHT { $$ = (struct ast *) newBrack($2); }
     ;
 
+iplist:
+    IP { $$ = newIPList(NULL, $1); }
+    | PREFIX { $$ = newIPList(NULL, $1); }
+    | iplist COMMA IP { $$ = newIPList($1, $3); }
+    | iplist COMMA PREFIX { $$ = newIPList($1, $3); }
+    ;
+
+strlist:
+    STRING { $$ = newStrList(NULL, $1); }
+    | strlist COMMA STRING { $$ = newStrList($1, $3); }
+    ;
+
 %%
 
 
@@ -0,0 +1,283 @@
+/**
+ * \file ipset.c
+ * \brief Sets of IP prefixes used by filter (sorted intervals of addresses).
+ * \date 2016
+ */
+/*
+ * Copyright (C) 2016 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include "unirecfilter.h"
+
+#define IPSET_LINE_SIZE 1024 // Maximal length of line of file with prefixes
+
+struct ip_set *ip_set_create()
+{
+   struct ip_set *set = (struct ip_set *) calloc(1, sizeof(struct ip_set));
+   if (set == NULL) {
+      fprintf(stderr, "Error: Not enough memory for set of IP prefixes.\n");
+   }
+   return set;
+}
+
+void ip_set_free(struct ip_set *set)
+{
+   if (set == NULL) {
+      return;
+   }
+   free(set->v4);
+   free(set->v6);
+   free(set);
+}
+
+// IPv6 address as two numbers in host byte order, [0] is the upper half
+static inline void ip_to_u128(const ip_addr_t *ip, uint64_t *a)
+{
+   a[0] = be64toh(ip->ui64[0]);
+   a[1] = be64toh(ip->ui64[1]);
+}
+
+static inline int cmp_u128(const uint64_t *a, const uint64_t *b)
+{
+   if (a[0] != b[0]) {
+      return (a[0] < b[0] ? -1 : 1);
+   }
+   if (a[1] != b[1]) {
+      return (a[1] < b[1] ? -1 : 1);
+   }
+   return 0;
+}
+
+/**
+ * \brief Add IP address or prefix to set.
+ * \param[in] set Set of prefixes.
+ * \param[in] str Address or prefix in CIDR notation (e.g. 10.0.0.0/8, 2001:db8::/32).
+ * \return 0 on success, 1 if prefix is not valid, -1 on memory allocation error.
+ */
+int ip_set_add(struct ip_set *set, const char *str)
+{
+   char addr[64];
+   const char *slash = strchr(str, '/');
+   size_t len = (slash != NULL ? (size_t) (slash - str) : strlen(str));
+   int prefix_len = -1;
+   ip_addr_t ip;
+
+   if (len >= sizeof(addr)) {
+      printf("Warning: %s is not a valid IP prefix.\n", str);
+      return 1;
+   }
+   memcpy(addr, str, len);
+   addr[len] = '\0';
+   if (slash != NULL) {
+      char *end;
+      prefix_len = strtol(slash + 1, &end, 10);
+      if (end == slash + 1 || *end != '\0' || prefix_len < 0) {
+         prefix_len = 129;
+      }
+   }
+   if (!ip_from_str(addr, &ip) || prefix_len > (ip_is4(&ip) ? 32 : 128)) {
+      printf("Warning: %s is not a valid IP prefix.\n", str);
+      return 1;
+   }
+
+   if (ip_is4(&ip)) {
+      uint32_t mask = (prefix_len == 0 ? 0 : 0xffffffffU << (32 - (prefix_len < 0 ? 32 : prefix_len)));
+      if (set->n_v4 == set->size_v4) {
+         uint32_t size = (set->size_v4 ? 2 * set->size_v4 : 16);
+         struct ip_range4 *v4 = (struct ip_range4 *) realloc(set->v4, size * sizeof(*v4));
+         if (v4 == NULL) {
+            fprintf(stderr, "Error: Not enough memory for set of IP prefixes.\n");
+            return -1;
+         }
+         set->v4 = v4;
+         set->size_v4 = size;
+      }
+      set->v4[set->n_v4].low = ip_get_v4_as_int(&ip) & mask;
+      set->v4[set->n_v4].high = set->v4[set->n_v4].low | ~mask;
+      set->n_v4++;
+   } else {
+      uint64_t a[2], mask[2];
+      if (prefix_len < 0) {
+         prefix_len = 128;
+      }
+      mask[0] = (prefix_len == 0 ? 0 : (prefix_len >= 64 ? ~0ULL : ~0ULL << (64 - prefix_len)));
+      mask[1] = (prefix_len <= 64 ? 0 : ~0ULL << (128 - prefix_len));
+      if (set->n_v6 == set->size_v6) {
+         uint32_t size = (set->size_v6 ? 2 * set->size_v6 : 16);
+         struct ip_range6 *v6 = (struct ip_range6 *) realloc(set->v6, size * sizeof(*v6));
+         if (v6 == NULL) {
+            fprintf(stderr, "Error: Not enough memory for set of IP prefixes.\n");
+            return -1;
+         }
+         set->v6 = v6;
+         set->size_v6 = size;
+      }
+      ip_to_u128(&ip, a);
+      set->v6[set->n_v6].low[0] = a[0] & mask[0];
+      set->v6[set->n_v6].low[1] = a[1] & mask[1];
+      set->v6[set->n_v6].high[0] = a[0] | ~mask[0];
+      set->v6[set->n_v6].high[1] = a[1] | ~mask[1];
+      set->n_v6++;
+   }
+   return 0;
+}
+
+/**
+ * \brief Load prefixes from file - whitespace or comma separated, lines may contain comments starting with #.
+ * \param[in] set Set of prefixes.
+ * \param[in] filename Name of file.
+ * \return 0 on success, -1 on error.
+ */
+int ip_set_load(struct ip_set *set, const char *filename)
+{
+   char line[IPSET_LINE_SIZE];
+   FILE *f = fopen(filename, "r");
+
+   if (f == NULL) {
+      fprintf(stderr, "Error: File %s could not be opened.\n", filename);
+      return -1;
+   }
+   while (fgets(line, sizeof(line), f) != NULL) {
+      char *token, *save = NULL;
+      char *comment = strchr(line, '#');
+      if (comment != NULL) {
+         *comment = '\0';
+      }
+      for (token = strtok_r(line, " \t\r\n,", &save); token != NULL; token = strtok_r(NULL, " \t\r\n,", &save)) {
+         if (ip_set_add(set, token) < 0) {
+            fclose(f);
+            return -1;
+         }
+      }
+   }
+   fclose(f);
+   return 0;
+}
+
+static int cmp_range4(const void *a, const void *b)
+{
+   const struct ip_range4 *x = (const struct ip_range4 *) a;
+   const struct ip_range4 *y = (const struct ip_range4 *) b;
+   return (x->low > y->low) - (x->low < y->low);
+}
+
+static int cmp_range6(const void *a, const void *b)
+{
+   return cmp_u128(((const struct ip_range6 *) a)->low, ((const struct ip_range6 *) b)->low);
+}
+
+/**
+ * \brief Sort ranges of set and merge overlapping and adjacent ones, must be called before lookups.
+ */
+void ip_set_finish(struct ip_set *set)
+{
+   uint32_t i, n;
+
+   qsort(set->v4, set->n_v4, sizeof(*set->v4), cmp_range4);
+   for (i = 1, n = (set->n_v4 ? 1 : 0); i < set->n_v4; i++) {
+      struct ip_range4 *last = &set->v4[n - 1];
+      if (last->high == 0xffffffffU || set->v4[i].low <= last->high + 1) {
+         if (set->v4[i].high > last->high) {
+            last->high = set->v4[i].high;
+         }
+      } else {
+         set->v4[n++] = set->v4[i];
+      }
+   }
+   set->n_v4 = n;
+
+   qsort(set->v6, set->n_v6, sizeof(*set->v6), cmp_range6);
+   for (i = 1, n = (set->n_v6 ? 1 : 0); i < set->n_v6; i++) {
+      struct ip_range6 *last = &set->v6[n - 1];
+      // Next address after the last range
+      uint64_t next[2] = { last->high[0] + (last->high[1] == ~0ULL), last->high[1] + 1 };
+      if ((last->high[0] == ~0ULL && last->high[1] == ~0ULL) || cmp_u128(set->v6[i].low, next) <= 0) {
+         if (cmp_u128(set->v6[i].high, last->high) > 0) {
+            memcpy(last->high, set->v6[i].high, sizeof(last->high));
+         }
+      } else {
+         set->v6[n++] = set->v6[i];
+      }
+   }
+   set->n_v6 = n;
+}
+
+/**
+ * \brief Check whether set contains IP address, binary search in sorted disjoint ranges.
+ */
+int ip_set_contains(const struct ip_set *set, const ip_addr_t *ip)
+{
+   uint32_t l, r;
+
+   if (ip_is4((ip_addr_t *) ip)) {
+      uint32_t a = ip_get_v4_as_int((ip_addr_t *) ip);
+      // Find the last range with low <= a
+      for (l = 0, r = set->n_v4; l < r; ) {
+         uint32_t m = l + (r - l) / 2;
+         if (set->v4[m].low <= a) {
+            l = m + 1;
+         } else {
+            r = m;
+         }
+      }
+      return l > 0 && a <= set->v4[l - 1].high;
+   } else {
+      uint64_t a[2];
+      ip_to_u128(ip, a);
+      for (l = 0, r = set->n_v6; l < r; ) {
+         uint32_t m = l + (r - l) / 2;
+         if (cmp_u128(set->v6[m].low, a) <= 0) {
+            l = m + 1;
+         } else {
+            r = m;
+         }
+      }
+      return l > 0 && cmp_u128(a, set->v6[l - 1].high) <= 0;
+   }
+}
+
+/**
+ * \brief Check whether two (finished) sets contain the same addresses.
+ */
+int ip_set_equal(const struct ip_set *a, const struct ip_set *b)
+{
+   return a->n_v4 == b->n_v4 && a->n_v6 == b->n_v6 &&
+          (a->n_v4 == 0 || memcmp(a->v4, b->v4, a->n_v4 * sizeof(*a->v4)) == 0) &&
+          (a->n_v6 == 0 || memcmp(a->v6, b->v6, a->n_v6 * sizeof(*a->v6)) == 0);
+}
@@ -0,0 +1,649 @@
+/**
+ * \file program.c
+ * \brief Compilation of filter into linear program evaluated for each record.
+ * \date 2016
+ */
+/*
+ * Copyright (C) 2016 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "unirecfilter.h"
+#include "fields.h"
+
+#define FP_EPS 1e-8 // Floating point numbers closer than this are equal
+
+// Masks of accepted results of comparison (bit 0 - lower, bit 1 - equal, bit 2 - greater)
+static const uint8_t cmp_mask[] = {
+   [OP_EQ] = 0x2,
+   [OP_NE] = 0x5,
+   [OP_LT] = 0x1,
+   [OP_LE] = 0x3,
+   [OP_GT] = 0x4,
+   [OP_GE] = 0x6,
+   [OP_RE] = 0x2,
+   [OP_INVALID] = 0x0
+};
+
+/* Operations of nodes of combined graph of all filters */
+enum { DAG_TEST, DAG_AND, DAG_OR, DAG_NOT };
+
+/**
+ * Node of combined graph of all filters, equal subexpressions are represented by one node.
+ */
+struct dag_node {
+   int op;
+   uint32_t a;             // Index of test or of the first operand
+   uint32_t b;             // Index of the second operand
+   uint32_t refs;          // Number of references from other nodes and outputs
+   int32_t slot;           // Slot for result of shared node (-1 if the node is not shared)
+};
+
+/**
+ * Program being compiled, arrays grow as needed.
+ */
+struct compiler {
+   struct filter_program *prog;
+   uint32_t tests_size;
+   uint32_t code_size;
+   struct dag_node *nodes;
+   uint32_t n_nodes;
+   uint32_t nodes_size;
+};
+
+static int emit(struct compiler *c, insn_op op, uint32_t arg)
+{
+   struct filter_program *prog = c->prog;
+
+   if (prog->n_code == c->code_size) {
+      uint32_t size = (c->code_size ? 2 * c->code_size : 16);
+      struct filter_insn *code = (struct filter_insn *) realloc(prog->code, size * sizeof(*code));
+      if (code == NULL) {
+         return -1;
+      }
+      prog->code = code;
+      c->code_size = size;
+   }
+   prog->code[prog->n_code].op = op;
+   prog->code[prog->n_code].arg = arg;
+   prog->code[prog->n_code].target = 0;
+   return prog->n_code++;
+}
+
+static struct filter_test *new_test(struct compiler *c)
+{
+   struct filter_program *prog = c->prog;
+
+   if (prog->n_tests == c->tests_size) {
+      uint32_t size = (c->tests_size ? 2 * c->tests_size : 16);
+      struct filter_test *tests = (struct filter_test *) realloc(prog->tests, size * sizeof(*tests));
+      if (tests == NULL) {
+         return NULL;
+      }
+      prog->tests = tests;
+      c->tests_size = size;
+   }
+   struct filter_test *test = &prog->tests[prog->n_tests];
+   memset(test, 0, sizeof(*test));
+   return test;
+}
+
+/**
+ * Check that field of the leaf is present in input template.
+ */
+static int field_present(const ur_template_t *tmplt, ur_field_id_t id)
+{
+   return id != UR_INVALID_FIELD && ur_is_present(tmplt, id);
+}
+
+/**
+ * Resolve type and offset of field of one leaf of syntax tree.
+ * Leaves which can never match (unknown field, unsupported type) are compiled as TEST_FALSE.
+ */
+static void compile_test(struct filter_test *test, struct ast *ast, const ur_template_t *tmplt)
+{
+   test->kind = TEST_FALSE;
+
+   switch (ast->type) {
+   case NODE_T_EXPRESSION: {
+      struct expression *e = (struct expression *) ast;
+      if (!field_present(tmplt, e->id)) {
+         return;
+      }
+      test->id = e->id;
+      test->mask = cmp_mask[e->cmp];
+      test->val.i = e->number;
+      switch (ur_get_type(e->id)) {
+      case UR_TYPE_UINT8:
+         test->kind = TEST_UINT8;
+         break;
+      case UR_TYPE_UINT16:
+         test->kind = TEST_UINT16;
+         break;
+      case UR_TYPE_UINT32:
+         test->kind = TEST_UINT32;
+         break;
+      case UR_TYPE_UINT64:
+         test->kind = TEST_UINT64;
+         break;
+      case UR_TYPE_INT8:
+         test->kind = TEST_INT8;
+         break;
+      case UR_TYPE_INT16:
+         test->kind = TEST_INT16;
+         break;
+      case UR_TYPE_INT32:
+         test->kind = TEST_INT32;
+         break;
+      case UR_TYPE_INT64:
+         test->kind = TEST_INT64;
+         break;
+      default:
+         return;
+      }
+      break;
+   }
+   case NODE_T_EXPRESSION_FP: {
+      struct expression_fp *e = (struct expression_fp *) ast;
+      if (!field_present(tmplt, e->id)) {
+         return;
+      }
+      test->id = e->id;
+      test->mask = cmp_mask[e->cmp];
+      test->val.d = e->number;
+      if (ur_get_type(e->id) == UR_TYPE_FLOAT) {
+         test->kind = TEST_FLOAT;
+      } else if (ur_get_type(e->id) == UR_TYPE_DOUBLE) {
+         test->kind = TEST_DOUBLE;
+      } else {
+         printf("Warning: Type of %s is not float or double.\n", e->column);
+         return;
+      }
+      break;
+   }
+   case NODE_T_IP: {
+      struct ip *e = (struct ip *) ast;
+      if (!field_present(tmplt, e->id) || ur_get_type(e->id) != UR_TYPE_IP) {
+         return;
+      }
+      test->id = e->id;
+      test->mask = cmp_mask[e->cmp];
+      test->val.ip = e->ipAddr;
+      // Equality does not need ordering of addresses
+      test->kind = (test->mask == cmp_mask[OP_EQ] || test->mask == cmp_mask[OP_NE] ? TEST_IP_EQ : TEST_IP);
+      break;
+   }
+   case NODE_T_IP_SET: {
+      struct ipset *e = (struct ipset *) ast;
+      if (!field_present(tmplt, e->id) || ur_get_type(e->id) != UR_TYPE_IP || e->set == NULL) {
+         return;
+      }
+      test->id = e->id;
+      test->kind = TEST_IP_SET;
+      test->set = e->set;
+      break;
+   }
+   case NODE_T_STRING: {
+      struct str *e = (struct str *) ast;
+      if (!field_present(tmplt, e->id)) {
+         return;
+      }
+      test->id = e->id;
+      test->s = e->s;
+      test->len = strlen(e->s);
+      if (ur_get_type(e->id) == UR_TYPE_CHAR) {
+         // Regular expression is not supported for char, it is compared as inequality
+         test->kind = TEST_CHAR;
+         test->mask = (e->cmp == OP_EQ ? cmp_mask[OP_EQ] : cmp_mask[OP_NE]);
+         test->val.u = (test->len == 1 ? (uint8_t) e->s[0] : 0x100);
+      } else if (ur_is_dynamic(e->id)) {
+         if (e->cmp == OP_RE) {
+            test->kind = TEST_REGEX;
+            test->re = &e->re;
+         } else {
+            test->kind = TEST_STRING;
+            test->mask = cmp_mask[e->cmp];
+         }
+      } else {
+         return;
+      }
+      break;
+   }
+   case NODE_T_STR_SET: {
+      struct strset *e = (struct strset *) ast;
+      if (!field_present(tmplt, e->id) || !ur_is_dynamic(e->id) || e->set == NULL) {
+         return;
+      }
+      test->id = e->id;
+      test->kind = TEST_STR_SET;
+      test->mask = cmp_mask[e->cmp];
+      test->sset = e->set;
+      break;
+   }
+   default:
+      return;
+   }
+   if (!ur_is_dynamic(test->id)) {
+      test->offset = tmplt->offset[test->id];
+   }
+}
+
+/**
+ * Check whether two tests are equal (tests are zeroed before compilation, so values can be compared as memory).
+ */
+static int same_test(const struct filter_test *a, const struct filter_test *b)
+{
+   return a->kind == b->kind && a->mask == b->mask && a->id == b->id && a->len == b->len &&
+          memcmp(&a->val, &b->val, sizeof(a->val)) == 0 &&
+          (a->s == b->s || (a->s != NULL && b->s != NULL && memcmp(a->s, b->s, a->len) == 0)) &&
+          (a->set == b->set || (a->set != NULL && b->set != NULL && ip_set_equal(a->set, b->set))) &&
+          (a->sset == b->sset || (a->sset != NULL && b->sset != NULL && str_set_equal(a->sset, b->sset)));
+}
+
+/**
+ * Find node in graph or add a new one.
+ * \return Index of the node or -1 on memory allocation error.
+ */
+static int64_t add_node(struct compiler *c, int op, uint32_t a, uint32_t b)
+{
+   uint32_t i;
+
+   for (i = 0; i < c->n_nodes; i++) {
+      if (c->nodes[i].op == op && c->nodes[i].a == a && c->nodes[i].b == b) {
+         return i;
+      }
+   }
+   if (c->n_nodes == c->nodes_size) {
+      uint32_t size = (c->nodes_size ? 2 * c->nodes_size : 16);
+      struct dag_node *nodes = (struct dag_node *) realloc(c->nodes, size * sizeof(*nodes));
+      if (nodes == NULL) {
+         return -1;
+      }
+      c->nodes = nodes;
+      c->nodes_size = size;
+   }
+   c->nodes[c->n_nodes].op = op;
+   c->nodes[c->n_nodes].a = a;
+   c->nodes[c->n_nodes].b = b;
+   c->nodes[c->n_nodes].refs = 0;
+   c->nodes[c->n_nodes].slot = -1;
+   return c->n_nodes++;
+}
+
+/**
+ * Add subtree of syntax tree into graph, equal tests and subexpressions are merged.
+ * \return Index of node of the subtree or -1 on memory allocation error.
+ */
+static int64_t build_node(struct compiler *c, struct ast *ast, const ur_template_t *tmplt)
+{
+   int64_t l, r;
+   uint32_t i;
+   struct filter_test *test;
+
+   switch (ast->type) {
+   case NODE_T_AST:
+      if ((l = build_node(c, ast->l, tmplt)) < 0) {
+         return -1;
+      }
+      if (ast->operator == OP_NOP || ast->r == NULL) {
+         return l;
+      }
+      if ((r = build_node(c, ast->r, tmplt)) < 0) {
+         return -1;
+      }
+      return add_node(c, (ast->operator == OP_AND ? DAG_AND : DAG_OR), l, r);
+   case NODE_T_BRACKET:
+      return build_node(c, ((struct brack *) ast)->b, tmplt);
+   case NODE_T_NEGATION:
+      if ((l = build_node(c, ((struct brack *) ast)->b, tmplt)) < 0) {
+         return -1;
+      }
+      return add_node(c, DAG_NOT, l, 0);
+   default:
+      if ((test = new_test(c)) == NULL) {
+         return -1;
+      }
+      compile_test(test, ast, tmplt);
+      for (i = 0; i < c->prog->n_tests && !same_test(&c->prog->tests[i], test); i++);
+      if (i == c->prog->n_tests) {
+         c->prog->n_tests++;
+      }
+      return add_node(c, DAG_TEST, i, 0);
+   }
+}
+
+/**
+ * Generate code of node, result of the node is left in accumulator.
+ * Logical operators are compiled into conditional jumps over the second operand (short-circuit evaluation).
+ * Result of shared node is stored into its slot and the code of the node is skipped when the slot is valid.
+ *
+ * \return 0 on success, -1 on memory allocation error.
+ */
+static int gen_node(struct compiler *c, uint32_t index)
+{
+   const struct dag_node *node = &c->nodes[index];
+   int load = -1, jump;
+
+   if (node->slot >= 0 && (load = emit(c, INSN_LOAD, node->slot)) < 0) {
+      return -1;
+   }
+   switch (node->op) {
+   case DAG_TEST:
+      if (emit(c, INSN_TEST, node->a) < 0) {
+         return -1;
+      }
+      break;
+   case DAG_AND:
+   case DAG_OR:
+      if (gen_node(c, node->a) != 0 ||
+          (jump = emit(c, (node->op == DAG_AND ? INSN_JUMP_FALSE : INSN_JUMP_TRUE), 0)) < 0 ||
+          gen_node(c, node->b) != 0) {
+         return -1;
+      }
+      c->prog->code[jump].target = c->prog->n_code;
+      break;
+   case DAG_NOT:
+      if (gen_node(c, node->a) != 0 || emit(c, INSN_NOT, 0) < 0) {
+         return -1;
+      }
+      break;
+   }
+   if (node->slot >= 0) {
+      if (emit(c, INSN_STORE, node->slot) < 0) {
+         return -1;
+      }
+      c->prog->code[load].target = c->prog->n_code;
+   }
+   return 0;
+}
+
+/**
+ * \brief Compile syntax trees of filters of all outputs for given input template.
+ * Types and offsets of fields are resolved once, program has to be compiled again when input template changes.
+ * Equal tests and subexpressions of all filters are merged and evaluated at most once per record.
+ * \param[in] trees Syntax trees of outputs (NULL - output without filter), they must not be freed before the program.
+ * \param[in] n_trees Number of outputs (at most 32).
+ * \param[in] in_tmplt Input template.
+ * \return Compiled program or NULL on error.
+ */
+struct filter_program *compileAST(struct ast **trees, int n_trees, const ur_template_t *in_tmplt)
+{
+   struct compiler c;
+   struct filter_program *prog;
+   int64_t *roots = NULL;
+   uint32_t i;
+   int o;
+
+   memset(&c, 0, sizeof(c));
+   prog = c.prog = (struct filter_program *) calloc(1, sizeof(struct filter_program));
+   if (prog == NULL || (roots = (int64_t *) calloc(n_trees, sizeof(*roots))) == NULL ||
+       (prog->entry = (uint32_t *) calloc(n_trees, sizeof(uint32_t))) == NULL) {
+      goto error;
+   }
+   prog->tmplt = in_tmplt;
+   prog->n_outputs = n_trees;
+
+   // Build graph of all filters
+   for (o = 0; o < n_trees; o++) {
+      if (trees[o] == NULL) {
+         prog->match_all |= (1U << o);
+         roots[o] = -1;
+      } else if ((roots[o] = build_node(&c, trees[o], in_tmplt)) < 0) {
+         goto error;
+      } else {
+         c.nodes[roots[o]].refs++;
+      }
+   }
+
+   // Nodes referenced more than once keep their result for other references
+   for (i = 0; i < c.n_nodes; i++) {
+      if (c.nodes[i].op != DAG_TEST) {
+         c.nodes[c.nodes[i].a].refs++;
+      }
+      if (c.nodes[i].op == DAG_AND || c.nodes[i].op == DAG_OR) {
+         c.nodes[c.nodes[i].b].refs++;
+      }
+   }
+   for (i = 0; i < c.n_nodes; i++) {
+      if (c.nodes[i].refs > 1) {
+         c.nodes[i].slot = prog->n_slots++;
+      }
+   }
+   if (prog->n_slots > 0) {
+      prog->slot_epoch = (uint32_t *) calloc(prog->n_slots, sizeof(uint32_t));
+      prog->slot_value = (uint8_t *) calloc(prog->n_slots, sizeof(uint8_t));
+      if (prog->slot_epoch == NULL || prog->slot_value == NULL) {
+         goto error;
+      }
+   }
+
+   for (o = 0; o < n_trees; o++) {
+      if (roots[o] >= 0) {
+         prog->entry[o] = prog->n_code;
+         if (gen_node(&c, roots[o]) != 0 || emit(&c, INSN_END, 0) < 0) {
+            goto error;
+         }
+      }
+   }
+   free(roots);
+   free(c.nodes);
+   return prog;
+
+error:
+   fprintf(stderr, "Error: Not enough memory for compiled filter.\n");
+   free(roots);
+   free(c.nodes);
+   freeProgram(prog);
+   return NULL;
+}
+
+void freeProgram(struct filter_program *prog)
+{
+   if (prog == NULL) {
+      return;
+   }
+   free(prog->tests);
+   free(prog->code);
+   free(prog->entry);
+   free(prog->slot_epoch);
+   free(prog->slot_value);
+   free(prog);
+}
+
+// Result of comparison as index into mask of accepted results
+#define ORDER(a, b) (((a) > (b)) - ((a) < (b)) + 1)
+
+#define FIELD(type) (*(const type *) ((const char *) in_rec + test->offset))
+
+static inline int order_fp(double a, double b)
+{
+   if (fabs(a - b) < FP_EPS) {
+      return 1;
+   }
+   return (a < b ? 0 : 2);
+}
+
+/**
+ * Evaluate one test on record.
+ */
+static inline int eval_test(const struct filter_test *test, const ur_template_t *tmplt, const void *in_rec)
+{
+   int res;
+   const char *str;
+   uint16_t size;
+
+   switch (test->kind) {
+   case TEST_UINT8:
+      res = ORDER((uint64_t) FIELD(uint8_t), test->val.u);
+      break;
+   case TEST_UINT16:
+      res = ORDER((uint64_t) FIELD(uint16_t), test->val.u);
+      break;
+   case TEST_UINT32:
+      res = ORDER((uint64_t) FIELD(uint32_t), test->val.u);
+      break;
+   case TEST_UINT64:
+      res = ORDER(FIELD(uint64_t), test->val.u);
+      break;
+   case TEST_INT8:
+      res = ORDER((int64_t) FIELD(int8_t), test->val.i);
+      break;
+   case TEST_INT16:
+      res = ORDER((int64_t) FIELD(int16_t), test->val.i);
+      break;
+   case TEST_INT32:
+      res = ORDER((int64_t) FIELD(int32_t), test->val.i);
+      break;
+   case TEST_INT64:
+      res = ORDER(FIELD(int64_t), test->val.i);
+      break;
+   case TEST_FLOAT:
+      res = order_fp(FIELD(float), test->val.d);
+      break;
+   case TEST_DOUBLE:
+      res = order_fp(FIELD(double), test->val.d);
+      break;
+   case TEST_IP:
+      res = ip_cmp(&FIELD(ip_addr_t), &test->val.ip);
+      res = (res > 0) - (res < 0) + 1;
+      break;
+   case TEST_IP_EQ:
+      res = (FIELD(ip_addr_t).ui64[0] == test->val.ip.ui64[0] && FIELD(ip_addr_t).ui64[1] == test->val.ip.ui64[1]);
+      break;
+   case TEST_IP_SET:
+      return ip_set_contains(test->set, &FIELD(ip_addr_t));
+   case TEST_CHAR:
+      res = ((uint8_t) FIELD(char) == test->val.u);
+      break;
+   case TEST_STRING:
+      size = ur_get_var_len(tmplt, in_rec, test->id);
+      str = (const char *) ur_get_ptr_by_id(tmplt, in_rec, test->id);
+      res = (size == test->len && memcmp(str, test->s, size) == 0);
+      break;
+   case TEST_REGEX: {
+      size = ur_get_var_len(tmplt, in_rec, test->id);
+      str = (const char *) ur_get_ptr_by_id(tmplt, in_rec, test->id);
+#ifdef REG_STARTEND
+      // Field is matched in place, it does not have to be terminated by zero
+      regmatch_t range;
+      range.rm_so = 0;
+      range.rm_eo = size;
+      return regexec(test->re, str, 1, &range, REG_STARTEND) != REG_NOMATCH;
+#else
+      memcpy(str_buffer, str, size);
+      str_buffer[size] = '\0';
+      return regexec(test->re, str_buffer, 0, NULL, 0) != REG_NOMATCH;
+#endif
+   }
+   case TEST_STR_SET:
+      size = ur_get_var_len(tmplt, in_rec, test->id);
+      str = (const char *) ur_get_ptr_by_id(tmplt, in_rec, test->id);
+      res = str_set_match(test->sset, str, size);
+      break;
+   default:
+      return 0;
+   }
+   // Equality tests (res is 0 or 1) use bit 0 of symmetric mask for inequality
+   return (test->mask >> res) & 1;
+}
+
+/**
+ * Run code of one output.
+ */
+static inline int run(struct filter_program *prog, const struct filter_insn *insn, const void *in_rec)
+{
+   int acc = 0;
+
+   while (1) {
+      switch (insn->op) {
+      case INSN_TEST:
+         acc = eval_test(&prog->tests[insn->arg], prog->tmplt, in_rec);
+         insn++;
+         break;
+      case INSN_JUMP_FALSE:
+         insn = (acc ? insn + 1 : prog->code + insn->target);
+         break;
+      case INSN_JUMP_TRUE:
+         insn = (acc ? prog->code + insn->target : insn + 1);
+         break;
+      case INSN_NOT:
+         acc = !acc;
+         insn++;
+         break;
+      case INSN_LOAD:
+         if (prog->slot_epoch[insn->arg] == prog->epoch) {
+            acc = prog->slot_value[insn->arg];
+            insn = prog->code + insn->target;
+         } else {
+            insn++;
+         }
+         break;
+      case INSN_STORE:
+         prog->slot_epoch[insn->arg] = prog->epoch;
+         prog->slot_value[insn->arg] = acc;
+         insn++;
+         break;
+      default:
+         return acc;
+      }
+   }
+}
+
+/**
+ * \brief Evaluate filters of all outputs on record.
+ * \param[in] prog Program compiled for template of the record.
+ * \param[in] in_rec Record.
+ * \return Bitmask of outputs whose filter matches the record.
+ */
+uint32_t evalProgram(struct filter_program *prog, const void *in_rec)
+{
+   uint32_t result = prog->match_all;
+   int o;
+
+   // Results of shared subexpressions are valid for one record only
+   if (++prog->epoch == 0) {
+      memset(prog->slot_epoch, 0, prog->n_slots * sizeof(uint32_t));
+      prog->epoch = 1;
+   }
+   for (o = 0; o < prog->n_outputs; o++) {
+      if (!(result & (1U << o)) && run(prog, prog->code + prog->entry[o], in_rec)) {
+         result |= (1U << o);
+      }
+   }
+   return result;
+}
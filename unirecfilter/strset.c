@@ -0,0 +1,487 @@
+/**
+ * \file strset.c
+ * \brief Sets of strings and patterns used by filter (hash table and Aho-Corasick automaton).
+ * \date 2016
+ */
+/*
+ * Copyright (C) 2016 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unirecfilter.h"
+
+#define REGEX_SPECIAL ".[]()*+?{}|^$\\" // Characters with special meaning in extended regular expression
+
+/* Flags of states of automaton */
+#define AC_ANY   0x1 // Pattern without anchors ends in the state or in its suffix
+#define AC_START 0x2 // Pattern anchored at the start of string ends in the state
+#define AC_END   0x4 // Pattern anchored at the end of string ends in the state or in its suffix
+
+struct str_set *str_set_create()
+{
+   struct str_set *set = (struct str_set *) calloc(1, sizeof(struct str_set));
+   if (set == NULL) {
+      fprintf(stderr, "Error: Not enough memory for set of strings.\n");
+   }
+   return set;
+}
+
+void str_set_free(struct str_set *set)
+{
+   uint32_t i;
+
+   if (set == NULL) {
+      return;
+   }
+   for (i = 0; i < set->n; i++) {
+      free(set->pattern[i]);
+   }
+   for (i = 0; i < set->n_exact; i++) {
+      free((char *) set->exact[i].s);
+   }
+   free(set->pattern);
+   free(set->exact);
+   free(set->table);
+   free(set->delta);
+   free(set->depth);
+   free(set->flags);
+   if (set->has_re) {
+      regfree(&set->re);
+   }
+   free(set);
+}
+
+/**
+ * \brief Add string or pattern to set.
+ * \return 0 on success, -1 on memory allocation error.
+ */
+int str_set_add(struct str_set *set, const char *str)
+{
+   if (set->n == set->size) {
+      uint32_t size = (set->size ? 2 * set->size : 16);
+      char **pattern = (char **) realloc(set->pattern, size * sizeof(*pattern));
+      if (pattern == NULL) {
+         fprintf(stderr, "Error: Not enough memory for set of strings.\n");
+         return -1;
+      }
+      set->pattern = pattern;
+      set->size = size;
+   }
+   if ((set->pattern[set->n] = strdup(str)) == NULL) {
+      fprintf(stderr, "Error: Not enough memory for set of strings.\n");
+      return -1;
+   }
+   set->n++;
+   return 0;
+}
+
+/**
+ * \brief Load strings from file - one per line, empty lines and lines starting with # are skipped.
+ * \param[in] set Set of strings.
+ * \param[in] filename Name of file.
+ * \return 0 on success, -1 on error.
+ */
+int str_set_load(struct str_set *set, const char *filename)
+{
+   char *line = NULL;
+   size_t size = 0;
+   ssize_t len;
+   FILE *f = fopen(filename, "r");
+
+   if (f == NULL) {
+      fprintf(stderr, "Error: File %s could not be opened.\n", filename);
+      return -1;
+   }
+   while ((len = getline(&line, &size, f)) >= 0) {
+      while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+         line[--len] = '\0';
+      }
+      if (len == 0 || line[0] == '#') {
+         continue;
+      }
+      if (str_set_add(set, line) != 0) {
+         free(line);
+         fclose(f);
+         return -1;
+      }
+   }
+   free(line);
+   fclose(f);
+   return 0;
+}
+
+// FNV-1a hash of string
+static inline uint32_t hash_str(const char *str, size_t len)
+{
+   uint32_t h = 2166136261U;
+   size_t i;
+
+   for (i = 0; i < len; i++) {
+      h = (h ^ (uint8_t) str[i]) * 16777619U;
+   }
+   return h;
+}
+
+static int add_exact(struct str_set *set, const char *str, size_t len)
+{
+   char *s = (char *) malloc(len + 1);
+
+   if (s == NULL) {
+      return -1;
+   }
+   memcpy(s, str, len);
+   s[len] = '\0';
+   set->exact[set->n_exact].s = s;
+   set->exact[set->n_exact].len = len;
+   set->n_exact++;
+   return 0;
+}
+
+/**
+ * Build hash table of exact strings (open addressing with linear probing, at most half full).
+ */
+static int build_table(struct str_set *set)
+{
+   uint32_t size = 16, i, j;
+
+   while (size < 2 * set->n_exact) {
+      size *= 2;
+   }
+   if ((set->table = (uint32_t *) calloc(size, sizeof(uint32_t))) == NULL) {
+      return -1;
+   }
+   set->table_mask = size - 1;
+   for (i = 0; i < set->n_exact; i++) {
+      j = hash_str(set->exact[i].s, set->exact[i].len) & set->table_mask;
+      while (set->table[j] != 0) {
+         j = (j + 1) & set->table_mask;
+      }
+      set->table[j] = i + 1;
+   }
+   return 0;
+}
+
+/**
+ * Decode regular expression consisting only of (escaped) literal characters and anchors.
+ * \param[in] p Pattern.
+ * \param[out] out Decoded literal (at least as long as pattern).
+ * \param[out] out_len Length of literal.
+ * \param[out] anchors AC_START and AC_END flags of anchors.
+ * \return 1 if pattern is literal, 0 otherwise.
+ */
+static int literal_pattern(const char *p, char *out, size_t *out_len, uint8_t *anchors)
+{
+   size_t n = 0;
+
+   *anchors = 0;
+   if (*p == '^') {
+      *anchors |= AC_START;
+      p++;
+   }
+   for (; *p != '\0'; p++) {
+      if (*p == '$' && p[1] == '\0') {
+         *anchors |= AC_END;
+         break;
+      }
+      if (*p == '\\') {
+         if (p[1] == '\0' || strchr(REGEX_SPECIAL, p[1]) == NULL) {
+            return 0;
+         }
+         p++;
+      } else if (strchr(REGEX_SPECIAL, *p) != NULL) {
+         return 0;
+      }
+      out[n++] = *p;
+   }
+   *out_len = n;
+   return 1;
+}
+
+/**
+ * Build Aho-Corasick automaton of literal patterns as complete table of transitions.
+ * Bytes not present in any pattern share class 0.
+ */
+static int build_automaton(struct str_set *set, const struct str_entry *lit, const uint8_t *lit_flags, uint32_t n_lit)
+{
+   size_t max_states = 1, n_cls = 1;
+   uint32_t i, s, c, t, head = 0, tail = 0;
+   uint32_t *fail = NULL, *queue = NULL;
+   size_t j;
+
+   memset(set->cls, 0, sizeof(set->cls));
+   for (i = 0; i < n_lit; i++) {
+      for (j = 0; j < lit[i].len; j++) {
+         if (set->cls[(uint8_t) lit[i].s[j]] == 0) {
+            set->cls[(uint8_t) lit[i].s[j]] = n_cls++;
+         }
+      }
+      max_states += lit[i].len;
+   }
+   set->n_cls = n_cls;
+   set->delta = (uint32_t *) calloc(max_states * n_cls, sizeof(uint32_t));
+   set->depth = (uint32_t *) calloc(max_states, sizeof(uint32_t));
+   set->flags = (uint8_t *) calloc(max_states, sizeof(uint8_t));
+   fail = (uint32_t *) calloc(max_states, sizeof(uint32_t));
+   queue = (uint32_t *) malloc(max_states * sizeof(uint32_t));
+   if (set->delta == NULL || set->depth == NULL || set->flags == NULL || fail == NULL || queue == NULL) {
+      free(fail);
+      free(queue);
+      return -1;
+   }
+
+   // Trie of patterns, transition to state 0 means missing edge
+   set->n_states = 1;
+   for (i = 0; i < n_lit; i++) {
+      for (j = 0, s = 0; j < lit[i].len; j++) {
+         uint32_t *edge = &set->delta[s * n_cls + set->cls[(uint8_t) lit[i].s[j]]];
+         if (*edge == 0) {
+            *edge = set->n_states;
+            set->depth[set->n_states] = set->depth[s] + 1;
+            set->n_states++;
+         }
+         s = *edge;
+      }
+      set->flags[s] |= lit_flags[i];
+   }
+
+   // Failure links in breadth-first order, missing edges are replaced by edges of failure state
+   for (c = 0; c < n_cls; c++) {
+      if ((t = set->delta[c]) != 0) {
+         queue[tail++] = t;
+      }
+   }
+   while (head < tail) {
+      s = queue[head++];
+      set->flags[s] |= set->flags[fail[s]] & (AC_ANY | AC_END);
+      for (c = 0; c < n_cls; c++) {
+         uint32_t *edge = &set->delta[s * n_cls + c];
+         if (*edge != 0) {
+            fail[*edge] = set->delta[fail[s] * n_cls + c];
+            queue[tail++] = *edge;
+         } else {
+            *edge = set->delta[fail[s] * n_cls + c];
+         }
+      }
+   }
+   free(fail);
+   free(queue);
+   return 0;
+}
+
+/**
+ * \brief Prepare set for matching, must be called before lookups.
+ * Exact strings are stored in hash table. Regular expressions consisting only of literal characters
+ * are matched by Aho-Corasick automaton (anchored at both ends by hash table), the remaining ones
+ * are joined into one alternation, so all patterns are matched in a single pass over string.
+ * \param[in] set Set of strings.
+ * \param[in] regex Members are regular expressions.
+ * \return 0 on success, -1 on memory allocation error.
+ */
+int str_set_finish(struct str_set *set, int regex)
+{
+   struct str_entry *lit = NULL;
+   uint8_t *lit_flags = NULL;
+   char *alt = NULL, *decoded = NULL;
+   size_t alt_len = 0, max_len = 0, len;
+   uint32_t i, n_lit = 0;
+   uint8_t anchors;
+   regex_t re;
+   int ret = -1;
+
+   set->regex = regex;
+   if (set->n == 0) {
+      return 0;
+   }
+   for (i = 0; i < set->n; i++) {
+      len = strlen(set->pattern[i]);
+      alt_len += len + 3;
+      if (len > max_len) {
+         max_len = len;
+      }
+   }
+   if ((set->exact = (struct str_entry *) malloc(set->n * sizeof(struct str_entry))) == NULL) {
+      goto exit;
+   }
+   if (!regex) {
+      for (i = 0; i < set->n; i++) {
+         if (add_exact(set, set->pattern[i], strlen(set->pattern[i])) != 0) {
+            goto exit;
+         }
+      }
+      ret = build_table(set);
+      goto exit;
+   }
+
+   lit = (struct str_entry *) malloc(set->n * sizeof(struct str_entry));
+   lit_flags = (uint8_t *) malloc(set->n);
+   alt = (char *) malloc(alt_len + 1);
+   if (lit == NULL || lit_flags == NULL || alt == NULL) {
+      goto exit;
+   }
+   alt_len = 0;
+   for (i = 0; i < set->n; i++) {
+      const char *p = set->pattern[i];
+      if ((decoded = (char *) malloc(max_len + 1)) == NULL) {
+         goto exit;
+      }
+      if (literal_pattern(p, decoded, &len, &anchors)) {
+         if (anchors == (AC_START | AC_END)) {
+            if (add_exact(set, decoded, len) != 0) {
+               goto exit;
+            }
+            free(decoded);
+         } else {
+            lit[n_lit].s = decoded;
+            lit[n_lit].len = len;
+            lit_flags[n_lit++] = (anchors ? anchors : AC_ANY);
+         }
+         decoded = NULL;
+         continue;
+      }
+      free(decoded);
+      decoded = NULL;
+      // Back-references would be renumbered by joining patterns
+      for (len = 0; p[len] != '\0' && !(p[len] == '\\' && p[len + 1] >= '1' && p[len + 1] <= '9'); len++) {
+         if (p[len] == '\\' && p[len + 1] != '\0') {
+            len++; // Skip escaped character, trailing backslash is left to regcomp
+         }
+      }
+      if (p[len] != '\0') {
+         printf("Warning: Back-references are not supported in set of patterns, %s is skipped.\n", p);
+         continue;
+      }
+      if (regcomp(&re, p, REG_EXTENDED | REG_NOSUB) != 0) {
+         printf("Regexp error: %s is not a valid regular expression.\n", p);
+         continue;
+      }
+      regfree(&re);
+      alt_len += sprintf(alt + alt_len, "%s(%s)", (alt_len ? "|" : ""), p);
+   }
+
+   if (build_table(set) != 0 || (n_lit > 0 && build_automaton(set, lit, lit_flags, n_lit) != 0)) {
+      goto exit;
+   }
+   if (alt_len > 0) {
+      if (regcomp(&set->re, alt, REG_EXTENDED | REG_NOSUB) != 0) {
+         printf("Regexp error: Patterns could not be joined into one regular expression.\n");
+      } else {
+         set->has_re = 1;
+      }
+   }
+   ret = 0;
+
+exit:
+   if (lit != NULL) {
+      for (i = 0; i < n_lit; i++) {
+         free((char *) lit[i].s);
+      }
+   }
+   free(lit);
+   free(lit_flags);
+   free(alt);
+   free(decoded);
+   if (ret != 0) {
+      fprintf(stderr, "Error: Not enough memory for set of strings.\n");
+   }
+   return ret;
+}
+
+/**
+ * \brief Check whether string (not terminated by zero) is in set or matches any pattern of set.
+ */
+int str_set_match(const struct str_set *set, const char *str, size_t len)
+{
+   uint32_t i;
+
+   if (set->n_exact > 0) {
+      for (i = hash_str(str, len) & set->table_mask; set->table[i] != 0; i = (i + 1) & set->table_mask) {
+         const struct str_entry *e = &set->exact[set->table[i] - 1];
+         if (e->len == len && memcmp(e->s, str, len) == 0) {
+            return 1;
+         }
+      }
+   }
+   if (set->n_states > 0) {
+      const uint32_t *delta = set->delta;
+      uint32_t s = 0;
+      size_t j;
+
+      if (set->flags[0] != 0) {
+         return 1; // Empty pattern
+      }
+      for (j = 0; j < len; j++) {
+         s = delta[s * set->n_cls + set->cls[(uint8_t) str[j]]];
+         if ((set->flags[s] & AC_ANY) || ((set->flags[s] & AC_START) && set->depth[s] == j + 1)) {
+            return 1;
+         }
+      }
+      if (set->flags[s] & AC_END) {
+         return 1;
+      }
+   }
+   if (set->has_re) {
+#ifdef REG_STARTEND
+      regmatch_t range;
+      range.rm_so = 0;
+      range.rm_eo = len;
+      return regexec(&set->re, str, 1, &range, REG_STARTEND) == 0;
+#else
+      memcpy(str_buffer, str, len);
+      str_buffer[len] = '\0';
+      return regexec(&set->re, str_buffer, 0, NULL, 0) == 0;
+#endif
+   }
+   return 0;
+}
+
+/**
+ * \brief Check whether two (finished) sets have the same members.
+ */
+int str_set_equal(const struct str_set *a, const struct str_set *b)
+{
+   uint32_t i;
+
+   if (a->regex != b->regex || a->n != b->n) {
+      return 0;
+   }
+   for (i = 0; i < a->n; i++) {
+      if (strcmp(a->pattern[i], b->pattern[i]) != 0) {
+         return 0;
+      }
+   }
+   return 1;
+}
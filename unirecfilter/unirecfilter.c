@@ -92,7 +92,7 @@ unsigned int num_records = 0;      // Number of records received (total of all i
 unsigned int max_num_records = 0;  // Exit after this number of records is received
 unsigned int max_num_ifaces = 32;  // Maximum number of output interfaces
 
-char *str_buffer = NULL;           // Auxiliary buffer for evalAST()
+char *str_buffer = NULL;           // Zero-terminated copy of string field for regexec() without REG_STARTEND
 
 // Function to handle SIGTERM and SIGINT signals (used to stop the module)
 TRAP_DEFAULT_SIGNAL_HANDLER(stop = 1);
@@ -355,9 +355,6 @@ float, double, ipaddr, string, bytes\n");
          fprintf(stderr, "ERROR: output data format is not set.\n");
       }
 
-      // Get Abstract syntax tree from filter
-      output_specifiers[i]->tree = getTree(output_specifiers[i]->filter, port_numbers[i]);
-
       // Calculate maximum needed memory for dynamic fields
       ur_field_id_t field_id = UR_ITER_BEGIN;
       while ((field_id = ur_iter_fields(output_specifiers[i]->out_tmplt, field_id)) != UR_ITER_END) {
@@ -371,9 +368,71 @@ float, double, ipaddr, string, bytes\n");
    return 0;
 }
 
+// Get abstract syntax trees of filters of all outputs, trees of previous filters are replaced only when all filters are valid
+int parse_filters(int n_outputs, char **port_numbers, struct unirec_output_t **output_specifiers)
+{
+   struct ast *trees[32];
+   int i;
+
+   for (i = 0; i < n_outputs; i++) {
+      trees[i] = getTree(output_specifiers[i]->filter, port_numbers[i]);
+      if (trees[i] == NULL && output_specifiers[i]->filter != NULL && output_specifiers[i]->filter[0] != '\0') {
+         fprintf(stderr, "Error: filter of output %s is not valid.\n", port_numbers[i]);
+         while (i-- > 0) {
+            freeAST(trees[i]);
+         }
+         return -3;
+      }
+   }
+   for (i = 0; i < n_outputs; i++) {
+      freeAST(output_specifiers[i]->tree);
+      output_specifiers[i]->tree = trees[i];
+   }
+   return 0;
+}
+
+// Compile filters of all outputs for input template, filters have to be compiled again when input template changes
+int compile_filters(struct filter_program **filters, int n_outputs, struct unirec_output_t **output_specifiers, const ur_template_t *in_tmplt)
+{
+   struct ast *trees[32];
+   int i;
+
+   for (i = 0; i < n_outputs; i++) {
+      trees[i] = output_specifiers[i]->tree;
+   }
+   freeProgram(*filters);
+   if ((*filters = compileAST(trees, n_outputs, in_tmplt)) == NULL) {
+      return -1;
+   }
+   if (verbose >= 0) {
+      printf("VERBOSE: Filters compiled: %u distinct tests, %u shared subexpressions\n", (*filters)->n_tests, (*filters)->n_slots);
+   }
+   return 0;
+}
+
+// Update input template when data format changes
+int update_input_template(ur_template_t **in_tmplt)
+{
+   const char *spec = NULL;
+   uint8_t data_fmt;
+
+   if (trap_get_data_fmt(TRAPIFC_INPUT, 0, &data_fmt, &spec) != TRAP_E_OK) {
+      fprintf(stderr, "Data format was not loaded.\n");
+      return -1;
+   }
+   *in_tmplt = ur_define_fields_and_update_template(spec, *in_tmplt);
+   if (*in_tmplt == NULL) {
+      fprintf(stderr, "Template could not be edited.\n");
+      return -1;
+   }
+   return 0;
+}
+
 int main(int argc, char **argv)
 {
    struct unirec_output_t **output_specifiers = NULL; // filters and output specifiers
+   struct filter_program *filters = NULL; // filters of all outputs compiled for input template
+   uint32_t matched; // outputs whose filter matches the record
    char **port_numbers;
    char *output_specifier_str = NULL;
    char *filter = NULL;
@@ -575,8 +634,10 @@ int main(int argc, char **argv)
          output_specifiers[i]->output_specifier_str = ur_cpy_string(req_format);
       }
    }
-   // Create templates from output specifiers
-   if ((ret = create_templates(n_outputs, port_numbers, output_specifiers)) != 0) {
+   // Create templates from output specifiers and compile filters
+   if ((ret = create_templates(n_outputs, port_numbers, output_specifiers)) != 0 ||
+       (ret = parse_filters(n_outputs, port_numbers, output_specifiers)) != 0 ||
+       (ret = compile_filters(&filters, n_outputs, output_specifiers, in_tmplt)) != 0) {
       for (i = 0; i < n_outputs; i++) {
          free(port_numbers[i]);
       }
@@ -604,7 +665,14 @@ int main(int argc, char **argv)
    // Copy data from input to output
    while (!stop) {
       // Receive data from any input interface, wait until data are available
-      ret = TRAP_RECEIVE(0, in_rec, in_rec_size, in_tmplt);
+      ret = trap_recv(0, &in_rec, &in_rec_size);
+      if (ret == TRAP_E_FORMAT_CHANGED) {
+         // Offsets of fields are resolved in compiled filters
+         if (update_input_template(&in_tmplt) != 0 || compile_filters(&filters, n_outputs, output_specifiers, in_tmplt) != 0) {
+            break;
+         }
+         ret = TRAP_E_OK;
+      }
       TRAP_DEFAULT_RECV_ERROR_HANDLING(ret, continue, break);
       // Check size of received data
       if (in_rec_size < ur_rec_fixlen_size(in_tmplt)) {
@@ -620,8 +688,9 @@ int main(int argc, char **argv)
       }
 
       // PROCESS THE DATA
+      matched = evalProgram(filters, in_rec);
       for (i = 0; i < n_outputs; i++) {
-         if (!(output_specifiers[i]->tree) || (output_specifiers[i]->tree && evalAST(output_specifiers[i]->tree, in_tmplt, in_rec))) {
+         if (matched & (1U << i)) {
             if (verbose >= 1) {
                printf("ADVANCED VERBOSE: Record %d accepted on interface %d\n", num_records, i);
             }
@@ -666,9 +735,15 @@ int main(int argc, char **argv)
          printf("\nReloading filter...\n\n");
          printf("New filter:\n");
 
-         if (get_filter_from_file(filename, output_specifiers, n_outputs) != 0
-            || create_templates(n_outputs, port_numbers, output_specifiers) != 0) {
-               stop = 1;
+         // Filter from command line is parsed again to reload files with prefixes
+         if (filename != NULL && get_filter_from_file(filename, output_specifiers, n_outputs) != 0) {
+            stop = 1;
+         } else if (parse_filters(n_outputs, port_numbers, output_specifiers) != 0) {
+            // Invalid filter or set file which could not be loaded, previous filters stay in use
+            printf("Warning: Filter was not reloaded, previous filter is used.\n");
+         } else if (create_templates(n_outputs, port_numbers, output_specifiers) != 0
+            || compile_filters(&filters, n_outputs, output_specifiers, in_tmplt) != 0) {
+            stop = 1;
          }
          reload_filter = 0;
       }
@@ -695,6 +770,7 @@ int main(int argc, char **argv)
    ur_free_template(in_tmplt);
    free(req_format);
 
+   freeProgram(filters);
    for (i = 0; i < n_outputs; i++) {
       if (output_specifiers[i]->tree != NULL) {
          freeAST(output_specifiers[i]->tree);
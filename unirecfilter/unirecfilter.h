@@ -59,7 +59,7 @@ memset(ur_get_ptr_by_id(tmpl, data, field_id), 0, ur_get_size(field_id));
 /* Used for types of expression nodes in abstract syntax tree */
 typedef enum { NODE_T_AST, NODE_T_EXPRESSION, NODE_T_EXPRESSION_FP,
                NODE_T_PROTOCOL, NODE_T_IP, NODE_T_STRING,
-               NODE_T_BRACKET, NODE_T_NEGATION } node_type;
+               NODE_T_BRACKET, NODE_T_NEGATION, NODE_T_IP_SET, NODE_T_STR_SET } node_type;
 
 /* Used for describing comparison operators */
 typedef enum { OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE, OP_RE /* regex match */, OP_INVALID } cmp_op;
@@ -116,18 +116,153 @@ struct str {
    ur_field_id_t id;
 };
 
+/* Range of IPv4 addresses */
+struct ip_range4 {
+   uint32_t low;
+   uint32_t high;
+};
+
+/* Range of IPv6 addresses, [0] is the upper half of address */
+struct ip_range6 {
+   uint64_t low[2];
+   uint64_t high[2];
+};
+
+/* Set of IP prefixes - sorted disjoint ranges of addresses */
+struct ip_set {
+   struct ip_range4 *v4;
+   uint32_t n_v4;
+   uint32_t size_v4;
+   struct ip_range6 *v6;
+   uint32_t n_v6;
+   uint32_t size_v6;
+};
+
+struct ipset {
+   node_type type;
+   char *column;
+   char *file;             // File with prefixes (NULL for list in filter)
+   struct ip_set *set;
+   ur_field_id_t id;
+};
+
+/* String of set (exact string or literal pattern) */
+struct str_entry {
+   const char *s;
+   size_t len;
+};
+
+/* Set of strings or regular expressions matched in one pass over string */
+struct str_set {
+   int regex;              // Members are regular expressions, otherwise exact strings
+   char **pattern;         // Members in order of addition
+   uint32_t n;
+   uint32_t size;
+   /* Hash table of exact strings (index of entry + 1, 0 is empty slot) */
+   struct str_entry *exact;
+   uint32_t n_exact;
+   uint32_t *table;
+   uint32_t table_mask;
+   /* Aho-Corasick automaton of literal patterns, transitions over classes of bytes */
+   uint16_t cls[256];
+   uint32_t n_cls;
+   uint32_t *delta;
+   uint32_t *depth;
+   uint8_t *flags;
+   uint32_t n_states;
+   /* Alternation of the remaining regular expressions */
+   regex_t re;
+   int has_re;
+};
+
+struct strset {
+   node_type type;
+   cmp_op cmp;             // OP_EQ or OP_NE - exact strings, OP_RE - regular expressions
+   char *column;
+   char *file;             // File with strings (NULL for list in filter)
+   struct str_set *set;
+   ur_field_id_t id;
+};
+
 struct brack {
    node_type type;
    struct ast *b;
 };
 
+/* Kinds of tests of compiled filter (leaves of syntax tree with resolved field type) */
+typedef enum { TEST_FALSE, TEST_UINT8, TEST_UINT16, TEST_UINT32, TEST_UINT64,
+               TEST_INT8, TEST_INT16, TEST_INT32, TEST_INT64, TEST_FLOAT, TEST_DOUBLE,
+               TEST_IP, TEST_IP_EQ, TEST_IP_SET, TEST_CHAR, TEST_STRING, TEST_REGEX, TEST_STR_SET } test_kind;
+
+/* Instructions of compiled filter, result of the last test is kept in accumulator */
+typedef enum { INSN_TEST, INSN_JUMP_FALSE, INSN_JUMP_TRUE, INSN_NOT,
+               INSN_LOAD /* load result of shared subexpression if it was already evaluated */,
+               INSN_STORE /* store result of shared subexpression */, INSN_END } insn_op;
+
+/* Test of one field */
+struct filter_test {
+   test_kind kind;
+   uint8_t mask;           // Accepted results of comparison: bit 0 - lower, bit 1 - equal, bit 2 - greater
+   uint16_t offset;        // Offset of static field in record
+   ur_field_id_t id;
+   union {
+      uint64_t u;
+      int64_t i;
+      double d;
+      ip_addr_t ip;
+   } val;
+   const char *s;          // String value (owned by syntax tree)
+   size_t len;
+   regex_t *re;
+   const struct ip_set *set;
+   const struct str_set *sset;
+};
+
+struct filter_insn {
+   insn_op op;
+   uint32_t arg;           // Index of test or slot of shared subexpression
+   uint32_t target;        // Target of jump
+};
+
+/* Filters of all outputs compiled together for input template, common subexpressions are evaluated once per record */
+struct filter_program {
+   const ur_template_t *tmplt;
+   struct filter_test *tests;
+   uint32_t n_tests;
+   struct filter_insn *code;
+   uint32_t n_code;
+   uint32_t *entry;        // Start of code of each output
+   int n_outputs;
+   uint32_t match_all;     // Outputs without filter
+   uint32_t n_slots;       // Results of shared subexpressions
+   uint32_t *slot_epoch;   // Record for which the slot is valid
+   uint8_t *slot_value;
+   uint32_t epoch;         // Number of the current record
+};
+
 int yylex();
 int yyparse();
 void printAST(struct ast *ast);
-int evalAST(struct ast *ast, const ur_template_t *in_tmplt, const void *in_rec);
 void freeAST(struct ast *tree);
 struct ast *getTree(const char *str, const char *port_number);
 void changeProtocol(struct ast **ast);
+struct filter_program *compileAST(struct ast **trees, int n_trees, const ur_template_t *in_tmplt);
+uint32_t evalProgram(struct filter_program *prog, const void *in_rec);
+void freeProgram(struct filter_program *prog);
+struct ip_set *ip_set_create();
+void ip_set_free(struct ip_set *set);
+int ip_set_add(struct ip_set *set, const char *str);
+int ip_set_load(struct ip_set *set, const char *filename);
+void ip_set_finish(struct ip_set *set);
+int ip_set_contains(const struct ip_set *set, const ip_addr_t *ip);
+int ip_set_equal(const struct ip_set *a, const struct ip_set *b);
+struct str_set *str_set_create();
+void str_set_free(struct str_set *set);
+int str_set_add(struct str_set *set, const char *str);
+int str_set_load(struct str_set *set, const char *filename);
+int str_set_finish(struct str_set *set, int regex);
+int str_set_match(const struct str_set *set, const char *str, size_t len);
+int str_set_equal(const struct str_set *a, const struct str_set *b);
 
 extern char * str_buffer;
 